@@ -0,0 +1,28 @@
+/*  APEX OpenMP Policy
+ *
+ *  Copyright (c) 2015 University of Oregon
+ *
+ *  Distributed under the Boost Software License, Version 1.0. (See accompanying
+ *  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+#ifndef APEX_OPENMP_POLICY_H
+#define APEX_OPENMP_POLICY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Gives the policy a hint about the amount of work (for example the trip
+ * count of the loop) in the next OpenMP parallel region started on the
+ * calling thread. Invocations of the same region whose work sizes fall in
+ * different buckets (powers of 2^APEX_OPENMP_CONTEXT_GRANULARITY) are tuned
+ * separately and get separate history entries. The hint applies to one
+ * region only. Applications using it link against libapex_openmp_policy. */
+void apex_openmp_policy_set_work_size(long long work_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
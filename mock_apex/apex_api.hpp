@@ -0,0 +1,57 @@
+//  APEX OpenMP Policy
+//
+//  Copyright (c) 2015 University of Oregon
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+// Mock of the APEX API used by the policy and its tools. Timers fire the
+// registered start and stop policies synchronously on the calling thread,
+// as APEX does; plugins are loaded by init() from APEX_PLUGINS_PATH. There
+// is no OMPT support, so OpenMP regions only produce events when a program
+// starts and stops them itself.
+
+#include <functional>
+#include <string>
+
+#include "apex_types.h"
+
+namespace apex {
+
+class task_identifier {
+    public:
+        std::string name;
+        bool has_name = true;
+
+        std::string get_name(bool resolve = true) {
+            (void) resolve;
+            return name;
+        }
+};
+
+class profiler;
+
+void init(const char * thread_name, uint64_t comm_rank, uint64_t comm_size);
+void finalize();
+void register_thread(const std::string & name);
+void exit_thread();
+
+profiler * start(const std::string & timer_name, void ** data_ptr = 0LL);
+void stop(profiler * the_profiler, bool cleanup = true);
+
+apex_profile * get_profile(const std::string & timer_name);
+void reset(const std::string & timer_name);
+// Adds a sample to the named counter, whose profile get_profile() returns.
+void sample_value(const std::string & name, double value);
+
+apex_policy_handle * register_policy(const apex_event_type when, std::function<int(apex_context const &)> f);
+int deregister_policy(apex_policy_handle * handle);
+
+apex_event_type register_custom_event(const std::string & name);
+void custom_event(apex_event_type event_type, void * custom_data);
+
+}
+
+#include "apex_policies.hpp"
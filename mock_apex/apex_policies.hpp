@@ -0,0 +1,120 @@
+//  APEX OpenMP Policy
+//
+//  Copyright (c) 2015 University of Oregon
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+// Mock of the APEX custom tuning API. The search is deliberately simple:
+// EXHAUSTIVE visits every point, starting from the initial values; every
+// other strategy measures a fixed number of random points. Once done the
+// parameters hold the best point measured and the request has converged.
+
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "apex_types.h"
+
+enum class apex_ah_tuning_strategy {
+    EXHAUSTIVE,
+    RANDOM,
+    NELDER_MEAD,
+    PARALLEL_RANK_ORDER
+};
+
+class apex_param {
+    protected:
+        std::string name;
+
+    public:
+        apex_param(const std::string & name) : name(name) {}
+        virtual ~apex_param() {}
+
+        std::string get_name() const {
+            return name;
+        }
+};
+
+class apex_tuning_request;
+
+namespace apex {
+apex_tuning_session_handle setup_custom_tuning(apex_tuning_request & request);
+}
+
+class apex_param_enum : public apex_param {
+    friend class apex_tuning_request;
+    friend apex_tuning_session_handle apex::setup_custom_tuning(apex_tuning_request & request);
+
+    private:
+        std::vector<std::string> possible_values;
+        size_t index;
+
+    public:
+        apex_param_enum(const std::string & name, const std::string & init_value,
+                const std::list<std::string> & possible_values);
+
+        std::string get_value() const {
+            return possible_values[index];
+        }
+};
+
+class apex_tuning_request {
+    friend apex_tuning_session_handle apex::setup_custom_tuning(apex_tuning_request & request);
+
+    private:
+        std::string name;
+        std::function<double()> metric;
+        apex_event_type trigger = APEX_INVALID_EVENT;
+        apex_ah_tuning_strategy strategy = apex_ah_tuning_strategy::NELDER_MEAD;
+        std::vector<std::shared_ptr<apex_param_enum>> params;
+        // Search state: points still to measure, and the best one so far.
+        std::vector<std::vector<size_t>> pending;
+        std::vector<size_t> best;
+        double best_value = 0.0;
+        bool converged = false;
+
+        std::vector<size_t> current() const;
+        void move_to(const std::vector<size_t> & point);
+
+    public:
+        apex_tuning_request(const std::string & name) : name(name) {}
+
+        std::shared_ptr<apex_param_enum> add_param_enum(const std::string & name, const std::string & init_value,
+                const std::list<std::string> & possible_values);
+        std::shared_ptr<apex_param> get_param(const std::string & name) const;
+
+        void set_metric(std::function<double()> metric) {
+            this->metric = metric;
+        }
+
+        std::string get_name() const {
+            return name;
+        }
+
+        void set_trigger(apex_event_type trigger) {
+            this->trigger = trigger;
+        }
+
+        apex_event_type get_trigger() const {
+            return trigger;
+        }
+
+        void set_strategy(apex_ah_tuning_strategy strategy) {
+            this->strategy = strategy;
+        }
+
+        bool has_converged() const {
+            return converged;
+        }
+
+        // Measures the current point and moves to the next; called on each
+        // custom event of the trigger.
+        void evaluate();
+};
@@ -0,0 +1,54 @@
+//  APEX OpenMP Policy
+//
+//  Copyright (c) 2015 University of Oregon
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+// The subset of the APEX types the policy uses, for building against the
+// mock APEX library when no APEX install is found.
+
+#include <stdint.h>
+
+typedef enum _event_type {
+    APEX_INVALID_EVENT = -1,
+    APEX_STARTUP = 0,
+    APEX_SHUTDOWN,
+    APEX_NEW_NODE,
+    APEX_NEW_THREAD,
+    APEX_EXIT_THREAD,
+    APEX_START_EVENT,
+    APEX_RESUME_EVENT,
+    APEX_STOP_EVENT,
+    APEX_YIELD_EVENT,
+    APEX_SAMPLE_VALUE,
+    APEX_PERIODIC,
+    APEX_CUSTOM_EVENT_1
+} apex_event_type;
+
+typedef struct _policy_handle {
+    int id;
+    apex_event_type event_type;
+} apex_policy_handle;
+
+typedef struct _context {
+    apex_event_type event_type;
+    apex_policy_handle * policy_handle;
+    void * data;
+} apex_context;
+
+typedef struct _profile {
+    double calls;
+    double accumulated;
+    double sum_squares;
+    double minimum;
+    double maximum;
+    int times_reset;
+} apex_profile;
+
+typedef uint32_t apex_tuning_session_handle;
+
+#define APEX_NOERROR 0
+#define APEX_ERROR 1
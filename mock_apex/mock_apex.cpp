@@ -0,0 +1,384 @@
+//  APEX OpenMP Policy
+//
+//  Copyright (c) 2015 University of Oregon
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <shared_mutex>
+#include <unordered_map>
+#include <dirent.h>
+#include <dlfcn.h>
+#include <stdlib.h>
+
+#include "apex_api.hpp"
+
+namespace {
+
+struct mock_policy {
+    apex_policy_handle handle;
+    std::function<int(apex_context const &)> function;
+};
+
+// Policies live in a fixed table so that events can run them without a
+// lock while others are registered. Deregistered policies are never freed,
+// since an event on another thread may still be running them.
+const int max_policies = 64;
+std::atomic<mock_policy *> policies[max_policies];
+std::atomic<int> policy_count{0};
+std::mutex policy_lock;
+
+struct mock_timer {
+    apex::task_identifier id;
+    std::mutex lock;
+    apex_profile profile;
+};
+
+std::unordered_map<std::string, std::unique_ptr<mock_timer>> timers;
+std::shared_timed_mutex timer_lock;
+
+std::unordered_map<std::string, apex_event_type> custom_events;
+std::unordered_map<int, apex_tuning_request *> tuning_requests;
+std::mutex custom_event_lock;
+apex_tuning_session_handle next_session = 1;
+
+bool initialized = false;
+std::vector<void *> plugins;
+
+// Random points measured by the strategies other than EXHAUSTIVE.
+const size_t random_points = 32;
+
+void fire(apex_event_type event_type, void * data) {
+    const int count = policy_count.load(std::memory_order_acquire);
+    for(int i = 0; i < count; ++i) {
+        mock_policy * policy = policies[i].load(std::memory_order_acquire);
+        if(policy != nullptr && policy->handle.event_type == event_type) {
+            apex_context context;
+            context.event_type = event_type;
+            context.policy_handle = &policy->handle;
+            context.data = data;
+            policy->function(context);
+        }
+    }
+}
+
+mock_timer * find_timer(const std::string & name) {
+    {
+        std::shared_lock<std::shared_timed_mutex> guard(timer_lock);
+        const auto found = timers.find(name);
+        if(found != timers.end()) {
+            return found->second.get();
+        }
+    }
+    std::unique_lock<std::shared_timed_mutex> guard(timer_lock);
+    std::unique_ptr<mock_timer> & timer = timers[name];
+    if(timer == nullptr) {
+        timer.reset(new mock_timer());
+        timer->id.name = name;
+        timer->profile = apex_profile();
+    }
+    return timer.get();
+}
+
+// Loads every shared library in APEX_PLUGINS_PATH and runs its
+// apex_plugin_init().
+void load_plugins() {
+    const char * path = getenv("APEX_PLUGINS_PATH");
+    if(path == nullptr) {
+        return;
+    }
+    DIR * dir = opendir(path);
+    if(dir == nullptr) {
+        std::cerr << "Unable to open APEX_PLUGINS_PATH " << path << std::endl;
+        return;
+    }
+    std::vector<std::string> files;
+    while(struct dirent * entry = readdir(dir)) {
+        const std::string file = entry->d_name;
+        if(file.size() > 3 && file.compare(file.size() - 3, 3, ".so") == 0) {
+            files.push_back(std::string(path) + "/" + file);
+        }
+    }
+    closedir(dir);
+    std::sort(files.begin(), files.end());
+    for(const std::string & file : files) {
+        void * plugin = dlopen(file.c_str(), RTLD_NOW | RTLD_LOCAL);
+        if(plugin == nullptr) {
+            std::cerr << "Unable to load plugin " << file << ": " << dlerror() << std::endl;
+            continue;
+        }
+        int (*plugin_init)() = reinterpret_cast<int (*)()>(dlsym(plugin, "apex_plugin_init"));
+        if(plugin_init == nullptr) {
+            std::cerr << "Plugin " << file << " has no apex_plugin_init" << std::endl;
+            continue;
+        }
+        plugins.push_back(plugin);
+        plugin_init();
+    }
+}
+
+}
+
+namespace apex {
+
+class profiler {
+    public:
+        mock_timer * timer;
+        std::chrono::steady_clock::time_point start;
+};
+
+void init(const char * thread_name, uint64_t comm_rank, uint64_t comm_size) {
+    (void) thread_name;
+    (void) comm_rank;
+    (void) comm_size;
+    if(initialized) {
+        return;
+    }
+    initialized = true;
+    load_plugins();
+    fire(APEX_STARTUP, nullptr);
+}
+
+void finalize() {
+    if(!initialized) {
+        return;
+    }
+    fire(APEX_SHUTDOWN, nullptr);
+    for(auto plugin = plugins.rbegin(); plugin != plugins.rend(); ++plugin) {
+        int (*plugin_finalize)() = reinterpret_cast<int (*)()>(dlsym(*plugin, "apex_plugin_finalize"));
+        if(plugin_finalize != nullptr) {
+            plugin_finalize();
+        }
+    }
+    plugins.clear();
+    initialized = false;
+}
+
+void register_thread(const std::string & name) {
+    (void) name;
+    fire(APEX_NEW_THREAD, nullptr);
+}
+
+void exit_thread() {
+    fire(APEX_EXIT_THREAD, nullptr);
+}
+
+profiler * start(const std::string & timer_name, void ** data_ptr) {
+    (void) data_ptr;
+    mock_timer * timer = find_timer(timer_name);
+    fire(APEX_START_EVENT, &timer->id);
+    profiler * the_profiler = new profiler();
+    the_profiler->timer = timer;
+    the_profiler->start = std::chrono::steady_clock::now();
+    return the_profiler;
+}
+
+void stop(profiler * the_profiler, bool cleanup) {
+    if(the_profiler == nullptr) {
+        return;
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - the_profiler->start;
+    mock_timer * timer = the_profiler->timer;
+    {
+        std::lock_guard<std::mutex> guard(timer->lock);
+        apex_profile & profile = timer->profile;
+        profile.minimum = profile.calls == 0 ? elapsed.count() : std::min(profile.minimum, elapsed.count());
+        profile.maximum = std::max(profile.maximum, elapsed.count());
+        profile.calls += 1;
+        profile.accumulated += elapsed.count();
+        profile.sum_squares += elapsed.count() * elapsed.count();
+    }
+    fire(APEX_STOP_EVENT, &timer->id);
+    if(cleanup) {
+        delete the_profiler;
+    }
+}
+
+apex_profile * get_profile(const std::string & timer_name) {
+    std::shared_lock<std::shared_timed_mutex> guard(timer_lock);
+    const auto found = timers.find(timer_name);
+    return found == timers.end() ? nullptr : &found->second->profile;
+}
+
+void sample_value(const std::string & name, double value) {
+    mock_timer * timer = find_timer(name);
+    std::lock_guard<std::mutex> guard(timer->lock);
+    apex_profile & profile = timer->profile;
+    profile.minimum = profile.calls == 0 ? value : std::min(profile.minimum, value);
+    profile.maximum = std::max(profile.maximum, value);
+    profile.calls += 1;
+    profile.accumulated += value;
+    profile.sum_squares += value * value;
+}
+
+void reset(const std::string & timer_name) {
+    mock_timer * timer = find_timer(timer_name);
+    std::lock_guard<std::mutex> guard(timer->lock);
+    const int times_reset = timer->profile.times_reset;
+    timer->profile = apex_profile();
+    timer->profile.times_reset = times_reset + 1;
+}
+
+apex_policy_handle * register_policy(const apex_event_type when, std::function<int(apex_context const &)> f) {
+    std::lock_guard<std::mutex> guard(policy_lock);
+    const int count = policy_count.load(std::memory_order_relaxed);
+    int slot = 0;
+    while(slot < count && policies[slot].load(std::memory_order_relaxed) != nullptr) {
+        ++slot;
+    }
+    if(slot == max_policies) {
+        std::cerr << "Too many policies registered with the mock APEX" << std::endl;
+        return nullptr;
+    }
+    mock_policy * policy = new mock_policy{apex_policy_handle{slot, when}, f};
+    policies[slot].store(policy, std::memory_order_release);
+    if(slot == count) {
+        policy_count.store(count + 1, std::memory_order_release);
+    }
+    return &policy->handle;
+}
+
+int deregister_policy(apex_policy_handle * handle) {
+    if(handle == nullptr || handle->id < 0 || handle->id >= max_policies) {
+        return APEX_ERROR;
+    }
+    std::lock_guard<std::mutex> guard(policy_lock);
+    mock_policy * policy = policies[handle->id].load(std::memory_order_relaxed);
+    if(policy == nullptr || &policy->handle != handle) {
+        return APEX_ERROR;
+    }
+    policies[handle->id].store(nullptr, std::memory_order_release);
+    return APEX_NOERROR;
+}
+
+apex_event_type register_custom_event(const std::string & name) {
+    std::lock_guard<std::mutex> guard(custom_event_lock);
+    const auto found = custom_events.find(name);
+    if(found != custom_events.end()) {
+        return found->second;
+    }
+    const apex_event_type event_type = static_cast<apex_event_type>(APEX_CUSTOM_EVENT_1 + custom_events.size());
+    custom_events[name] = event_type;
+    return event_type;
+}
+
+void custom_event(apex_event_type event_type, void * custom_data) {
+    apex_tuning_request * request = nullptr;
+    {
+        std::lock_guard<std::mutex> guard(custom_event_lock);
+        const auto found = tuning_requests.find(event_type);
+        if(found != tuning_requests.end()) {
+            request = found->second;
+        }
+    }
+    if(request != nullptr) {
+        request->evaluate();
+    }
+    fire(event_type, custom_data);
+}
+
+apex_tuning_session_handle setup_custom_tuning(apex_tuning_request & request) {
+    request.pending.clear();
+    request.best.clear();
+    request.converged = request.params.empty();
+    const std::vector<size_t> start = request.current();
+    if(request.strategy == apex_ah_tuning_strategy::EXHAUSTIVE) {
+        // Every other point, in odometer order from the start.
+        std::vector<size_t> offset(start.size(), 0);
+        for(;;) {
+            size_t d = 0;
+            for(; d < offset.size(); ++d) {
+                if(++offset[d] < request.params[d]->possible_values.size()) {
+                    break;
+                }
+                offset[d] = 0;
+            }
+            if(d == offset.size()) {
+                break;
+            }
+            std::vector<size_t> point(start.size());
+            for(size_t i = 0; i < point.size(); ++i) {
+                point[i] = (start[i] + offset[i]) % request.params[i]->possible_values.size();
+            }
+            request.pending.push_back(point);
+        }
+    } else if(!request.params.empty()) {
+        std::mt19937 random(std::hash<std::string>()(request.name));
+        for(size_t i = 0; i < random_points; ++i) {
+            std::vector<size_t> point(start.size());
+            for(size_t d = 0; d < point.size(); ++d) {
+                point[d] = std::uniform_int_distribution<size_t>(0, request.params[d]->possible_values.size() - 1)(random);
+            }
+            request.pending.push_back(point);
+        }
+    }
+    std::reverse(request.pending.begin(), request.pending.end());
+    std::lock_guard<std::mutex> guard(custom_event_lock);
+    tuning_requests[request.trigger] = &request;
+    return next_session++;
+}
+
+}
+
+apex_param_enum::apex_param_enum(const std::string & name, const std::string & init_value,
+        const std::list<std::string> & possible_values)
+    : apex_param(name), possible_values(possible_values.begin(), possible_values.end()), index(0) {
+    const auto found = std::find(this->possible_values.begin(), this->possible_values.end(), init_value);
+    if(found != this->possible_values.end()) {
+        index = found - this->possible_values.begin();
+    }
+}
+
+std::shared_ptr<apex_param_enum> apex_tuning_request::add_param_enum(const std::string & name,
+        const std::string & init_value, const std::list<std::string> & possible_values) {
+    std::shared_ptr<apex_param_enum> param = std::make_shared<apex_param_enum>(name, init_value, possible_values);
+    params.push_back(param);
+    return param;
+}
+
+std::shared_ptr<apex_param> apex_tuning_request::get_param(const std::string & name) const {
+    for(const auto & param : params) {
+        if(param->get_name() == name) {
+            return param;
+        }
+    }
+    return nullptr;
+}
+
+std::vector<size_t> apex_tuning_request::current() const {
+    std::vector<size_t> point;
+    for(const auto & param : params) {
+        point.push_back(param->index);
+    }
+    return point;
+}
+
+void apex_tuning_request::move_to(const std::vector<size_t> & point) {
+    for(size_t d = 0; d < params.size(); ++d) {
+        params[d]->index = point[d];
+    }
+}
+
+void apex_tuning_request::evaluate() {
+    if(converged) {
+        return;
+    }
+    const double value = metric ? metric() : 0.0;
+    if(best.empty() || value < best_value) {
+        best = current();
+        best_value = value;
+    }
+    if(pending.empty()) {
+        move_to(best);
+        converged = true;
+        return;
+    }
+    move_to(pending.back());
+    pending.pop_back();
+}
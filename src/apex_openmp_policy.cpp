@@ -11,399 +11,1760 @@
 #include <unordered_map>
 #include <memory>
 #include <set>
+#include <map>
+#include <algorithm>
 #include <utility>
 #include <cstdlib>
+#include <cassert>
 #include <stdexcept>
 #include <chrono>
 #include <ctime>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
 #include <stdio.h>
+#include <cmath>
+#include <limits>
+#include <sys/stat.h>
 
-#include <rapidjson/document.h>
-#include <rapidjson/istreamwrapper.h>
-            
 #include <omp.h>
 
 #include "apex_api.hpp"
 #include "apex_policies.hpp"
 
+#include "apex_openmp_policy.h"
+#include "region_registry.hpp"
+#include "mpsc_queue.hpp"
+#include "sample_evaluator.hpp"
+#include "history.hpp"
+#include "search.hpp"
+#include "neighborhood_search.hpp"
+#include "bayesian_search.hpp"
+#include "record_search.hpp"
+#include "cooperative_search.hpp"
+#include "shared_table.hpp"
+#include "online_tuner.hpp"
+#include "topology.hpp"
+#include "tuning_space.hpp"
+#include "trace.hpp"
+#include "ompt_imbalance.hpp"
+#include "energy_counter.hpp"
 
-static int apex_openmp_policy_tuning_window = 3;
+// OpenMP runtime settings for one point of the tuning space. Decoded from
+// the tuning request's string parameters only when the tuner moves to a new
+// point, so that region entry just applies it.
+struct omp_config {
+    int threads;
+    omp_sched_t sched;
+    int chunk;
+    // -1 leaves the ICV alone (the dimension is not being tuned).
+    int dynamic = -1;
+    int max_active_levels = -1;
+};
+
+static bool same_config(const omp_config & a, const omp_config & b) {
+    return a.threads == b.threads && a.sched == b.sched && a.chunk == b.chunk && a.dynamic == b.dynamic
+        && a.max_active_levels == b.max_active_levels;
+}
+
+// omp_sched_monotonic from OpenMP 5.0, or'ed into the schedule kind.
+#if defined(_OPENMP) && _OPENMP >= 201811
+static const unsigned omp_sched_monotonic_flag = 0x80000000u;
+#else
+static const unsigned omp_sched_monotonic_flag = 0;
+#endif
+
+// The current config of a region. The single writer (holding the region
+// lock) fills the buffer that is not current and then bumps the version;
+// readers copy the current buffer and retry if the version moved meanwhile.
+class omp_config_slot {
+    private:
+        omp_config buffers[2];
+        std::atomic<unsigned> version{0};
+
+    public:
+        omp_config load() const {
+            omp_config config;
+            unsigned before = version.load(std::memory_order_acquire);
+            for(;;) {
+                config = buffers[before & 1];
+                std::atomic_thread_fence(std::memory_order_acquire);
+                const unsigned after = version.load(std::memory_order_relaxed);
+                if(after == before) {
+                    return config;
+                }
+                before = after;
+            }
+        }
+
+        void store(const omp_config & config) {
+            const unsigned current = version.load(std::memory_order_relaxed);
+            buffers[(current + 1) & 1] = config;
+            version.store(current + 1, std::memory_order_release);
+        }
+};
+
+// An OpenMP parallel region known to the policy.
+//
+// Start and stop events for the same region may arrive on several threads.
+// The request is created once under the region lock and then published
+// through the ready flag; the tuner step (custom event plus reset) is also
+// serialized by the lock. Region entry only reads the published config.
+// Once the session converges (or for regions pinned from history) the
+// region is frozen: entry applies the final config and stop events return
+// immediately, without any profile queries or resets.
+struct omp_region {
+    uint32_t id;
+    std::string name;
+    std::shared_ptr<apex_tuning_request> request;
+    omp_config_slot config;
+    // Per-invocation times of the current trial, and the best estimate of
+    // any trial so far. Both are protected by the lock.
+    sample_evaluator samples;
+    double best_value = 0.0;
+    omp_config best_config;
+    // Relative spread of the best trial, which later trials race against,
+    // and the successive halving rungs of the search's trials.
+    double best_spread = 0.0;
+    successive_halving rungs;
+    // The region's space (see APEX_OPENMP_SPACE) and the point last decoded
+    // from the APEX request. Points measured so far map to their estimate,
+    // so points equivalent under the constraints are not measured twice.
+    tuning_space space;
+    search_point point;
+    std::map<search_point, double> measured;
+    double trial_value = 0.0;
+    // Plugin-side search, used instead of an APEX request when set.
+    std::unique_ptr<search_strategy> search;
+    // Bandit over the best configs once converged (APEX_OPENMP_ONLINE).
+    std::unique_ptr<online_tuner> online;
+    // History entry to warm-start from (APEX_OPENMP_WARM_START).
+    std::unique_ptr<history_entry> prior;
+    // The region's results shared with other processes (APEX_OPENMP_SHARED).
+    shared_region_slot * shared = nullptr;
+    // Region selection (APEX_OPENMP_MIN_REGION_TIME, APEX_OPENMP_TOP_REGIONS):
+    // until chosen for tuning, the region runs the default config and only
+    // its calls and time are counted. Skipped regions stay on the default.
+    std::atomic<bool> observing{false};
+    std::atomic<uint64_t> observed_ns{0};
+    std::atomic<uint32_t> observed_calls{0};
+    std::atomic<uint32_t> next_selection{0};
+    std::atomic<int64_t> first_seen_ns{0};
+    bool skipped = false;
+    // Tuning held back by the budget (APEX_OPENMP_TUNING_BUDGET): the region
+    // runs its best config so far and the next trial waits in paused_config.
+    std::atomic<bool> paused{false};
+    omp_config paused_config;
+    // Load imbalance of the current trial's invocations (see
+    // ompt_imbalance.hpp), and whether it ruled out the static schedule
+    // (APEX_OPENMP_IMBALANCE). Protected by the lock.
+    double imbalance_sum = 0.0;
+    uint64_t imbalance_regions = 0;
+    bool prune_static = false;
+    // Team size transitions (APEX_OPENMP_TRANSITIONS): the usual gap from
+    // the region that ran just before this one when the team size stays the
+    // same, the extra gap when it changes, and that region's team size.
+    // Protected by the lock.
+    double steady_gap = -1.0;
+    double switch_cost = 0.0;
+    int previous_threads = 0;
+    // Time per call and team size of the first trial, the baseline of
+    // APEX_OPENMP_OBJECTIVE=EFFICIENCY. Protected by the lock.
+    double baseline_value = 0.0;
+    int baseline_threads = 0;
+    // Groups of back-to-back regions tuned together (APEX_OPENMP_GROUPS).
+    // A member runs its leader's config and its times go into the leader's
+    // trials, where a sample is the sum over one pass from the leader to
+    // the last member. The leader's fields are protected by its lock.
+    std::atomic<omp_region *> group{nullptr};
+    std::vector<omp_region *> members;
+    const omp_region * group_last = nullptr;
+    double round_value = 0.0;
+    // Set while the tuner thread ends the last trial (APEX_OPENMP_ASYNC).
+    std::atomic<bool> pending{false};
+    // Per work-size bucket regions, created on the first hint for this
+    // region (see apex_openmp_policy_set_work_size).
+    std::atomic<std::atomic<omp_region *> *> contexts{nullptr};
+    // Set once a tuning session starts; read without the lock by stop events
+    // and the journal.
+    std::atomic<bool> tuning{false};
+    bool converged = false;
+    std::atomic<bool> ready{false};
+    std::atomic<bool> frozen{false};
+    std::mutex lock;
+
+    ~omp_region() {
+        // The bucket regions themselves are owned by the registry.
+        delete[] contexts.load();
+    }
+};
+
+static const std::string omp_region_prefix{"OpenMP_PARALLEL_REGION"};
+
+// Sentinel bound to task identifiers that are not OpenMP parallel regions,
+// so they are rejected with a single lookup.
+static omp_region not_an_omp_region;
+
+static sample_evaluator_settings apex_openmp_policy_evaluator;
 static apex_ah_tuning_strategy apex_openmp_policy_tuning_strategy = apex_ah_tuning_strategy::NELDER_MEAD;
-static std::unordered_map<std::string, std::shared_ptr<apex_tuning_request>> * apex_openmp_policy_tuning_requests;
+// APEX_OPENMP_STRATEGY=BAYESIAN uses the plugin's bayesian_search instead of
+// an APEX strategy; the budget is its maximum number of trials (0: auto).
+static bool apex_openmp_policy_bayesian = false;
+static size_t apex_openmp_policy_search_budget = 0;
+// Record mode (APEX_OPENMP_RECORD): each region measures a spread of
+// configs into the trace for replay_tuner instead of tuning.
+static bool apex_openmp_policy_record = false;
+static size_t apex_openmp_policy_record_points = 128;
+// With APEX_OPENMP_SHARED=<name>, the processes of a node tune together
+// through a shared memory segment of that name, which also keeps their
+// results for later jobs. Claims of points by processes that died expire
+// after APEX_OPENMP_SHARED_TIMEOUT seconds.
+static shared_table * apex_openmp_policy_shared = nullptr;
+static double apex_openmp_policy_shared_timeout = 60.0;
+// Region selection: regions are observed for APEX_OPENMP_OBSERVE_CALLS
+// calls on the default config, then tuned only if their mean call takes at
+// least APEX_OPENMP_MIN_REGION_TIME seconds and they are among the
+// APEX_OPENMP_TOP_REGIONS taking the largest share of the runtime. Regions
+// that miss the second test are looked at again after twice as many calls.
+static bool apex_openmp_policy_selecting = false;
+static double apex_openmp_policy_min_region_time = 0.0;
+static int apex_openmp_policy_top_regions = 0;
+static uint32_t apex_openmp_policy_observe_calls = 20;
+static std::atomic<int> apex_openmp_policy_regions_selected{0};
+// The ICVs in effect at startup, for regions that are not tuned.
+static omp_config apex_openmp_policy_default_config{1, omp_sched_static, 0};
+// With APEX_OPENMP_TUNING_BUDGET, at most that fraction of the runtime is
+// spent in trials: over budget, tuning regions pause on their best config
+// at the end of a trial, and no new region is chosen for tuning.
+static double apex_openmp_policy_tuning_budget = 0.0;
+static std::atomic<int64_t> apex_openmp_policy_trial_ns{0};
+static int64_t apex_openmp_policy_start_ns = 0;
+// When OMPT reports that a trial on the static schedule left the threads
+// idle at barriers for more than this share of the region on average, the
+// search only tries the other schedules from then on. 0 turns it off.
+static double apex_openmp_policy_imbalance_threshold = 0.25;
+// With APEX_OPENMP_TRANSITIONS, the gap between a region and the one that
+// ran just before it on the same thread is measured when it is under
+// APEX_OPENMP_BACK_TO_BACK seconds. If the team size changed, the gap
+// beyond the usual one is charged to the trial, and once converged the
+// region keeps the previous region's team size unless changing it gains
+// more than that switch cost. With APEX_OPENMP_GROUPS, a region that first
+// runs back to back after one being tuned joins its group instead.
+static bool apex_openmp_policy_transitions = false;
+static bool apex_openmp_policy_groups = false;
+static double apex_openmp_policy_back_to_back = 0.001;
+static const size_t max_group_size = 8;
+// What a trial minimizes (APEX_OPENMP_OBJECTIVE), per call: the time; the
+// core-seconds, time x team size; the time, penalized in proportion when
+// the parallel efficiency relative to the region's first trial falls below
+// APEX_OPENMP_MIN_EFFICIENCY; time x team size ^ APEX_OPENMP_OBJECTIVE_WEIGHT,
+// which goes from time at 0 to core-seconds at 1; or the energy (see
+// energy_counter.hpp). The order matches the history's objective codes.
+// Budgets, observation and traces stay in seconds.
+enum class tuning_objective {TIME, CORE_SECONDS, EFFICIENCY, WEIGHTED, ENERGY};
+static tuning_objective apex_openmp_policy_objective = tuning_objective::TIME;
+static double apex_openmp_policy_objective_weight = 0.5;
+static double apex_openmp_policy_min_efficiency = 0.5;
+// With APEX_OPENMP_ASYNC, trials end on a tuner thread: the application
+// thread that completes a trial only queues its estimate and picks up the
+// next config at a later region entry. Invocations of the region that run
+// meanwhile are not counted in any trial. The tuner sleeps while the queue
+// is empty; a wakeup lost to the race between the two is caught by the
+// timeout.
+struct finished_trial {
+    omp_region * region;
+    double value;
+    double spread;
+    omp_config config;
+};
+static bool apex_openmp_policy_async = false;
+static mpsc_queue<finished_trial> * apex_openmp_policy_trials = nullptr;
+static std::thread apex_openmp_policy_tuner;
+static std::mutex apex_openmp_policy_tuner_lock;
+static std::condition_variable apex_openmp_policy_tuner_wake;
+static std::atomic<bool> apex_openmp_policy_tuner_idle{false};
+static std::atomic<bool> apex_openmp_policy_tuner_stop{false};
+
+// With APEX_OPENMP_ONLINE, converged regions keep being timed: a bandit
+// over the best few configs spends a small share of the batches exploring,
+// and a local search restarts when the chosen config gets slower.
+static bool apex_openmp_policy_online = false;
+static size_t apex_openmp_policy_online_arms = 3;
+static double apex_openmp_policy_online_explore = 0.05;
+static double apex_openmp_policy_drift_threshold = 0.5;
+static region_registry<omp_region> * apex_openmp_policy_regions;
 static bool apex_openmp_policy_verbose = false;
 static bool apex_openmp_policy_use_history = false;
 static bool apex_openmp_policy_running = false;
 static std::string apex_openmp_policy_history_file = "";
+static history_file * apex_openmp_policy_history = nullptr;
+
+// With APEX_OPENMP_WARM_START, history entries seed a local search over the
+// full space instead of pinning the region. If the historical point still
+// performs within APEX_OPENMP_WARM_TOLERANCE of its recorded time, the
+// region converges after one trial. Unconverged entries are used as priors
+// with a wider initial neighborhood.
+static bool apex_openmp_policy_warm_start = false;
+static double apex_openmp_policy_warm_tolerance = 0.05;
 
-static const std::list<std::string> default_thread_space{"2", "4", "8", "16", "24", "32"};
+// With APEX_OPENMP_JOURNAL=<path>, results are appended to <path>.journal
+// as regions converge (and every APEX_OPENMP_JOURNAL_INTERVAL seconds for
+// regions still tuning), and merged into the binary history at <path> at
+// finalize or once the journal holds APEX_OPENMP_JOURNAL_COMPACT records.
+// That compaction is only flagged where the record is written, which may be
+// under a region lock, and done by the tuner thread (APEX_OPENMP_ASYNC) or
+// else after the next trial-ending stop has released its region lock.
+static history_journal * apex_openmp_policy_journal = nullptr;
+static std::string apex_openmp_policy_journal_path = "";
+static double apex_openmp_policy_journal_interval = 0.0;
+static int apex_openmp_policy_journal_compact = 1000;
+static history_merge apex_openmp_policy_history_merge = history_merge::LATEST;
+static std::mutex apex_openmp_policy_journal_lock;
+static int apex_openmp_policy_journal_records = 0;
+static std::atomic<int64_t> apex_openmp_policy_journal_last{0};
+static std::atomic<bool> apex_openmp_policy_compact_due{false};
+
+// With APEX_OPENMP_DROP_STOP_POLICY, stop events are ignored altogether once
+// every region that was being tuned has converged. The flag short-circuits
+// the stop policy right away; the policy itself is deregistered on the next
+// start event (deregistering from inside a stop callback would deadlock on
+// APEX's stop policy lock) and registered again if a new region shows up.
+static bool apex_openmp_policy_drop_stop_policy = false;
+static std::atomic<int> apex_openmp_policy_regions_tuning{0};
+static std::atomic<bool> apex_openmp_policy_stop_dropped{false};
+static std::mutex apex_openmp_policy_stop_policy_lock;
+static std::atomic<bool> apex_openmp_policy_stop_registered{false};
+
+// Derived from the machine's topology in register_policy().
+static std::list<std::string> default_thread_space;
 static const std::list<std::string> default_schedule_space{"static", "dynamic", "guided"};
 static const std::list<std::string> default_chunk_space{"1", "8", "32", "64", "128", "256", "512"};
 
-static const std::list<std::string> * thread_space = nullptr;
-static const std::list<std::string> * schedule_space = nullptr;
-static const std::list<std::string> * chunk_space = nullptr;
+static tuning_space_config apex_openmp_policy_space;
 
 static apex_policy_handle * start_policy;
 static apex_policy_handle * stop_policy;
 
-static void set_omp_params(std::shared_ptr<apex_tuning_request> request) {
-	//std::cout << __func__ << std::endl;
-        std::shared_ptr<apex_param_enum> thread_param = std::static_pointer_cast<apex_param_enum>(request->get_param("omp_num_threads"));
-        const int num_threads = atoi(thread_param->get_value().c_str());
-
-        std::shared_ptr<apex_param_enum> schedule_param = std::static_pointer_cast<apex_param_enum>(request->get_param("omp_schedule"));
-        const std::string schedule_value = schedule_param->get_value();
-        omp_sched_t schedule = omp_sched_auto;
-        if(schedule_value == "static") {
-            schedule = omp_sched_static;
-        } else if(schedule_value == "dynamic") {
-            schedule = omp_sched_dynamic;
-        } else if(schedule_value == "guided") {
-            schedule = omp_sched_guided;
-        } else if(schedule_value == "auto") {
-            schedule = omp_sched_auto;
+// Regions being timed on this thread. Start and stop events nest, so this
+// is a small stack; entries orphaned by a region freezing in between are
+// discarded when an enclosing region stops. The site is the region the
+// APEX event maps to and region the (possibly work-size bucketed) region
+// that was tuned, and config what it ran with.
+struct omp_region_timer {
+    const omp_region * site;
+    omp_region * region;
+    omp_config config;
+    std::chrono::steady_clock::time_point start;
+    ompt_imbalance_totals imbalance;
+    // Energy counter at the start (APEX_OPENMP_OBJECTIVE=ENERGY).
+    double energy;
+    // The outermost region that stopped just before this one started, and
+    // the seconds in between, or nullptr.
+    omp_region * previous;
+    int previous_threads;
+    double gap;
+};
+static const int max_timer_depth = 32;
+static thread_local omp_region_timer region_timers[max_timer_depth];
+// Starts nested deeper than max_timer_depth, which are not timed.
+static std::atomic<uint64_t> apex_openmp_policy_timer_overflows{0};
+static thread_local int region_timer_depth = 0;
+// The (tuned) region of the outermost timer stopped last on this thread,
+// the team size it ran and when.
+static thread_local omp_region * last_region = nullptr;
+static thread_local int last_region_threads = 0;
+static thread_local std::chrono::steady_clock::time_point last_region_stop;
+
+// Work-size hint for the next region started on this thread, or -1.
+static const int max_context_buckets = 64;
+static int apex_openmp_policy_context_granularity = 2;
+static thread_local long long region_work_size = -1;
+
+int policy(const apex_context context);
+
+// Accepts the OMP_SCHEDULE spelling of a modifier, e.g. "monotonic:dynamic".
+static omp_sched_t parse_schedule(const std::string & schedule_value) {
+    const size_t colon = schedule_value.find(':');
+    if(colon != std::string::npos) {
+        const std::string modifier = schedule_value.substr(0, colon);
+        const omp_sched_t kind = parse_schedule(schedule_value.substr(colon + 1));
+        if(modifier == "monotonic") {
+            return static_cast<omp_sched_t>(kind | omp_sched_monotonic_flag);
+        } else if(modifier == "nonmonotonic") {
+            return kind;
+        }
+        throw std::invalid_argument("omp_schedule");
+    }
+    if(schedule_value == "static") {
+        return omp_sched_static;
+    } else if(schedule_value == "dynamic") {
+        return omp_sched_dynamic;
+    } else if(schedule_value == "guided") {
+        return omp_sched_guided;
+    } else if(schedule_value == "auto") {
+        return omp_sched_auto;
+    } else {
+        throw std::invalid_argument("omp_schedule");
+    }
+}
+
+// Called with the region lock held whenever the tuner may have moved.
+static void update_omp_params(omp_region & region);
+
+// Returns the config applied.
+static omp_config set_omp_params(const omp_region & region) {
+    const omp_config config = region.config.load();
+
+    if(apex_openmp_policy_verbose) {
+        fprintf(stderr, "name: %s, num_threads: %d, schedule %d, chunk_size %d, dynamic %d, max_active_levels %d\n", region.name.c_str(),
+                config.threads, config.sched, config.chunk, config.dynamic, config.max_active_levels);
+    }
+
+    // Only touch the ICVs that differ from what is already in effect.
+    if(omp_get_max_threads() != config.threads) {
+        omp_set_num_threads(config.threads);
+    }
+    omp_sched_t schedule;
+    int chunk_size;
+    omp_get_schedule(&schedule, &chunk_size);
+    if(schedule != config.sched || chunk_size != config.chunk) {
+        omp_set_schedule(config.sched, config.chunk);
+    }
+    if(config.dynamic >= 0 && omp_get_dynamic() != config.dynamic) {
+        omp_set_dynamic(config.dynamic);
+    }
+    if(config.max_active_levels >= 0 && omp_get_max_active_levels() != config.max_active_levels) {
+        omp_set_max_active_levels(config.max_active_levels);
+    }
+    return config;
+}
+
+static std::string objective_name() {
+    return history_objective_name(static_cast<int32_t>(apex_openmp_policy_objective) + 1);
+}
+
+// True if a history entry's value can be compared with this run's; entries
+// without an objective were measured in time.
+static bool same_objective(const history_entry & entry) {
+    return (entry.objective.empty() ? std::string("time") : entry.objective) == objective_name();
+}
+
+// Pins a new region to its config from the history file, if it has one.
+static void apply_history(omp_region & region) {
+    history_entry entry;
+    if(apex_openmp_policy_history == nullptr || !apex_openmp_policy_history->lookup(region.name, entry)) {
+        return;
+    }
+    if(history_schedule_code(entry.schedule) == 0) {
+        std::cerr << "WARNING: Ignoring history entry for " << region.name << " with unknown schedule" << std::endl;
+        return;
+    }
+    if(apex_openmp_policy_warm_start) {
+        region.prior.reset(new history_entry(entry));
+        if(apex_openmp_policy_verbose) {
+            fprintf(stderr, "Warm-starting %s from (%d, %s, %d).\n", region.name.c_str(), entry.threads, entry.schedule.c_str(), entry.chunk);
+        }
+        return;
+    }
+    omp_config config{entry.threads, parse_schedule(entry.schedule), entry.chunk};
+    config.dynamic = entry.dynamic;
+    config.max_active_levels = entry.max_active_levels;
+    region.config.store(config);
+    region.converged = entry.converged;
+    if(std::isfinite(entry.value) && same_objective(entry)) {
+        region.best_value = entry.value;
+    }
+    region.ready.store(true, std::memory_order_release);
+    region.frozen.store(true, std::memory_order_release);
+    if(apex_openmp_policy_verbose) {
+        fprintf(stderr, "Added %s -> (%d, %s, %d) from history.\n", region.name.c_str(), entry.threads, entry.schedule.c_str(), entry.chunk);
+    }
+}
+
+static omp_region * add_region(const std::string & name) {
+    return apex_openmp_policy_regions->find_or_add(name, [&name]() {
+        omp_region * region = new omp_region();
+        region->name = name;
+        apply_history(*region);
+        return region;
+    });
+}
+
+// Slow path: called the first time a task identifier is seen (possibly by
+// several threads at once; bind() keeps the first result).
+static omp_region * resolve_region(apex::task_identifier * id) {
+    omp_region * region = &not_an_omp_region;
+    if(id->has_name) {
+        const std::string name = id->get_name();
+        if(name.compare(0, omp_region_prefix.size(), omp_region_prefix) == 0) {
+            region = add_region(name);
+            if(region == nullptr) {
+                std::cerr << "ERROR: Too many OpenMP regions; not tuning " << name << std::endl;
+                region = &not_an_omp_region;
+            } else if(trace_is_open()) {
+                trace_region(region->id, region->name);
+            }
+        }
+    }
+    return apex_openmp_policy_regions->bind(id, region);
+}
+
+static omp_config decode_point(const tuning_space & space, const search_point & point) {
+    omp_config config{0, omp_sched_static, 0};
+    bool monotonic = false;
+    for(size_t d = 0; d < space.dimensions.size(); ++d) {
+        const search_dimension & dimension = space.dimensions[d];
+        const std::string & value = dimension.values[point[d]];
+        if(dimension.name == "omp_num_threads") {
+            config.threads = atoi(value.c_str());
+        } else if(dimension.name == "omp_schedule") {
+            config.sched = parse_schedule(value);
+        } else if(dimension.name == "omp_chunk_size") {
+            config.chunk = atoi(value.c_str());
+        } else if(dimension.name == "omp_dynamic") {
+            config.dynamic = (value == "true" || value == "1") ? 1 : 0;
+        } else if(dimension.name == "omp_max_active_levels") {
+            config.max_active_levels = atoi(value.c_str());
+        } else if(dimension.name == "omp_schedule_modifier") {
+            monotonic = (value == "monotonic");
+        }
+    }
+    // The static schedule is always monotonic.
+    if(monotonic && (config.sched & ~omp_sched_monotonic_flag) != omp_sched_static) {
+        config.sched = static_cast<omp_sched_t>(config.sched | omp_sched_monotonic_flag);
+    }
+    return config;
+}
+
+// The point the APEX request is at, in the region's space.
+static search_point decode_omp_params(const omp_region & region) {
+    const search_space & dimensions = region.space.dimensions;
+    search_point point(dimensions.size(), 0);
+    for(size_t d = 0; d < dimensions.size(); ++d) {
+        std::shared_ptr<apex_param_enum> param = std::static_pointer_cast<apex_param_enum>(region.request->get_param(dimensions[d].name));
+        point[d] = std::max(0, search_index_of(dimensions[d], param->get_value()));
+    }
+    return point;
+}
+
+static void update_omp_params(omp_region & region) {
+    region.point = decode_omp_params(region);
+    region.space.normalize(region.point);
+    region.config.store(decode_point(region.space, region.point));
+}
+
+// True if the point runs the static schedule.
+static bool static_schedule(const tuning_space & space, const search_point & point) {
+    for(size_t d = 0; d < space.dimensions.size(); ++d) {
+        if(space.dimensions[d].name == "omp_schedule") {
+            return (parse_schedule(space.dimensions[d].values[point[d]]) & ~omp_sched_monotonic_flag) == omp_sched_static;
+        }
+    }
+    return false;
+}
+
+// True if the space has a schedule other than static to turn to.
+static bool other_schedules(const tuning_space & space) {
+    for(const search_dimension & dimension : space.dimensions) {
+        if(dimension.name == "omp_schedule") {
+            for(const std::string & value : dimension.values) {
+                if((parse_schedule(value) & ~omp_sched_monotonic_flag) != omp_sched_static) {
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+// Normalizes the point; false if the region's space or its measured load
+// imbalance rules it out. Called with the region lock held.
+static bool region_allows(const omp_region & region, search_point & point) {
+    if(!region.space.normalize(point)) {
+        return false;
+    }
+    return !region.prune_static || !static_schedule(region.space, point);
+}
+
+// Lets plugin-side searches skip the points the region rules out.
+static search_filter space_filter(const omp_region & region) {
+    const omp_region * filtered = &region;
+    return [filtered](search_point & point) { return region_allows(*filtered, point); };
+}
+
+// Starts a local search around the region's history entry.
+static void start_warm_session(omp_region & region) {
+    const history_entry & prior = *region.prior;
+    const search_space & dimensions = region.space.dimensions;
+    search_point start(dimensions.size(), 0);
+    for(size_t d = 0; d < dimensions.size(); ++d) {
+        std::string value;
+        if(dimensions[d].name == "omp_num_threads") {
+            value = std::to_string(prior.threads);
+        } else if(dimensions[d].name == "omp_schedule") {
+            // The modifier may be a dimension of its own.
+            value = prior.schedule;
+            const size_t colon = value.find(':');
+            if(colon != std::string::npos && std::find(dimensions[d].values.begin(), dimensions[d].values.end(), value) == dimensions[d].values.end()) {
+                value = value.substr(colon + 1);
+            }
+        } else if(dimensions[d].name == "omp_chunk_size") {
+            value = std::to_string(prior.chunk);
+        } else if(dimensions[d].name == "omp_dynamic" && prior.dynamic >= 0) {
+            value = prior.dynamic ? "true" : "false";
+        } else if(dimensions[d].name == "omp_max_active_levels" && prior.max_active_levels >= 0) {
+            value = std::to_string(prior.max_active_levels);
+        } else if(dimensions[d].name == "omp_schedule_modifier") {
+            value = prior.schedule.compare(0, 10, "monotonic:") == 0 ? "monotonic" : "nonmonotonic";
+        }
+        start[d] = std::max(0, search_index_of(dimensions[d], value));
+    }
+    region.space.normalize(start);
+    const double reference = (prior.converged && std::isfinite(prior.value) && same_objective(prior)) ? prior.value : 0.0;
+    const int radius = prior.converged ? 1 : 2;
+    region.search.reset(new neighborhood_search(dimensions, start, radius, reference, apex_openmp_policy_warm_tolerance,
+            0.02, space_filter(region)));
+    if(apex_openmp_policy_verbose) {
+        fprintf(stderr, "Starting warm-started tuning session for %s\n", region.name.c_str());
+    }
+    region.tuning.store(true, std::memory_order_release);
+    region.config.store(decode_point(region.space, region.search->current()));
+    set_omp_params(region);
+}
+
+// Where a cold tuning session starts.
+static std::string preferred_value(const search_dimension & dimension) {
+    if(dimension.name == "omp_num_threads") {
+        return "16";
+    } else if(dimension.name == "omp_schedule") {
+        return "static";
+    } else if(dimension.name == "omp_chunk_size") {
+        return "64";
+    }
+    return std::string();
+}
+
+// The value of the dimension closest to preferred, which need not be in it.
+static std::string initial_value(const search_dimension & dimension, const std::string & preferred) {
+    const int index = search_index_of(dimension, preferred);
+    return index < 0 ? dimension.values.front() : dimension.values[index];
+}
+
+// Starts a plugin-side model-based search from the default start point.
+static void start_model_session(omp_region & region) {
+    const search_space & dimensions = region.space.dimensions;
+    search_point start(dimensions.size(), 0);
+    for(size_t d = 0; d < dimensions.size(); ++d) {
+        start[d] = std::max(0, search_index_of(dimensions[d], initial_value(dimensions[d], preferred_value(dimensions[d]))));
+    }
+    region.search.reset(new bayesian_search(dimensions, start, space_filter(region), apex_openmp_policy_search_budget, 0.01,
+            static_cast<unsigned>(region.id) + 1));
+    if(apex_openmp_policy_verbose) {
+        fprintf(stderr, "Starting BAYESIAN tuning session for %s\n", region.name.c_str());
+    }
+    region.tuning.store(true, std::memory_order_release);
+    region.config.store(decode_point(region.space, region.search->current()));
+    set_omp_params(region);
+}
+
+// Starts measuring the region's configs for the replay tool.
+static void start_record_session(omp_region & region) {
+    const search_space & dimensions = region.space.dimensions;
+    search_point start(dimensions.size(), 0);
+    for(size_t d = 0; d < dimensions.size(); ++d) {
+        start[d] = std::max(0, search_index_of(dimensions[d], initial_value(dimensions[d], preferred_value(dimensions[d]))));
+    }
+    region.search.reset(new record_search(dimensions, start, space_filter(region), apex_openmp_policy_record_points,
+            static_cast<unsigned>(region.id) + 1));
+    if(apex_openmp_policy_verbose) {
+        fprintf(stderr, "Starting recording session for %s\n", region.name.c_str());
+    }
+    region.tuning.store(true, std::memory_order_release);
+    region.config.store(decode_point(region.space, region.search->current()));
+    set_omp_params(region);
+}
+
+static void freeze_region(omp_region & region);
+
+// A shared search may end on a point another process measured; keep the
+// node's value for it. Called with the region lock held.
+static void adopt_shared_result(omp_region & region) {
+    uint64_t key;
+    double value;
+    if(region.shared != nullptr && region.shared->converged_on(key, value)) {
+        region.best_value = value;
+        region.best_config = region.config.load();
+    }
+}
+
+// Starts a search shared with the other processes of the node, or pins the
+// region if one of them already converged. Returns false if the region's
+// space is too large to share.
+static bool start_shared_session(omp_region & region) {
+    const search_space & dimensions = region.space.dimensions;
+    search_point start(dimensions.size(), 0);
+    for(size_t d = 0; d < dimensions.size(); ++d) {
+        start[d] = std::max(0, search_index_of(dimensions[d], initial_value(dimensions[d], preferred_value(dimensions[d]))));
+    }
+    search_point last(dimensions.size(), 0);
+    for(size_t d = 0; d < dimensions.size(); ++d) {
+        last[d] = static_cast<int>(dimensions[d].values.size()) - 1;
+    }
+    if(shared_point_key(dimensions, last) == 0) {
+        return false;
+    }
+    region.shared = apex_openmp_policy_shared->region(region.name, shared_space_hash(dimensions));
+    if(region.shared == nullptr) {
+        std::cerr << "WARNING: Shared tuning table is full; tuning " << region.name << " alone" << std::endl;
+        return false;
+    }
+    uint64_t key;
+    double value;
+    if(region.shared->converged_on(key, value)) {
+        region.config.store(decode_point(region.space, shared_point(dimensions, key)));
+        region.best_value = value;
+        region.best_config = region.config.load();
+        if(apex_openmp_policy_verbose) {
+            fprintf(stderr, "Using the shared result for %s\n", region.name.c_str());
+        }
+        set_omp_params(region);
+        freeze_region(region);
+        return true;
+    }
+    region.search.reset(new cooperative_search(dimensions, start, region.shared, space_filter(region),
+            apex_openmp_policy_search_budget, static_cast<unsigned>(region.id) + 1, apex_openmp_policy_shared_timeout));
+    if(apex_openmp_policy_verbose) {
+        fprintf(stderr, "Starting shared tuning session for %s\n", region.name.c_str());
+    }
+    region.tuning.store(true, std::memory_order_release);
+    region.config.store(decode_point(region.space, region.search->current()));
+    set_omp_params(region);
+    // Other processes may have finished the search while this one was
+    // starting.
+    if(region.search->converged()) {
+        adopt_shared_result(region);
+        freeze_region(region);
+    }
+    return true;
+}
+
+static void start_tuning_session(omp_region & region) {
+    region.space = apex_openmp_policy_space.for_region(region.name);
+    if(apex_openmp_policy_record) {
+        start_record_session(region);
+        return;
+    }
+    if(region.prior != nullptr) {
+        start_warm_session(region);
+        return;
+    }
+    if(apex_openmp_policy_shared != nullptr && start_shared_session(region)) {
+        return;
+    }
+    if(apex_openmp_policy_bayesian) {
+        start_model_session(region);
+        return;
+    }
+    const std::string & name = region.name;
+    if(apex_openmp_policy_verbose) {
+        fprintf(stderr, "Starting tuning session for %s\n", name.c_str());
+    }
+    std::shared_ptr<apex_tuning_request> request{std::make_shared<apex_tuning_request>(name)};
+    region.request = request;
+
+    // Create an event to trigger this tuning session.
+    apex_event_type trigger = apex::register_custom_event(name);
+    request->set_trigger(trigger);
+
+    // Create a metric: the robust estimate of the time per call of the trial
+    // that just finished, or the known value of a point that was skipped.
+    // Only called from custom_event with the region lock held.
+    omp_region * region_ptr = &region;
+    std::function<double(void)> metric = [=]()->double{
+        const double result = region_ptr->trial_value;
+        if(result <= 0.0) {
+            std::cerr << "ERROR: no samples for " << name << std::endl;
+            return 0.0;
+        }
+        if(apex_openmp_policy_verbose) {
+            const sample_evaluator & samples = region_ptr->samples;
+            fprintf(stderr, "time per call: %f (%d samples, stddev %f)\n", result, samples.size(), std::sqrt(samples.variance()));
+        }
+        return result;
+    };
+    request->set_metric(metric);
+
+    // Set apex_openmp_policy_tuning_strategy
+    request->set_strategy(apex_openmp_policy_tuning_strategy);
+
+    // Create a parameter for each dimension of the region's space.
+    for(const search_dimension & dimension : region.space.dimensions) {
+        const std::list<std::string> values(dimension.values.begin(), dimension.values.end());
+        request->add_param_enum(dimension.name, initial_value(dimension, preferred_value(dimension)), values);
+    }
+
+    // Start the tuning session.
+    apex::setup_custom_tuning(*request);
+    region.tuning.store(true, std::memory_order_release);
+
+    // Set OpenMP runtime parameters to initial values.
+    update_omp_params(region);
+    set_omp_params(region);
+}
+
+static void register_stop_policy() {
+    std::function<int(apex_context const&)> policy_fn{policy};
+    stop_policy = apex::register_policy(APEX_STOP_EVENT, policy_fn);
+    apex_openmp_policy_stop_registered.store(stop_policy != nullptr);
+}
+
+// Called from a start event once every tuned region has converged.
+static void drop_stop_policy() {
+    std::lock_guard<std::mutex> guard(apex_openmp_policy_stop_policy_lock);
+    if(apex_openmp_policy_stop_registered && apex_openmp_policy_regions_tuning.load() == 0) {
+        if(apex_openmp_policy_verbose) {
+            fprintf(stderr, "All regions converged; deregistering stop policy.\n");
+        }
+        apex::deregister_policy(stop_policy);
+        apex_openmp_policy_stop_registered.store(false);
+    }
+}
+
+// Called when a new region starts tuning.
+static void restore_stop_policy() {
+    std::lock_guard<std::mutex> guard(apex_openmp_policy_stop_policy_lock);
+    apex_openmp_policy_stop_dropped.store(false);
+    if(!apex_openmp_policy_stop_registered) {
+        if(apex_openmp_policy_verbose) {
+            fprintf(stderr, "New region to tune; registering stop policy again.\n");
+        }
+        register_stop_policy();
+    }
+}
+
+static std::string schedule_name(omp_sched_t schedule);
+
+static history_entry make_history_entry(const omp_region & region, const omp_config & config, bool converged, double value) {
+    history_entry entry;
+    entry.name = region.name;
+    entry.threads = config.threads;
+    entry.schedule = schedule_name(config.sched);
+    entry.chunk = config.chunk;
+    entry.dynamic = config.dynamic;
+    entry.max_active_levels = config.max_active_levels;
+    entry.converged = converged;
+    entry.value = value > 0.0 ? value : std::numeric_limits<double>::quiet_NaN();
+    entry.objective = objective_name();
+    return entry;
+}
+
+static void journal_entry(const history_entry & entry, bool sync) {
+    std::lock_guard<std::mutex> guard(apex_openmp_policy_journal_lock);
+    if(apex_openmp_policy_journal == nullptr) {
+        return;
+    }
+    apex_openmp_policy_journal->append(entry, sync);
+    if(++apex_openmp_policy_journal_records >= apex_openmp_policy_journal_compact) {
+        apex_openmp_policy_compact_due.store(true, std::memory_order_relaxed);
+        apex_openmp_policy_journal_records = 0;
+    }
+}
+
+// Compacts the journal if journal_entry asked for it. Called without any
+// region lock held.
+static void maybe_compact_journal() {
+    if(!apex_openmp_policy_compact_due.load(std::memory_order_relaxed)
+            || !apex_openmp_policy_compact_due.exchange(false)) {
+        return;
+    }
+    std::lock_guard<std::mutex> guard(apex_openmp_policy_journal_lock);
+    if(apex_openmp_policy_journal != nullptr) {
+        compact_history(apex_openmp_policy_journal_path, apex_openmp_policy_journal->filename(), apex_openmp_policy_history_merge);
+    }
+}
+
+// Journals the best config so far of every region that is still tuning.
+// Called without any region lock held.
+static void journal_tuning_regions(bool sync) {
+    apex_openmp_policy_regions->for_each([&](omp_region & region) {
+        if(!region.tuning.load(std::memory_order_acquire) || region.frozen.load(std::memory_order_acquire)) {
+            return;
+        }
+        std::unique_lock<std::mutex> guard(region.lock);
+        if(region.best_value > 0.0 && !region.frozen.load(std::memory_order_relaxed)) {
+            const history_entry entry = make_history_entry(region, region.best_config, region.converged, region.best_value);
+            guard.unlock();
+            journal_entry(entry, sync);
+        }
+    });
+}
+
+static void maybe_journal_tuning_regions() {
+    if(apex_openmp_policy_journal == nullptr || apex_openmp_policy_journal_interval <= 0.0) {
+        return;
+    }
+    const int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    int64_t last = apex_openmp_policy_journal_last.load(std::memory_order_relaxed);
+    if(now - last < static_cast<int64_t>(apex_openmp_policy_journal_interval * 1e9)) {
+        return;
+    }
+    if(apex_openmp_policy_journal_last.compare_exchange_strong(last, now)) {
+        journal_tuning_regions(false);
+    }
+}
+
+// Called once a region that needed stop events no longer does.
+static void region_done_tuning() {
+    if(apex_openmp_policy_regions_tuning.fetch_sub(1) == 1 && apex_openmp_policy_drop_stop_policy) {
+        apex_openmp_policy_stop_dropped.store(true);
+    }
+}
+
+// Called with the region lock held once its session has converged.
+static void freeze_region(omp_region & region) {
+    region.converged = true;
+    region.frozen.store(true, std::memory_order_release);
+    if(apex_openmp_policy_verbose) {
+        const omp_config config = region.config.load();
+        fprintf(stderr, "Converged: %s -> (%d, %d, %d)\n", region.name.c_str(), config.threads, config.sched, config.chunk);
+    }
+    region_done_tuning();
+    if(apex_openmp_policy_journal != nullptr) {
+        journal_entry(make_history_entry(region, region.config.load(), true, region.best_value), true);
+        for(const omp_region * member : region.members) {
+            journal_entry(make_history_entry(*member, region.config.load(), true, 0.0), true);
+        }
+    }
+}
+
+// Called with the region lock held instead of freeze_region() in online
+// mode: the best configs measured become the arms of the bandit.
+static void start_online(omp_region & region) {
+    region.converged = true;
+    std::vector<std::pair<search_point, double>> arms(region.measured.begin(), region.measured.end());
+    std::sort(arms.begin(), arms.end(), [](const std::pair<search_point, double> & a, const std::pair<search_point, double> & b) {
+        return a.second < b.second;
+    });
+    if(arms.size() > apex_openmp_policy_online_arms) {
+        arms.resize(apex_openmp_policy_online_arms);
+    }
+    if(arms.empty()) {
+        freeze_region(region);
+        return;
+    }
+    region.online.reset(new online_tuner(arms, apex_openmp_policy_online_explore, apex_openmp_policy_drift_threshold));
+    region.config.store(decode_point(region.space, region.online->current()));
+    if(apex_openmp_policy_verbose) {
+        const omp_config config = region.config.load();
+        fprintf(stderr, "Converged: %s -> (%d, %d, %d), continuing online over %zu configs\n", region.name.c_str(),
+                config.threads, config.sched, config.chunk, arms.size());
+    }
+    if(apex_openmp_policy_journal != nullptr) {
+        journal_entry(make_history_entry(region, region.config.load(), true, region.best_value), true);
+    }
+}
+
+// Reports a batch to the bandit. When the incumbent drifted, a local
+// search around it starts and the region tunes again.
+static void online_step(omp_region & region, double value) {
+    if(!region.online->report(value)) {
+        region.best_value = region.online->incumbent_value();
+        region.best_config = decode_point(region.space, region.online->incumbent());
+        region.config.store(decode_point(region.space, region.online->current()));
+        return;
+    }
+    const search_point start = region.online->incumbent();
+    if(apex_openmp_policy_verbose) {
+        fprintf(stderr, "Performance of %s drifted; searching again.\n", region.name.c_str());
+    }
+    region.online.reset();
+    region.measured.clear();
+    region.converged = false;
+    region.best_value = 0.0;
+    region.best_spread = 0.0;
+    region.rungs.reset();
+    region.search.reset(new neighborhood_search(region.space.dimensions, start, 1, 0.0, 0.0, 0.02, space_filter(region)));
+    region.config.store(decode_point(region.space, region.search->current()));
+}
+
+static void start_timer(const omp_region & site, omp_region & region, const omp_config & config) {
+    if(region_timer_depth == max_timer_depth) {
+        // Overwriting an outer timer would make its stop time the wrong
+        // start; leave this one untimed instead.
+        apex_openmp_policy_timer_overflows.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    omp_region_timer & timer = region_timers[region_timer_depth++];
+    timer.site = &site;
+    timer.region = &region;
+    timer.config = config;
+    timer.start = std::chrono::steady_clock::now();
+    timer.imbalance = ompt_imbalance_thread_totals();
+    timer.energy = 0.0;
+    if(apex_openmp_policy_objective == tuning_objective::ENERGY && !region.frozen.load(std::memory_order_relaxed)) {
+        timer.energy = energy_counter_read();
+    }
+    timer.previous = nullptr;
+    if(region_timer_depth == 1 && last_region != nullptr) {
+        const std::chrono::duration<double> gap = timer.start - last_region_stop;
+        timer.previous = last_region;
+        timer.previous_threads = last_region_threads;
+        timer.gap = gap.count();
+    }
+}
+
+// The region that the innermost timed start of site on this thread was
+// tuning, or nullptr if there is none.
+static omp_region * timed_region(const omp_region & site) {
+    for(int depth = region_timer_depth - 1; depth >= 0; --depth) {
+        if(region_timers[depth].site == &site) {
+            return region_timers[depth].region;
+        }
+    }
+    return nullptr;
+}
+
+// Returns the seconds since the matching start on this thread, or a
+// negative value if there is none. The popped entry is copied to timer
+// if given.
+static double stop_timer(const omp_region & site, omp_region_timer * timer = nullptr) {
+    for(int depth = region_timer_depth - 1; depth >= 0; --depth) {
+        if(region_timers[depth].site == &site) {
+            region_timer_depth = depth;
+            const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            const std::chrono::duration<double> elapsed = now - region_timers[depth].start;
+            if(depth == 0) {
+                last_region = region_timers[depth].region;
+                last_region_threads = region_timers[depth].config.threads;
+                last_region_stop = now;
+            }
+            if(timer != nullptr) {
+                *timer = region_timers[depth];
+            }
+            return elapsed.count();
+        }
+    }
+    return -1.0;
+}
+
+// Appends a finished invocation to this thread's trace ring.
+static void trace_timer(const omp_region_timer & timer, double elapsed, uint8_t flags) {
+    trace_record record;
+    record.start = std::chrono::duration_cast<std::chrono::nanoseconds>(timer.start.time_since_epoch()).count();
+    record.stop = record.start + static_cast<uint64_t>(elapsed * 1e9);
+    record.region = timer.region->id;
+    record.chunk = timer.config.chunk;
+    record.threads = static_cast<int16_t>(timer.config.threads);
+    record.thread = 0;
+    const unsigned sched = static_cast<unsigned>(timer.config.sched);
+    record.schedule = static_cast<int8_t>(sched & ~omp_sched_monotonic_flag);
+    if(omp_sched_monotonic_flag != 0 && (sched & omp_sched_monotonic_flag)) {
+        record.schedule |= trace_schedule_monotonic;
+    }
+    record.flags = flags;
+    record.dynamic = static_cast<int8_t>(timer.config.dynamic);
+    record.max_active_levels = static_cast<int8_t>(std::min(timer.config.max_active_levels, 127));
+    trace_invocation(record);
+}
+
+static int context_bucket(long long work_size) {
+    int log2 = 0;
+    while(work_size > 1 && log2 < 63) {
+        work_size >>= 1;
+        ++log2;
+    }
+    return std::min(max_context_buckets - 1, log2 / apex_openmp_policy_context_granularity);
+}
+
+// The region tuning the invocations of site whose work size falls in the
+// given bucket. Lock-free once the bucket exists.
+static omp_region * context_region(omp_region & site, int bucket) {
+    std::atomic<omp_region *> * contexts = site.contexts.load(std::memory_order_acquire);
+    if(contexts == nullptr) {
+        std::atomic<omp_region *> * fresh = new std::atomic<omp_region *>[max_context_buckets];
+        for(int i = 0; i < max_context_buckets; ++i) {
+            fresh[i].store(nullptr, std::memory_order_relaxed);
+        }
+        if(site.contexts.compare_exchange_strong(contexts, fresh, std::memory_order_acq_rel)) {
+            contexts = fresh;
         } else {
-            throw std::invalid_argument("omp_schedule");
+            delete[] fresh;
+        }
+    }
+    omp_region * region = contexts[bucket].load(std::memory_order_acquire);
+    if(region == nullptr) {
+        const int low = bucket * apex_openmp_policy_context_granularity;
+        region = add_region(site.name + " [work 2^" + std::to_string(low) + "]");
+        if(region == nullptr) {
+            return &site;
+        }
+        if(trace_is_open()) {
+            trace_region(region->id, region->name);
         }
+        contexts[bucket].store(region, std::memory_order_release);
+    }
+    return region;
+}
 
-        std::shared_ptr<apex_param_enum> chunk_param = std::static_pointer_cast<apex_param_enum>(request->get_param("omp_chunk_size"));
-        const int chunk_size = atoi(chunk_param->get_value().c_str());
+static int64_t steady_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
 
-        const char * name = request->get_name().c_str();
+// True while trials have taken more than the budgeted share of the runtime.
+static bool over_budget() {
+    if(apex_openmp_policy_tuning_budget <= 0.0) {
+        return false;
+    }
+    const double elapsed = static_cast<double>(steady_ns() - apex_openmp_policy_start_ns);
+    return apex_openmp_policy_trial_ns.load(std::memory_order_relaxed) > apex_openmp_policy_tuning_budget * elapsed;
+}
+
+// Called with the region lock held on the region's first start when
+// regions are selected.
+static void start_observing(omp_region & region) {
+    region.config.store(apex_openmp_policy_default_config);
+    region.first_seen_ns.store(steady_ns());
+    region.next_selection.store(apex_openmp_policy_observe_calls);
+    region.observing.store(true, std::memory_order_release);
+    set_omp_params(region);
+}
 
+// The share of the time since the region was first seen spent in it.
+static double observed_share(const omp_region & region, int64_t now) {
+    const int64_t elapsed = now - region.first_seen_ns.load();
+    return elapsed > 0 ? region.observed_ns.load() / static_cast<double>(elapsed) : 0.0;
+}
+
+// Decides whether an observed region is tuned, skipped, or observed for
+// longer. Called with the region lock held.
+static void select_region(omp_region & region) {
+    const uint32_t calls = region.observed_calls.load();
+    if(!region.observing.load(std::memory_order_relaxed) || calls < region.next_selection.load()) {
+        return;
+    }
+    const double mean = region.observed_ns.load() * 1e-9 / calls;
+    if(mean < apex_openmp_policy_min_region_time) {
+        region.skipped = true;
+        region.observing.store(false, std::memory_order_relaxed);
+        region.frozen.store(true, std::memory_order_release);
         if(apex_openmp_policy_verbose) {
-            fprintf(stderr, "name: %s, num_threads: %d, schedule %d, chunk_size %d\n", name, num_threads, schedule, chunk_size);
+            fprintf(stderr, "Skipping %s: %g s per call.\n", region.name.c_str(), mean);
+        }
+        region_done_tuning();
+        return;
+    }
+    bool chosen = !over_budget();
+    if(chosen && apex_openmp_policy_top_regions > 0) {
+        // Regions already chosen, and those still observed that take a
+        // larger share of the runtime, come first.
+        const int64_t now = steady_ns();
+        const double share = observed_share(region, now);
+        int ahead = apex_openmp_policy_regions_selected.load();
+        apex_openmp_policy_regions->for_each([&](const omp_region & other) {
+            if(&other != &region && other.observing.load(std::memory_order_acquire) && observed_share(other, now) > share) {
+                ++ahead;
+            }
+        });
+        chosen = ahead < apex_openmp_policy_top_regions;
+    }
+    if(!chosen) {
+        region.next_selection.store(calls < (1u << 30) ? 2 * calls : calls);
+        return;
+    }
+    apex_openmp_policy_regions_selected.fetch_add(1);
+    if(apex_openmp_policy_verbose) {
+        fprintf(stderr, "Selected %s for tuning: %g s per call after %u calls.\n", region.name.c_str(), mean, calls);
+    }
+    start_tuning_session(region);
+    region.observing.store(false, std::memory_order_release);
+}
+
+// Called with the region lock held at the end of a trial that left the
+// region over budget.
+static void pause_region(omp_region & region) {
+    region.paused_config = region.config.load();
+    region.config.store(region.best_config);
+    region.paused.store(true, std::memory_order_release);
+    if(apex_openmp_policy_verbose) {
+        fprintf(stderr, "Tuning budget spent; pausing %s.\n", region.name.c_str());
+    }
+}
+
+// Returns false if the region has to stay paused.
+static bool resume_region(omp_region & region) {
+    if(over_budget()) {
+        return false;
+    }
+    std::lock_guard<std::mutex> guard(region.lock);
+    if(region.paused.load(std::memory_order_relaxed)) {
+        region.config.store(region.paused_config);
+        region.paused.store(false, std::memory_order_release);
+    }
+    return true;
+}
+
+// The region tuned for the outermost region that stopped on this thread,
+// if that was under APEX_OPENMP_BACK_TO_BACK seconds ago.
+static omp_region * back_to_back_region() {
+    if(region_timer_depth != 0 || last_region == nullptr) {
+        return nullptr;
+    }
+    const std::chrono::duration<double> gap = std::chrono::steady_clock::now() - last_region_stop;
+    return gap.count() <= apex_openmp_policy_back_to_back ? last_region : nullptr;
+}
+
+// Adds a region starting for the first time to the group of the region
+// that ran just before it, if that group is being tuned and has not
+// finished a trial yet. Called with the region lock held; returns the
+// leader, or nullptr if the region is tuned by itself.
+static omp_region * join_group(omp_region & region) {
+    omp_region * previous = back_to_back_region();
+    if(previous == nullptr) {
+        return nullptr;
+    }
+    omp_region * leader = previous->group.load(std::memory_order_acquire);
+    if(leader == nullptr) {
+        leader = previous;
+    }
+    if(leader == &region) {
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> guard(leader->lock);
+    if(!leader->tuning || leader->frozen.load(std::memory_order_relaxed) || leader->online != nullptr
+            || leader->observing.load(std::memory_order_relaxed) || !leader->measured.empty()
+            || leader->members.size() >= max_group_size) {
+        return nullptr;
+    }
+    leader->members.push_back(&region);
+    leader->group_last = &region;
+    // Samples so far did not include the new member.
+    leader->samples.reset();
+    leader->round_value = 0.0;
+    region.group.store(leader, std::memory_order_release);
+    if(apex_openmp_policy_verbose) {
+        fprintf(stderr, "Tuning %s together with %s\n", region.name.c_str(), leader->name.c_str());
+    }
+    return leader;
+}
+
+void handle_start(omp_region & region, const omp_region & site) {
+    if(region.frozen.load(std::memory_order_acquire)) {
+        // Converged: only apply the final config, timed only to see the
+        // gaps to the regions after it.
+        // Without stop events (APEX_OPENMP_DROP_STOP_POLICY) the timer
+        // would never be popped.
+        const omp_config config = set_omp_params(region);
+        if((trace_is_open() || apex_openmp_policy_transitions || apex_openmp_policy_groups)
+                && !apex_openmp_policy_stop_dropped.load(std::memory_order_relaxed)) {
+            start_timer(site, region, config);
+        }
+        if(apex_openmp_policy_stop_dropped.load(std::memory_order_relaxed) && apex_openmp_policy_stop_registered) {
+            drop_stop_policy();
         }
+        return;
+    }
+    // Group members run with their leader.
+    omp_region * leader = region.group.load(std::memory_order_acquire);
+    if(leader != nullptr) {
+        handle_start(*leader, site);
+        return;
+    }
+    if(!region.ready.load(std::memory_order_acquire)) {
+        {
+            std::lock_guard<std::mutex> guard(region.lock);
+            if(!region.ready.load(std::memory_order_relaxed)) {
+                leader = apex_openmp_policy_groups ? join_group(region) : nullptr;
+                if(leader == nullptr) {
+                    // Start a new tuning session.
+                    apex_openmp_policy_regions_tuning.fetch_add(1);
+                    if(apex_openmp_policy_drop_stop_policy) {
+                        restore_stop_policy();
+                    }
+                    if(apex_openmp_policy_selecting) {
+                        start_observing(region);
+                    } else {
+                        start_tuning_session(region);
+                    }
+                    region.ready.store(true, std::memory_order_release);
+                    start_timer(site, region, region.config.load());
+                    return;
+                }
+                region.ready.store(true, std::memory_order_release);
+            }
+        }
+        leader = region.group.load(std::memory_order_acquire);
+        if(leader != nullptr) {
+            handle_start(*leader, site);
+            return;
+        }
+    }
+    if(region.paused.load(std::memory_order_acquire) && !resume_region(region)) {
+        // Over budget: run the best config so far, untimed.
+        set_omp_params(region);
+        return;
+    }
+    // We've seen this region before.
+    start_timer(site, region, set_omp_params(region));
+}
+
+static const size_t max_skipped_points = 1000;
 
-        omp_set_num_threads(num_threads);
-        omp_set_schedule(schedule, chunk_size);
+// A value worse than anything the region measured, for points it rules out.
+// Only for the APEX-side searches; the plugin's own can skip points.
+static double excluded_value(const omp_region & region) {
+    double worst = 0.0;
+    for(const auto & measured : region.measured) {
+        worst = std::max(worst, measured.second);
+    }
+    return 2.0 * worst;
 }
 
-
-void handle_start(const std::string & name) {
-	//std::cout << __func__ << std::endl;
-    auto search = apex_openmp_policy_tuning_requests->find(name);
-    if(search == apex_openmp_policy_tuning_requests->end()) {
-        // Start a new tuning session.
+// Publishes the load imbalance of the trial that just ran config and, if
+// the static schedule left the threads waiting on each other, rules it out
+// for the rest of the search. Called with the region lock held.
+static void end_trial_imbalance(omp_region & region, const omp_config & config) {
+    if(region.imbalance_regions == 0) {
+        return;
+    }
+    const double imbalance = region.imbalance_sum / region.imbalance_regions;
+    region.imbalance_sum = 0.0;
+    region.imbalance_regions = 0;
+    apex::sample_value(region.name + " imbalance", imbalance);
+    if(apex_openmp_policy_verbose) {
+        fprintf(stderr, "name: %s, imbalance %.3f\n", region.name.c_str(), imbalance);
+    }
+    if(apex_openmp_policy_imbalance_threshold > 0.0 && !region.prune_static && region.online == nullptr
+            && imbalance > apex_openmp_policy_imbalance_threshold
+            && (config.sched & ~omp_sched_monotonic_flag) == omp_sched_static && other_schedules(region.space)) {
+        region.prune_static = true;
         if(apex_openmp_policy_verbose) {
-            fprintf(stderr, "Starting tuning session for %s\n", name.c_str());
-        }
-        std::shared_ptr<apex_tuning_request> request{std::make_shared<apex_tuning_request>(name)};
-        apex_openmp_policy_tuning_requests->insert(std::make_pair(name, request));
-
-        // Create an event to trigger this tuning session.
-        apex_event_type trigger = apex::register_custom_event(name);
-        request->set_trigger(trigger);
-
-        // Create a metric
-        std::function<double(void)> metric = [=]()->double{
-            apex_profile * profile = apex::get_profile(name);
-            if(profile == nullptr) {
-                std::cerr << "ERROR: no profile for " << name << std::endl;
-                return 0.0;
-            } 
-            if(profile->calls == 0.0) {
-                std::cerr << "ERROR: calls = 0 for " << name << std::endl;
-                return 0.0;
-            }
-            double result = profile->accumulated/profile->calls;
-            if(apex_openmp_policy_verbose) {
-                fprintf(stderr, "time per call: %f\n", result);
-            }
-            return result;
-        };
-        request->set_metric(metric);
+            fprintf(stderr, "name: %s, imbalance %.3f on the static schedule, only trying the others\n", region.name.c_str(), imbalance);
+        }
+    }
+}
 
-        // Set apex_openmp_policy_tuning_strategy
-        request->set_strategy(apex_openmp_policy_tuning_strategy);
+// The cost of the team size change on entry to the region, if the region
+// before it ran back to back with another team size: the gap between them
+// beyond the usual one. Also keeps the estimates of both up to date.
+// Called with the region lock held.
+static double transition_cost(omp_region & region, const omp_region_timer & timer) {
+    if(!apex_openmp_policy_transitions || timer.previous == nullptr || timer.previous == &region
+            || timer.gap > apex_openmp_policy_back_to_back) {
+        return 0.0;
+    }
+    const double weight = 0.2;
+    region.previous_threads = timer.previous_threads;
+    if(timer.previous_threads == timer.config.threads) {
+        region.steady_gap = region.steady_gap < 0.0 ? timer.gap : (1.0 - weight) * region.steady_gap + weight * timer.gap;
+        return 0.0;
+    }
+    if(region.steady_gap < 0.0) {
+        return 0.0;
+    }
+    const double cost = std::max(0.0, timer.gap - region.steady_gap);
+    region.switch_cost = region.switch_cost <= 0.0 ? cost : (1.0 - weight) * region.switch_cost + weight * cost;
+    return cost;
+}
 
-        int max_threads = omp_get_num_procs();
+// The objective value of an invocation that ran threads for seconds, plus
+// the cost of a transition in seconds, and used joules (ENERGY only). A
+// transition is charged to the energy at the region's average power.
+static double objective_value(int threads, double seconds, double cost, double joules) {
+    switch(apex_openmp_policy_objective) {
+        case tuning_objective::CORE_SECONDS:
+            return (seconds + cost) * threads;
+        case tuning_objective::WEIGHTED:
+            return (seconds + cost) * std::pow(static_cast<double>(threads), apex_openmp_policy_objective_weight);
+        case tuning_objective::ENERGY:
+            return seconds > 0.0 ? std::max(joules, 0.0) * (seconds + cost) / seconds : 0.0;
+        default:
+            // EFFICIENCY is a time until efficiency_penalty.
+            return seconds + cost;
+    }
+}
 
-        // Create a parameter for number of threads.
-        std::shared_ptr<apex_param_enum> threads_param = request->add_param_enum("omp_num_threads", "16", *thread_space);
+// For EFFICIENCY: scales a sample of seconds at threads up by how far its
+// efficiency relative to the region's baseline falls short of the minimum.
+// The first trial, which sets the baseline, is not penalized. Called with
+// the region lock held.
+static double efficiency_penalty(const omp_region & region, double seconds, int threads) {
+    if(apex_openmp_policy_objective != tuning_objective::EFFICIENCY || region.baseline_threads <= 0 || seconds <= 0.0) {
+        return seconds;
+    }
+    const double efficiency = region.baseline_value * region.baseline_threads / (seconds * threads);
+    return efficiency < apex_openmp_policy_min_efficiency ? seconds * apex_openmp_policy_min_efficiency / efficiency : seconds;
+}
 
-        // Create a parameter for scheduling policy.
-        std::shared_ptr<apex_param_enum> schedule_param = request->add_param_enum("omp_schedule", "static", *schedule_space);
+// Hysteresis on the team size of a region that just converged: it keeps
+// the team size of the region usually run just before it unless changing
+// gains more than the switch cost. The trials that change it were already
+// charged that cost, so the change has to pay for it twice. Called with
+// the region lock held.
+static void settle_team_size(omp_region & region) {
+    // The switch cost has no energy equivalent.
+    if(!apex_openmp_policy_transitions || region.previous_threads <= 0 || region.switch_cost <= 0.0
+            || apex_openmp_policy_objective == tuning_objective::ENERGY) {
+        return;
+    }
+    const omp_config config = region.config.load();
+    if(config.threads == region.previous_threads || region.best_value <= 0.0) {
+        return;
+    }
+    const search_point * same = nullptr;
+    double same_value = 0.0;
+    for(const auto & measured : region.measured) {
+        if((same == nullptr || measured.second < same_value)
+                && decode_point(region.space, measured.first).threads == region.previous_threads) {
+            same = &measured.first;
+            same_value = measured.second;
+        }
+    }
+    const double switch_cost = objective_value(config.threads, 0.0, region.switch_cost, 0.0);
+    if(same == nullptr || region.best_value + switch_cost < same_value) {
+        return;
+    }
+    if(apex_openmp_policy_verbose) {
+        fprintf(stderr, "Keeping %d threads for %s: %d would gain %g per call but switching costs %g\n", region.previous_threads,
+                region.name.c_str(), config.threads, same_value - region.best_value, switch_cost);
+    }
+    region.best_value = same_value;
+    region.best_config = decode_point(region.space, *same);
+    region.config.store(region.best_config);
+}
 
-        // Create a parameter for chunk size.
-        std::shared_ptr<apex_param_enum> chunk_param = request->add_param_enum("omp_chunk_size", "64", *chunk_space);
+// Reports a finished trial to the region's search and publishes the next
+// config. Called with the region lock held; returns true once converged.
+static bool tuner_step(omp_region & region, double value) {
+    if(region.search != nullptr) {
+        region.search->report(value);
+        // Points the search proposed before the static schedule was ruled
+        // out are skipped.
+        for(size_t skipped = 0; region.prune_static && skipped < max_skipped_points && !region.search->converged(); ++skipped) {
+            search_point point = region.search->current();
+            if(region_allows(region, point)) {
+                break;
+            }
+            region.search->skip();
+        }
+        region.config.store(decode_point(region.space, region.search->current()));
+        return region.search->converged();
+    }
+    std::shared_ptr<apex_tuning_request> request = region.request;
+    region.trial_value = value;
+    // Points that are excluded, or equivalent to one already measured, are
+    // answered right away instead of being run. Excluded points get a value
+    // worse than anything measured.
+    for(size_t skipped = 0; skipped <= max_skipped_points; ++skipped) {
+        // Evaluate the results
+        apex::custom_event(request->get_trigger(), NULL);
+        if(request->has_converged()) {
+            break;
+        }
+        search_point point = decode_omp_params(region);
+        const bool allowed = region_allows(region, point);
+        const auto known = region.measured.find(point);
+        if(allowed && known == region.measured.end()) {
+            break;
+        }
+        region.trial_value = allowed ? known->second : excluded_value(region);
+    }
+    update_omp_params(region);
+    return request->has_converged();
+}
 
-        // Set OpenMP runtime parameters to initial values.
-        set_omp_params(request);
+// Ends a trial of the region that ran config, with its estimate and
+// spread: steps the search and publishes the next config. Called with the
+// region lock held, on the application thread or the tuner thread.
+static void finish_trial(omp_region & region, double value, double spread, const omp_config & config) {
+    end_trial_imbalance(region, config);
+    if(apex_openmp_policy_objective == tuning_objective::EFFICIENCY && region.baseline_threads == 0) {
+        region.baseline_value = value;
+        region.baseline_threads = config.threads;
+    }
+    if(region.online != nullptr) {
+        online_step(region, value);
+        return;
+    }
+    if(region.best_value <= 0.0 || value < region.best_value) {
+        region.best_value = value;
+        region.best_spread = spread;
+        region.best_config = config;
+    }
+    region.measured[region.search != nullptr ? region.search->current() : region.point] = value;
+    const bool converged = tuner_step(region, value);
+    if(converged) {
+        adopt_shared_result(region);
+        settle_team_size(region);
+    }
+    if(converged && apex_openmp_policy_online) {
+        start_online(region);
+    } else if(converged) {
+        freeze_region(region);
+    } else if(over_budget()) {
+        pause_region(region);
+    }
+}
 
-        // Start the tuning session.
-        apex_tuning_session_handle session = apex::setup_custom_tuning(*request);
-    } else {
-        // We've seen this region before.
-        std::shared_ptr<apex_tuning_request> request = search->second;
-        set_omp_params(request);
+// Ends the trials queued by the application threads (APEX_OPENMP_ASYNC),
+// until asked to stop.
+static void run_tuner() {
+    apex::register_thread("apex_openmp_policy tuner");
+    finished_trial trial;
+    for(;;) {
+        while(apex_openmp_policy_trials->pop(trial)) {
+            {
+                std::lock_guard<std::mutex> guard(trial.region->lock);
+                if(!trial.region->frozen.load(std::memory_order_relaxed)) {
+                    finish_trial(*trial.region, trial.value, trial.spread, trial.config);
+                }
+                trial.region->pending.store(false, std::memory_order_release);
+            }
+            maybe_journal_tuning_regions();
+        }
+        maybe_compact_journal();
+        if(apex_openmp_policy_tuner_stop.load()) {
+            break;
+        }
+        std::unique_lock<std::mutex> guard(apex_openmp_policy_tuner_lock);
+        apex_openmp_policy_tuner_idle.store(true);
+        if(apex_openmp_policy_trials->empty() && !apex_openmp_policy_tuner_stop.load()) {
+            apex_openmp_policy_tuner_wake.wait_for(guard, std::chrono::milliseconds(10));
+        }
+        apex_openmp_policy_tuner_idle.store(false);
     }
+    apex::exit_thread();
 }
 
-void handle_stop(const std::string & name) {
-	//std::cout << __func__ << std::endl;
-    auto search = apex_openmp_policy_tuning_requests->find(name);
-    if(search == apex_openmp_policy_tuning_requests->end()) {
-        std::cerr << "ERROR: Stop received on \"" << name << "\" but we've never seen a start for it." << std::endl;
-    } else {
-        apex_profile * profile = apex::get_profile(name);
-        if(apex_openmp_policy_tuning_window == 1 || (profile != nullptr && profile->calls >= apex_openmp_policy_tuning_window)) {
-            std::shared_ptr<apex_tuning_request> request = search->second;
-            // Evaluate the results
-            apex::custom_event(request->get_trigger(), NULL);
-            // Reset counter so each measurement is fresh.
-            apex::reset(name);
+void handle_stop(omp_region & region, const omp_region & site) {
+    if(region.frozen.load(std::memory_order_acquire)) {
+        omp_region_timer timer;
+        const double elapsed = stop_timer(site, &timer);
+        if(elapsed >= 0.0 && trace_is_open()) {
+            trace_timer(timer, elapsed, trace_flag_converged);
+        }
+        return;
+    }
+    if(!region.ready.load(std::memory_order_acquire)) {
+        std::cerr << "ERROR: Stop received on \"" << region.name << "\" but we've never seen a start for it." << std::endl;
+    } else if(region.observing.load(std::memory_order_acquire)) {
+        omp_region_timer timer;
+        const double elapsed = stop_timer(site, &timer);
+        if(elapsed < 0.0) {
+            return;
+        }
+        if(trace_is_open()) {
+            trace_timer(timer, elapsed, 0);
+        }
+        region.observed_ns.fetch_add(static_cast<uint64_t>(elapsed * 1e9), std::memory_order_relaxed);
+        const uint32_t calls = region.observed_calls.fetch_add(1, std::memory_order_relaxed) + 1;
+        if(calls >= region.next_selection.load(std::memory_order_relaxed)) {
+            std::lock_guard<std::mutex> guard(region.lock);
+            select_region(region);
+        }
+    } else if(region.tuning.load(std::memory_order_acquire)) {
+        omp_region_timer timer;
+        const double elapsed = stop_timer(site, &timer);
+        if(elapsed < 0.0) {
+            return;
+        }
+        const double joules = apex_openmp_policy_objective == tuning_objective::ENERGY ? energy_counter_read() - timer.energy : 0.0;
+        if(region.pending.load(std::memory_order_acquire)) {
+            // The tuner thread is ending the trial; this invocation ran in
+            // neither that one nor the next.
+            if(trace_is_open()) {
+                trace_timer(timer, elapsed, trace_flag_trial);
+            }
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> guard(region.lock);
+            if(region.frozen.load(std::memory_order_relaxed)) {
+                return;
+            }
+            const bool stale = region.pending.load(std::memory_order_relaxed)
+                || (apex_openmp_policy_async && !same_config(timer.config, region.config.load()));
+            if(ompt_imbalance_active() && !stale) {
+                const ompt_imbalance_totals imbalance = ompt_imbalance_thread_totals();
+                region.imbalance_regions += imbalance.regions - timer.imbalance.regions;
+                region.imbalance_sum += imbalance.sum - timer.imbalance.sum;
+            }
+            if(apex_openmp_policy_tuning_budget > 0.0 && region.online == nullptr) {
+                apex_openmp_policy_trial_ns.fetch_add(static_cast<int64_t>(elapsed * 1e9), std::memory_order_relaxed);
+            }
+            if(trace_is_open()) {
+                trace_timer(timer, elapsed, region.online != nullptr ? trace_flag_online | trace_flag_converged : trace_flag_trial);
+            }
+            if(stale) {
+                return;
+            }
+            // A group's sample is only complete at the stop of its last member.
+            region.round_value += objective_value(timer.config.threads, elapsed, transition_cost(region, timer), joules);
+            if(region.group_last != nullptr && &site != region.group_last) {
+                return;
+            }
+            region.samples.add(efficiency_penalty(region, region.round_value, timer.config.threads));
+            region.round_value = 0.0;
+            // Online batches are not raced; the bandit needs them whole.
+            const bool searching = region.online == nullptr;
+            if(searching) {
+                region.samples.record_rung(apex_openmp_policy_evaluator, region.rungs);
+            }
+            if(!region.samples.done(apex_openmp_policy_evaluator, region.best_value, searching ? region.best_spread : 0.0)) {
+                return;
+            }
+            const double value = region.samples.estimate(apex_openmp_policy_evaluator);
+            const double spread = region.samples.relative_spread(apex_openmp_policy_evaluator);
+            // Start a fresh trial.
+            region.samples.reset();
+            if(apex_openmp_policy_async) {
+                region.pending.store(true, std::memory_order_release);
+                apex_openmp_policy_trials->push(finished_trial{&region, value, spread, region.config.load()});
+                if(apex_openmp_policy_tuner_idle.load()) {
+                    apex_openmp_policy_tuner_wake.notify_one();
+                }
+                return;
+            }
+            finish_trial(region, value, spread, region.config.load());
         }
+        maybe_journal_tuning_regions();
+        maybe_compact_journal();
     }
 };
 
 int policy(const apex_context context) {
-	//std::cout << __func__ << std::endl;
+    if(context.event_type == APEX_STOP_EVENT && apex_openmp_policy_stop_dropped.load(std::memory_order_relaxed)) {
+        return APEX_NOERROR;
+    }
     if(context.data == nullptr) {
         std::cerr << "ERROR: No task_identifier for event!" << std::endl;
         return APEX_ERROR;
     }
     apex::task_identifier * id = (apex::task_identifier *) context.data;
-    if(!id->has_name) {
-        // Skip events without names.
+    omp_region * region = apex_openmp_policy_regions->find(id);
+    if(region == nullptr) {
+        region = resolve_region(id);
+    }
+    if(region == &not_an_omp_region) {
+        // Skip events without names and events that are not parallel regions.
         return APEX_NOERROR;
     }
-    std::string name = id->get_name();
     if(context.event_type == APEX_START_EVENT) {
-        if(name.find("OpenMP_PARALLEL_REGION") == 0) {
-            handle_start(name);
+        omp_region * target = region;
+        if(region_work_size >= 0) {
+            target = context_region(*region, context_bucket(region_work_size));
+            region_work_size = -1;
         }
+        handle_start(*target, *region);
     } else if(context.event_type == APEX_STOP_EVENT) {
-        if(name.find("OpenMP_PARALLEL_REGION") == 0) {
-            handle_stop(name);
-        }
+        omp_region * target = timed_region(*region);
+        handle_stop(target == nullptr ? *region : *target, *region);
     }        
     return APEX_NOERROR;
 }
 
-void Tokenize(const std::string& str,
-                      std::vector<std::string>& tokens,
-                      const std::string& delimiters = ",")
-{
-    // Skip delimiters at beginning.
-    std::string::size_type lastPos = str.find_first_not_of(delimiters, 0);
-    // Find first "non-delimiter".
-    std::string::size_type pos     = str.find_first_of(delimiters, lastPos);
-
-    while (std::string::npos != pos || std::string::npos != lastPos)
-    {
-        // Found a token, add it to the vector.
-        tokens.push_back(str.substr(lastPos, pos - lastPos));
-        // Skip delimiters.  Note the "not_of"
-        lastPos = str.find_first_not_of(delimiters, pos);
-        // Find next "non-delimiter"
-        pos = str.find_first_of(delimiters, lastPos);
+// History entries are looked up lazily when a region is first entered.
+void read_results(const std::string & filename) {
+    apex_openmp_policy_history = new history_file();
+    if(!apex_openmp_policy_history->open(filename)) {
+        delete apex_openmp_policy_history;
+        apex_openmp_policy_history = nullptr;
+        assert(false);
+    } else if(apex_openmp_policy_verbose) {
+        fprintf(stderr, "Using %zu regions from history file %s\n", apex_openmp_policy_history->size(), filename.c_str());
     }
 }
 
-void read_results(const std::string & filename) {
-    std::ifstream results_file(filename, std::ifstream::in);
-    if(!results_file.good()) {
-        std::cerr << "Unable to open results file " << filename << std::endl;
-        assert(false);
-    } else {
-        std::string line;
-        std::getline(results_file, line); // ignore first line (header)
-        while(!results_file.eof()) {
-            std::getline(results_file, line);
-            std::vector<std::string> parts;
-            Tokenize(line, parts);
-            if(parts.size() == 5) {
-                std::string & name = parts[0];
-                std::string & threads = parts[1];
-                std::string & schedule = parts[2];
-                std::string & chunk_size = parts[3];
-                std::string & converged = parts[4];
-                // Remove quotes from strings
-                name.erase(std::remove(name.begin(), name.end(), '"'), name.end());
-                threads.erase(std::remove(threads.begin(), threads.end(), '"'), threads.end());
-                schedule.erase(std::remove(schedule.begin(), schedule.end(), '"'), schedule.end());
-                chunk_size.erase(std::remove(chunk_size.begin(), chunk_size.end(), '"'), chunk_size.end());
-                converged.erase(std::remove(converged.begin(), converged.end(), '"'), converged.end());
-                // Create a dummy tuning request with the values from the results file.
-                std::shared_ptr<apex_tuning_request> request{std::make_shared<apex_tuning_request>(name)};
-                apex_openmp_policy_tuning_requests->insert(std::make_pair(name, request));
-                std::shared_ptr<apex_param_enum> threads_param = request->add_param_enum("omp_num_threads", threads, {threads});
-                std::shared_ptr<apex_param_enum> schedule_param = request->add_param_enum("omp_schedule", schedule, {schedule});
-                std::shared_ptr<apex_param_enum> chunk_param = request->add_param_enum("omp_chunk_size", chunk_size, {chunk_size});
-                
-                if(apex_openmp_policy_verbose) {
-                   fprintf(stderr, "Added %s -> (%s, %s, %s) from history.\n", name.c_str(), threads.c_str(), schedule.c_str(), chunk_size.c_str());
-                }
-            }
-        }
+static std::string schedule_name(omp_sched_t schedule) {
+    if(omp_sched_monotonic_flag != 0 && (schedule & omp_sched_monotonic_flag)) {
+        return "monotonic:" + schedule_name(static_cast<omp_sched_t>(schedule & ~omp_sched_monotonic_flag));
+    }
+    switch(schedule) {
+        case omp_sched_static: return "static";
+        case omp_sched_dynamic: return "dynamic";
+        case omp_sched_guided: return "guided";
+        case omp_sched_auto: return "auto";
+        default: return "unknown";
     }
 }
 
 void print_summary() {
-    std::time_t time = std::time(NULL);
-    char time_str[128];
-    std::strftime(time_str, 128, "results-%F-%H-%M-%S.csv", std::localtime(&time));
-    std::ofstream results_file(time_str, std::ofstream::out);
-    results_file << "\"name\",\"num_threads\",\"schedule\",\"chunk_size\",\"converged\"" << std::endl;
+    // With a journal, results go to the journal's history instead of a new
+    // file per run.
+    std::ofstream results_file;
+    const bool write_results = apex_openmp_policy_journal == nullptr;
+    if(write_results) {
+        std::time_t time = std::time(NULL);
+        char time_str[128];
+        std::strftime(time_str, 128, "results-%F-%H-%M-%S.csv", std::localtime(&time));
+        results_file.open(time_str, std::ofstream::out);
+        results_file << "\"name\",\"num_threads\",\"schedule\",\"chunk_size\",\"converged\",\"value\",\"dynamic\",\"max_active_levels\",\"objective\"" << std::endl;
+    }
     std::cout << std::endl << "OpenMP final settings: " << std::endl;
-    for(auto request_pair : *apex_openmp_policy_tuning_requests) {
-        auto request = request_pair.second;
-        const std::string & name = request->get_name();
-        const std::string & threads = std::static_pointer_cast<apex_param_enum>(request->get_param("omp_num_threads"))->get_value();
-        const std::string & schedule = std::static_pointer_cast<apex_param_enum>(request->get_param("omp_schedule"))->get_value();
-        const std::string & chunk = std::static_pointer_cast<apex_param_enum>(request->get_param("omp_chunk_size"))->get_value();
-        const std::string converged = request->has_converged() ? "CONVERGED" : "NOT CONVERGED";
+    apex_openmp_policy_regions->for_each([&](omp_region & region) {
+        if(!region.ready.load(std::memory_order_acquire)) {
+            return;
+        }
+        // Group members report their leader's config.
+        const omp_region * leader = region.group.load(std::memory_order_acquire);
+        const omp_region & tuned = leader != nullptr ? *leader : region;
+        const omp_config config = tuned.config.load();
+        const std::string & name = region.name;
+        const int threads = config.threads;
+        const std::string schedule = schedule_name(config.sched);
+        const int chunk = config.chunk;
+        const std::string converged = tuned.converged ? "CONVERGED" : "NOT CONVERGED";
+        const std::string dynamic = config.dynamic < 0 ? "" : (config.dynamic ? "true" : "false");
+        const std::string levels = config.max_active_levels < 0 ? "" : std::to_string(config.max_active_levels);
         std::cout << "name: " << name << ", num_threads: " << threads << ", schedule: " << schedule
-            << ", chunk_size: " << chunk << " " << converged << std::endl;
-        results_file << "\"" << name << "\"," << threads << ",\"" << schedule << "\"," << chunk << ",\"" << converged << "\"" << std::endl;
-    }
+            << ", chunk_size: " << chunk;
+        if(!dynamic.empty()) {
+            std::cout << ", dynamic: " << dynamic;
+        }
+        if(!levels.empty()) {
+            std::cout << ", max_active_levels: " << levels;
+        }
+        std::cout << " " << (region.skipped ? "SKIPPED" : converged);
+        if(leader != nullptr) {
+            std::cout << " (with " << leader->name << ")";
+        }
+        std::cout << std::endl;
+        if(write_results) {
+            // A member never ran trials of its own, so its value is unknown
+            // (read back as NaN); the leader's covers the whole group.
+            results_file << "\"" << name << "\"," << threads << ",\"" << schedule << "\"," << chunk << ",\"" << converged << "\",";
+            if(leader == nullptr) {
+                results_file << region.best_value;
+            }
+            results_file << "," << dynamic << "," << levels << ",\"" << objective_name() << "\"" << std::endl;
+        }
+    });
     std::cout << std::endl;
-    results_file.flush();
-    results_file.close();
-}
-
-bool parse_space_file(const std::string & filename) {
-    using namespace rapidjson;
-    std::ifstream space_file(filename, std::ifstream::in);
-    if(!space_file.good()) {
-        std::cerr << "Unable to open parameter space specification file " << filename << std::endl;
-        assert(false);
-        return false;
-    } else {
-        IStreamWrapper space_file_wrapper(space_file);
-        Document document;
-        document.ParseStream(space_file_wrapper);
-        if(!document.IsObject()) {
-            std::cerr << "Parameter space file root must be an object." << std::endl;
-            return false;
-        }
-        if(!document.HasMember("tuning_space")) {
-            std::cerr << "Parameter space file root must contain a member named 'tuning_space'." << std::endl;
-            return false;
-        }
-
-        const auto & tuning_spec = document["tuning_space"];
-        if(!tuning_spec.IsObject()) {
-            std::cerr << "Parameter space file's 'tuning_space' member must be an object." << std::endl;
-            return false;
-        }
-        if(!tuning_spec.HasMember("omp_num_threads")) {
-            std::cerr << "Parameter space file's 'tuning_space' object must contain a member named 'omp_num_threads'" << std::endl;
-            return false;
-        }
-        if(!tuning_spec.HasMember("omp_schedule")) {
-            std::cerr << "Parameter space file's 'tuning_space' object must contain a member named 'omp_schedule'" << std::endl;
-            return false;
-        }
-        if(!tuning_spec.HasMember("omp_chunk_size")) {
-            std::cerr << "Parameter space file's 'tuning_space' object must contain a member named 'omp_chunk_size'" << std::endl;
-            return false;
-        }
-
-        const auto & omp_num_threads_array = tuning_spec["omp_num_threads"];
-        const auto & omp_schedule_array    = tuning_spec["omp_schedule"];
-        const auto & omp_chunk_size_array  = tuning_spec["omp_chunk_size"];
-
-        // Validate array types
-        if(!omp_num_threads_array.IsArray()) {
-            std::cerr << "Parameter space file's 'omp_num_threads' member must be an array." << std::endl;
-            return false;
-        }
-        if(!omp_schedule_array.IsArray()) {
-            std::cerr << "Parameter space file's 'omp_schedule' member must be an array." << std::endl;
-            return false;
-        }
-        if(!omp_chunk_size_array.IsArray()) {
-            std::cerr << "Parameter space file's 'omp_chunk_size' member must be an array." << std::endl;
-            return false;
-        }
-
-        // omp_num_threads
-        std::list<std::string> num_threads_list;
-        for(auto itr = omp_num_threads_array.Begin(); itr != omp_num_threads_array.End(); ++itr) {
-              if(itr->IsInt()) {
-                  const int this_num_threads = itr->GetInt();
-                  const std::string this_num_threads_str = std::to_string(this_num_threads);
-                  num_threads_list.push_back(this_num_threads_str);
-              } else if(itr->IsString()) {
-                  const char * this_num_threads = itr->GetString();
-                  const std::string this_num_threads_str = std::string(this_num_threads, itr->GetStringLength());
-                  num_threads_list.push_back(this_num_threads_str);
-              } else {
-                  std::cerr << "Parameter space file's 'omp_num_threads' member must contain only integers or strings" << std::endl;
-                  return false;
-              }
-        }
-        thread_space = new std::list<std::string>{num_threads_list};
-        
-        // omp_schedule
-        std::list<std::string> schedule_list;
-        for(auto itr = omp_schedule_array.Begin(); itr != omp_schedule_array.End(); ++itr) {
-              if(itr->IsString()) {
-                  const char * this_schedule = itr->GetString();
-                  const std::string this_schedule_str = std::string(this_schedule, itr->GetStringLength());
-                  schedule_list.push_back(this_schedule_str);
-              } else {
-                  std::cerr << "Parameter space file's 'omp_schedule' member must contain only strings" << std::endl;
-                  return false;
-              }
-        }
-        schedule_space = new std::list<std::string>{schedule_list};
-
-        // omp_chunk_size
-        std::list<std::string> chunk_size_list;
-        for(auto itr = omp_chunk_size_array.Begin(); itr != omp_chunk_size_array.End(); ++itr) {
-              if(itr->IsInt()) {
-                  const int this_chunk_size = itr->GetInt();
-                  const std::string this_chunk_size_str = std::to_string(this_chunk_size);
-                  chunk_size_list.push_back(this_chunk_size_str);
-              } else if(itr->IsString()) {
-                  const char * this_chunk_size = itr->GetString();
-                  const std::string this_chunk_size_str = std::string(this_chunk_size, itr->GetStringLength());
-                  chunk_size_list.push_back(this_chunk_size_str);
-              } else {
-                  std::cerr << "Parameter space file's 'omp_chunk_size' member must contain only integers or strings" << std::endl;
-                  return false;
-              }
-        }
-        chunk_space = new std::list<std::string>{chunk_size_list};
-        
+    if(write_results) {
+        results_file.flush();
+        results_file.close();
     }
-    return true;
 }
 
 void print_tuning_space() {
     std::cerr << "Tuning space: " << std::endl;
-    std::cerr << "\tomp_num_threads: ";
-    if(thread_space == nullptr) {
-        std::cerr << "NULL";
-    } else {
-        for(auto num_threads : *thread_space) {
-            std::cerr << num_threads << " ";
+    const tuning_space & space = apex_openmp_policy_space.global_space();
+    for(const search_dimension & dimension : space.dimensions) {
+        std::cerr << "\t" << dimension.name << ": ";
+        for(const std::string & value : dimension.values) {
+            std::cerr << value << " ";
         }
+        std::cerr << std::endl;
     }
-    std::cerr << std::endl;
-
-    std::cerr << "\tomp_schedule: ";
-    if(schedule_space == nullptr) {
-        std::cerr << "NULL";
-    } else {
-        for(auto schedule : *schedule_space) {
-            std::cerr << schedule << " ";
-        }
+    for(const space_constraint & constraint : space.constraints) {
+        std::cerr << "\tconstraint: " << constraint.param << (constraint.fixed.empty() ? " excludes some values" : " fixed to " + constraint.fixed)
+                  << " for some values of " << constraint.when << std::endl;
     }
-    std::cerr << std::endl;
-
-    std::cerr << "\tomp_chunk_size: ";
-    if(chunk_space == nullptr) {
-        std::cerr << "NULL";
-    } else {
-        for(auto chunk_size : *chunk_space) {
-            std::cerr << chunk_size << " ";
-        }
+    std::cerr << "\t" << space.size() << " distinct points" << std::endl;
+    for(size_t i = 0; i < apex_openmp_policy_space.override_count(); ++i) {
+        std::cerr << "\toverride for regions matching " << apex_openmp_policy_space.override_pattern(i) << std::endl;
     }
-    std::cerr << std::endl;
 }
 
 
@@ -416,13 +1777,168 @@ int register_policy() {
         apex_openmp_policy_verbose = 1;
     }
 
-    // APEX_OPENMP_WINDOW
+    // APEX_OPENMP_WINDOW: minimum number of samples per trial
     const char * option = std::getenv("APEX_OPENMP_WINDOW");
     if(option != nullptr) {
-        apex_openmp_policy_tuning_window = atoi(option);        
+        apex_openmp_policy_evaluator.min_samples = std::max(1, atoi(option));
+    }
+
+    // APEX_OPENMP_MAX_WINDOW: maximum number of samples per trial
+    option = std::getenv("APEX_OPENMP_MAX_WINDOW");
+    if(option != nullptr) {
+        apex_openmp_policy_evaluator.max_samples = atoi(option);
+    }
+    apex_openmp_policy_evaluator.max_samples = std::min(static_cast<int>(sample_evaluator::capacity),
+            std::max(apex_openmp_policy_evaluator.min_samples, apex_openmp_policy_evaluator.max_samples));
+
+    // APEX_OPENMP_PRECISION: relative confidence half-width that ends a trial
+    option = std::getenv("APEX_OPENMP_PRECISION");
+    if(option != nullptr) {
+        apex_openmp_policy_evaluator.precision = atof(option);
+    }
+
+    // APEX_OPENMP_BAD_MARGIN: how much slower than the best trial counts as clearly bad
+    option = std::getenv("APEX_OPENMP_BAD_MARGIN");
+    if(option != nullptr) {
+        apex_openmp_policy_evaluator.bad_margin = atof(option);
+    }
+
+    // APEX_OPENMP_RACE: 0 lets every trial reach APEX_OPENMP_WINDOW samples
+    option = std::getenv("APEX_OPENMP_RACE");
+    if(option != nullptr) {
+        apex_openmp_policy_evaluator.race = atoi(option) != 0;
+    }
+
+    // APEX_OPENMP_HALVING: successive halving factor of trial lengths, 0 for none
+    option = std::getenv("APEX_OPENMP_HALVING");
+    if(option != nullptr) {
+        if(atoi(option) >= 0) {
+            apex_openmp_policy_evaluator.halving_eta = atoi(option);
+        } else {
+            std::cerr << "Invalid setting for APEX_OPENMP_HALVING: " << option << std::endl;
+            std::cerr << "Will use default of " << apex_openmp_policy_evaluator.halving_eta << "." << std::endl;
+        }
+    }
+
+    // APEX_OPENMP_IMBALANCE: load imbalance above which the static schedule
+    // is ruled out, 0 for never (needs the plugin loaded as an OMPT tool,
+    // see ompt_imbalance.hpp)
+    option = std::getenv("APEX_OPENMP_IMBALANCE");
+    if(option != nullptr) {
+        if(atof(option) >= 0.0 && atof(option) < 1.0) {
+            apex_openmp_policy_imbalance_threshold = atof(option);
+        } else {
+            std::cerr << "Invalid setting for APEX_OPENMP_IMBALANCE: " << option << std::endl;
+            std::cerr << "Will use default of " << apex_openmp_policy_imbalance_threshold << "." << std::endl;
+        }
+    }
+
+    // APEX_OPENMP_TRANSITIONS: 1 charges team size changes between back
+    // to back regions to the trials that make them
+    // APEX_OPENMP_GROUPS: 1 tunes back-to-back regions together
+    // APEX_OPENMP_BACK_TO_BACK: largest gap in seconds between back-to-back
+    // regions
+    option = std::getenv("APEX_OPENMP_TRANSITIONS");
+    if(option != nullptr) {
+        apex_openmp_policy_transitions = atoi(option) != 0;
+    }
+    option = std::getenv("APEX_OPENMP_GROUPS");
+    if(option != nullptr) {
+        apex_openmp_policy_groups = atoi(option) != 0;
+    }
+    option = std::getenv("APEX_OPENMP_BACK_TO_BACK");
+    if(option != nullptr) {
+        if(atof(option) > 0.0) {
+            apex_openmp_policy_back_to_back = atof(option);
+        } else {
+            std::cerr << "Invalid setting for APEX_OPENMP_BACK_TO_BACK: " << option << std::endl;
+            std::cerr << "Will use default of " << apex_openmp_policy_back_to_back << "." << std::endl;
+        }
+    }
+
+    // APEX_OPENMP_ASYNC: 1 ends trials on a tuner thread
+    option = std::getenv("APEX_OPENMP_ASYNC");
+    if(option != nullptr && atoi(option) != 0) {
+        apex_openmp_policy_async = true;
+        apex_openmp_policy_trials = new mpsc_queue<finished_trial>();
+        apex_openmp_policy_tuner = std::thread(run_tuner);
+    }
+
+    // APEX_OPENMP_ESTIMATOR
+    option = std::getenv("APEX_OPENMP_ESTIMATOR");
+    if(option != nullptr) {
+        std::string estimator_str{option};
+        transform(estimator_str.begin(), estimator_str.end(), estimator_str.begin(), ::toupper);
+        if(estimator_str == "MEAN") {
+            apex_openmp_policy_evaluator.estimator = sample_estimator::MEAN;
+        } else if(estimator_str == "MEDIAN") {
+            apex_openmp_policy_evaluator.estimator = sample_estimator::MEDIAN;
+        } else if(estimator_str == "TRIMMED_MEAN") {
+            apex_openmp_policy_evaluator.estimator = sample_estimator::TRIMMED_MEAN;
+        } else {
+            std::cerr << "Invalid setting for APEX_OPENMP_ESTIMATOR: " << estimator_str << std::endl;
+            std::cerr << "Will use default of MEDIAN." << std::endl;
+        }
+    }
+
+    // APEX_OPENMP_OBJECTIVE: TIME, CORE_SECONDS, EFFICIENCY, WEIGHTED or ENERGY
+    option = std::getenv("APEX_OPENMP_OBJECTIVE");
+    if(option != nullptr) {
+        std::string objective_str{option};
+        transform(objective_str.begin(), objective_str.end(), objective_str.begin(), ::toupper);
+        if(objective_str == "TIME") {
+            apex_openmp_policy_objective = tuning_objective::TIME;
+        } else if(objective_str == "CORE_SECONDS") {
+            apex_openmp_policy_objective = tuning_objective::CORE_SECONDS;
+        } else if(objective_str == "EFFICIENCY") {
+            apex_openmp_policy_objective = tuning_objective::EFFICIENCY;
+        } else if(objective_str == "WEIGHTED") {
+            apex_openmp_policy_objective = tuning_objective::WEIGHTED;
+        } else if(objective_str == "ENERGY") {
+            apex_openmp_policy_objective = tuning_objective::ENERGY;
+        } else {
+            std::cerr << "Invalid setting for APEX_OPENMP_OBJECTIVE: " << objective_str << std::endl;
+            std::cerr << "Will use default of TIME." << std::endl;
+        }
+    }
+    // APEX_OPENMP_OBJECTIVE_WEIGHT: exponent of the team size for WEIGHTED
+    option = std::getenv("APEX_OPENMP_OBJECTIVE_WEIGHT");
+    if(option != nullptr) {
+        if(atof(option) >= 0.0 && atof(option) <= 1.0) {
+            apex_openmp_policy_objective_weight = atof(option);
+        } else {
+            std::cerr << "Invalid setting for APEX_OPENMP_OBJECTIVE_WEIGHT: " << option << std::endl;
+            std::cerr << "Will use default of " << apex_openmp_policy_objective_weight << "." << std::endl;
+        }
+    }
+    // APEX_OPENMP_MIN_EFFICIENCY: parallel efficiency below which EFFICIENCY penalizes a config
+    option = std::getenv("APEX_OPENMP_MIN_EFFICIENCY");
+    if(option != nullptr) {
+        if(atof(option) > 0.0 && atof(option) <= 1.0) {
+            apex_openmp_policy_min_efficiency = atof(option);
+        } else {
+            std::cerr << "Invalid setting for APEX_OPENMP_MIN_EFFICIENCY: " << option << std::endl;
+            std::cerr << "Will use default of " << apex_openmp_policy_min_efficiency << "." << std::endl;
+        }
+    }
+    // APEX_OPENMP_ENERGY_FILE: microjoule counter read instead of powercap
+    if(apex_openmp_policy_objective == tuning_objective::ENERGY) {
+        option = std::getenv("APEX_OPENMP_ENERGY_FILE");
+        if(!energy_counter_init(option == nullptr ? std::string() : std::string(option))) {
+            std::cerr << "Unable to read energy counters" << (option == nullptr ? "" : std::string(" from ") + option) << std::endl;
+            std::cerr << "Will use default of TIME." << std::endl;
+            apex_openmp_policy_objective = tuning_objective::TIME;
+        }
     }
+
     if(apex_openmp_policy_verbose) {
-        std::cerr << "apex_openmp_policy_tuning_window = " << apex_openmp_policy_tuning_window << std::endl;
+        std::cerr << "apex_openmp_policy_tuning_window = " << apex_openmp_policy_evaluator.min_samples
+            << ".." << apex_openmp_policy_evaluator.max_samples
+            << ", precision = " << apex_openmp_policy_evaluator.precision
+            << ", bad margin = " << apex_openmp_policy_evaluator.bad_margin
+            << ", racing " << (apex_openmp_policy_evaluator.race ? "on" : "off")
+            << ", halving factor = " << apex_openmp_policy_evaluator.halving_eta
+            << ", objective = " << objective_name() << std::endl;
     }
 
     // APEX_OPENMP_STRATEGY
@@ -447,12 +1963,262 @@ int register_policy() {
     } else if(apex_openmp_policy_tuning_strategy_str == "PARALLEL_RANK_ORDER") {
         apex_openmp_policy_tuning_strategy = apex_ah_tuning_strategy::PARALLEL_RANK_ORDER;
         std::cerr << "Using PARALLEL_RANK_ORDER tuning strategy." << std::endl;
+    } else if(apex_openmp_policy_tuning_strategy_str == "BAYESIAN") {
+        apex_openmp_policy_bayesian = true;
+        std::cerr << "Using BAYESIAN tuning strategy." << std::endl;
     } else {
         std::cerr << "Invalid setting for APEX_OPENMP_STRATEGY: " << apex_openmp_policy_tuning_strategy_str << std::endl;
         std::cerr << "Will use default of NELDER_MEAD." << std::endl;
         apex_openmp_policy_tuning_strategy = apex_ah_tuning_strategy::NELDER_MEAD;
     }
 
+    // APEX_OPENMP_SEARCH_BUDGET: maximum trials of the BAYESIAN strategy
+    option = std::getenv("APEX_OPENMP_SEARCH_BUDGET");
+    if(option != nullptr) {
+        apex_openmp_policy_search_budget = std::max(0, atoi(option));
+    }
+
+    // APEX_OPENMP_ONLINE: keep tuning converged regions
+    option = std::getenv("APEX_OPENMP_ONLINE");
+    if(option != nullptr) {
+        apex_openmp_policy_online = true;
+    }
+
+    // APEX_OPENMP_ONLINE_ARMS: configs the online bandit chooses between
+    option = std::getenv("APEX_OPENMP_ONLINE_ARMS");
+    if(option != nullptr) {
+        apex_openmp_policy_online_arms = std::max(1, atoi(option));
+    }
+
+    // APEX_OPENMP_ONLINE_EXPLORE: share of batches spent off the best config
+    option = std::getenv("APEX_OPENMP_ONLINE_EXPLORE");
+    if(option != nullptr) {
+        const double explore = atof(option);
+        if(explore >= 0.0 && explore < 1.0) {
+            apex_openmp_policy_online_explore = explore;
+        } else {
+            std::cerr << "Invalid setting for APEX_OPENMP_ONLINE_EXPLORE: " << option << std::endl;
+            std::cerr << "Will use default of " << apex_openmp_policy_online_explore << "." << std::endl;
+        }
+    }
+
+    // APEX_OPENMP_DRIFT_THRESHOLD: accumulated log slowdown that restarts a search
+    option = std::getenv("APEX_OPENMP_DRIFT_THRESHOLD");
+    if(option != nullptr) {
+        const double threshold = atof(option);
+        if(threshold > 0.0) {
+            apex_openmp_policy_drift_threshold = threshold;
+        } else {
+            std::cerr << "Invalid setting for APEX_OPENMP_DRIFT_THRESHOLD: " << option << std::endl;
+            std::cerr << "Will use default of " << apex_openmp_policy_drift_threshold << "." << std::endl;
+        }
+    }
+
+    // APEX_OPENMP_CONTEXT_GRANULARITY: work-size buckets span 2^granularity
+    option = std::getenv("APEX_OPENMP_CONTEXT_GRANULARITY");
+    if(option != nullptr) {
+        apex_openmp_policy_context_granularity = std::max(1, atoi(option));
+    }
+
+    // APEX_OPENMP_RECORD: trace file for record mode, where every trial
+    // takes the full window (APEX_OPENMP_MAX_WINDOW), without racing or
+    // pruning by load imbalance, so that replay_tuner can replay smaller
+    // ones
+    // APEX_OPENMP_RECORD_POINTS: configs measured per region
+    const char * record_option = std::getenv("APEX_OPENMP_RECORD");
+    if(record_option != nullptr) {
+        apex_openmp_policy_record = true;
+        apex_openmp_policy_evaluator.min_samples = apex_openmp_policy_evaluator.max_samples;
+        apex_openmp_policy_evaluator.race = false;
+        apex_openmp_policy_evaluator.halving_eta = 0;
+        apex_openmp_policy_imbalance_threshold = 0.0;
+        option = std::getenv("APEX_OPENMP_RECORD_POINTS");
+        if(option != nullptr) {
+            if(atoi(option) > 0) {
+                apex_openmp_policy_record_points = atoi(option);
+            } else {
+                std::cerr << "Invalid setting for APEX_OPENMP_RECORD_POINTS: " << option << std::endl;
+                std::cerr << "Will use default of " << apex_openmp_policy_record_points << "." << std::endl;
+            }
+        }
+        std::cerr << "Recording up to " << apex_openmp_policy_record_points << " configs per region to " << record_option << std::endl;
+    }
+
+    // APEX_OPENMP_TRACE: file to write a binary trace of every region
+    // invocation to (see trace_reader)
+    // APEX_OPENMP_TRACE_BUFFER: records buffered per thread between flushes
+    option = std::getenv("APEX_OPENMP_TRACE");
+    if(record_option != nullptr) {
+        if(option != nullptr) {
+            std::cerr << "WARNING: APEX_OPENMP_TRACE is ignored in record mode; the trace goes to APEX_OPENMP_RECORD." << std::endl;
+        }
+        option = record_option;
+    }
+    if(option != nullptr) {
+        size_t trace_buffer = 8192;
+        const char * buffer_option = std::getenv("APEX_OPENMP_TRACE_BUFFER");
+        if(buffer_option != nullptr) {
+            const long value = atol(buffer_option);
+            if(value > 0) {
+                trace_buffer = value;
+            } else {
+                std::cerr << "Invalid setting for APEX_OPENMP_TRACE_BUFFER: " << buffer_option << std::endl;
+                std::cerr << "Will use default of " << trace_buffer << "." << std::endl;
+            }
+        }
+        trace_open(option, trace_buffer, 100);
+    }
+
+    // APEX_OPENMP_MIN_REGION_TIME: seconds per call below which a region
+    // is not tuned
+    option = std::getenv("APEX_OPENMP_MIN_REGION_TIME");
+    if(option != nullptr) {
+        if(atof(option) >= 0.0) {
+            apex_openmp_policy_min_region_time = atof(option);
+            apex_openmp_policy_selecting = apex_openmp_policy_min_region_time > 0.0;
+        } else {
+            std::cerr << "Invalid setting for APEX_OPENMP_MIN_REGION_TIME: " << option << std::endl;
+            std::cerr << "Will use default of 0." << std::endl;
+        }
+    }
+
+    // APEX_OPENMP_TOP_REGIONS: tune only the regions taking the most time
+    option = std::getenv("APEX_OPENMP_TOP_REGIONS");
+    if(option != nullptr) {
+        if(atoi(option) >= 0) {
+            apex_openmp_policy_top_regions = atoi(option);
+            apex_openmp_policy_selecting = apex_openmp_policy_selecting || apex_openmp_policy_top_regions > 0;
+        } else {
+            std::cerr << "Invalid setting for APEX_OPENMP_TOP_REGIONS: " << option << std::endl;
+            std::cerr << "Will use default of 0 (all regions)." << std::endl;
+        }
+    }
+
+    // APEX_OPENMP_OBSERVE_CALLS: calls observed before selecting a region
+    option = std::getenv("APEX_OPENMP_OBSERVE_CALLS");
+    if(option != nullptr) {
+        if(atoi(option) > 0) {
+            apex_openmp_policy_observe_calls = atoi(option);
+        } else {
+            std::cerr << "Invalid setting for APEX_OPENMP_OBSERVE_CALLS: " << option << std::endl;
+            std::cerr << "Will use default of " << apex_openmp_policy_observe_calls << "." << std::endl;
+        }
+    }
+
+    // APEX_OPENMP_TUNING_BUDGET: fraction of the runtime that trials may take
+    option = std::getenv("APEX_OPENMP_TUNING_BUDGET");
+    if(option != nullptr) {
+        const double budget = atof(option);
+        if(budget > 0.0 && budget <= 1.0) {
+            apex_openmp_policy_tuning_budget = budget;
+        } else {
+            std::cerr << "Invalid setting for APEX_OPENMP_TUNING_BUDGET: " << option << std::endl;
+            std::cerr << "Will use default of no budget." << std::endl;
+        }
+    }
+    apex_openmp_policy_start_ns = steady_ns();
+    {
+        omp_sched_t schedule;
+        int chunk;
+        omp_get_schedule(&schedule, &chunk);
+        apex_openmp_policy_default_config = omp_config{omp_get_max_threads(), schedule, chunk};
+        apex_openmp_policy_default_config.dynamic = omp_get_dynamic();
+        apex_openmp_policy_default_config.max_active_levels = omp_get_max_active_levels();
+    }
+    if(apex_openmp_policy_verbose && apex_openmp_policy_selecting) {
+        std::cerr << "Selecting regions after " << apex_openmp_policy_observe_calls << " calls: at least "
+            << apex_openmp_policy_min_region_time << " s per call";
+        if(apex_openmp_policy_top_regions > 0) {
+            std::cerr << ", top " << apex_openmp_policy_top_regions << " by time";
+        }
+        std::cerr << std::endl;
+    }
+
+    // APEX_OPENMP_SHARED_TIMEOUT: seconds after which a claimed point is
+    // taken to belong to a process that died
+    option = std::getenv("APEX_OPENMP_SHARED_TIMEOUT");
+    if(option != nullptr) {
+        if(atof(option) > 0.0) {
+            apex_openmp_policy_shared_timeout = atof(option);
+        } else {
+            std::cerr << "Invalid setting for APEX_OPENMP_SHARED_TIMEOUT: " << option << std::endl;
+            std::cerr << "Will use default of " << apex_openmp_policy_shared_timeout << "." << std::endl;
+        }
+    }
+
+    // APEX_OPENMP_SHARED: name of the shared memory segment through which
+    // the processes of a node tune together
+    option = std::getenv("APEX_OPENMP_SHARED");
+    if(option != nullptr && option[0] != '\0') {
+        if(apex_openmp_policy_record) {
+            std::cerr << "WARNING: APEX_OPENMP_SHARED is ignored in record mode." << std::endl;
+        } else {
+            apex_openmp_policy_shared = new shared_table();
+            if(!apex_openmp_policy_shared->open(option)) {
+                delete apex_openmp_policy_shared;
+                apex_openmp_policy_shared = nullptr;
+            } else {
+                std::cerr << "Tuning together with the other processes attached to " << option << " ("
+                    << apex_openmp_policy_shared->processes() << " so far) using the BAYESIAN strategy." << std::endl;
+            }
+        }
+    }
+
+    // APEX_OPENMP_WARM_START
+    option = std::getenv("APEX_OPENMP_WARM_START");
+    if(option != nullptr) {
+        apex_openmp_policy_warm_start = true;
+    }
+
+    // APEX_OPENMP_WARM_TOLERANCE
+    option = std::getenv("APEX_OPENMP_WARM_TOLERANCE");
+    if(option != nullptr) {
+        apex_openmp_policy_warm_tolerance = atof(option);
+    }
+
+    // APEX_OPENMP_HISTORY_MERGE
+    option = std::getenv("APEX_OPENMP_HISTORY_MERGE");
+    if(option != nullptr) {
+        std::string merge_str{option};
+        transform(merge_str.begin(), merge_str.end(), merge_str.begin(), ::toupper);
+        if(merge_str == "BEST") {
+            apex_openmp_policy_history_merge = history_merge::BEST;
+        } else if(merge_str == "LATEST") {
+            apex_openmp_policy_history_merge = history_merge::LATEST;
+        } else {
+            std::cerr << "Invalid setting for APEX_OPENMP_HISTORY_MERGE: " << merge_str << std::endl;
+            std::cerr << "Will use default of LATEST." << std::endl;
+        }
+    }
+
+    // APEX_OPENMP_JOURNAL_INTERVAL
+    option = std::getenv("APEX_OPENMP_JOURNAL_INTERVAL");
+    if(option != nullptr) {
+        apex_openmp_policy_journal_interval = atof(option);
+    }
+
+    // APEX_OPENMP_JOURNAL_COMPACT
+    option = std::getenv("APEX_OPENMP_JOURNAL_COMPACT");
+    if(option != nullptr) {
+        apex_openmp_policy_journal_compact = std::max(1, atoi(option));
+    }
+
+    // APEX_OPENMP_JOURNAL
+    option = std::getenv("APEX_OPENMP_JOURNAL");
+    if(option != nullptr && option[0] != '\0') {
+        apex_openmp_policy_journal_path = std::string(option);
+        const std::string journal_file = apex_openmp_policy_journal_path + ".journal";
+        // Recover whatever an earlier run that did not finish left behind.
+        compact_history(apex_openmp_policy_journal_path, journal_file, apex_openmp_policy_history_merge);
+        apex_openmp_policy_journal = new history_journal();
+        if(!apex_openmp_policy_journal->open(journal_file)) {
+            delete apex_openmp_policy_journal;
+            apex_openmp_policy_journal = nullptr;
+        } else if(apex_openmp_policy_verbose) {
+            std::cerr << "Journaling tuning results to " << journal_file << std::endl;
+        }
+    }
+
     // APEX_OPENMP_HISTORY
     const char * apex_openmp_policy_history_file_option = std::getenv("APEX_OPENMP_HISTORY");
     if(apex_openmp_policy_history_file_option != nullptr) {
@@ -460,35 +2226,93 @@ int register_policy() {
         if(!apex_openmp_policy_history_file.empty()) {
             apex_openmp_policy_use_history = true;
         }
+    } else if(apex_openmp_policy_journal != nullptr) {
+        // The journal's history doubles as the history for this run.
+        struct stat st;
+        if(stat(apex_openmp_policy_journal_path.c_str(), &st) == 0 && st.st_size > 0) {
+            apex_openmp_policy_history_file = apex_openmp_policy_journal_path;
+            apex_openmp_policy_use_history = true;
+        }
     }
     if(apex_openmp_policy_use_history) {
         read_results(apex_openmp_policy_history_file);
     }
 
+    // APEX_OPENMP_DROP_STOP_POLICY
+    const char * apex_openmp_policy_drop_stop_policy_option = std::getenv("APEX_OPENMP_DROP_STOP_POLICY");
+    if(apex_openmp_policy_drop_stop_policy_option != nullptr) {
+        apex_openmp_policy_drop_stop_policy = true;
+    }
+    if(apex_openmp_policy_online && apex_openmp_policy_drop_stop_policy) {
+        std::cerr << "WARNING: APEX_OPENMP_DROP_STOP_POLICY has no effect with APEX_OPENMP_ONLINE." << std::endl;
+    }
+
     // APEX_OPENMP_SPACE
+    const cpu_topology topology = read_topology();
+    default_thread_space = topology_thread_space(topology);
     const char * apex_openmp_policy_space_file_option = std::getenv("APEX_OPENMP_SPACE");
     bool using_space_file = false;
     if(apex_openmp_policy_space_file_option != nullptr) {
-        const std::string apex_opemp_policy_space_file{apex_openmp_policy_space_file_option};
-        using_space_file = parse_space_file(apex_opemp_policy_space_file);
+        const std::map<std::string, int> symbols{{"cores", topology.core_limit}, {"cpus", topology.cpus},
+            {"cores_per_socket", topology.cores_per_socket}, {"cores_per_numa_node", topology.cores_per_numa_node}};
+        using_space_file = apex_openmp_policy_space.parse(apex_openmp_policy_space_file_option, symbols);
         if(!using_space_file) {
+            apex_openmp_policy_space = tuning_space_config();
             std::cerr << "WARNING: Unable to use tuning space file " << apex_openmp_policy_space_file_option << ". Using default tuning space instead." << std::endl;
         }
     } 
 
-    // Set up the search spaces
+    // Set up the search spaces. Parameters the space file leaves out keep
+    // their default values.
     if(!using_space_file) {
         if(apex_openmp_policy_verbose) {
-            std::cerr << "Using default tuning space." << std::endl;
+            std::cerr << "Using default tuning space for " << topology.cores << " cores (limit " << topology.core_limit
+                      << ", " << topology.cpus << " hardware threads) on " << topology.sockets << " sockets and "
+                      << topology.numa_nodes << " NUMA nodes." << std::endl;
         }
-        thread_space   = &default_thread_space;
-        schedule_space = &default_schedule_space;
-        chunk_space    = &default_chunk_space;
     } else {
         if(apex_openmp_policy_verbose) {
             std::cerr << "Using tuning space from " << apex_openmp_policy_space_file_option << std::endl;
         }
     }
+    search_space defaults(3);
+    defaults[0].name = "omp_num_threads";
+    defaults[0].values.assign(default_thread_space.begin(), default_thread_space.end());
+    defaults[1].name = "omp_schedule";
+    defaults[1].values.assign(default_schedule_space.begin(), default_schedule_space.end());
+    defaults[2].name = "omp_chunk_size";
+    defaults[2].values.assign(default_chunk_space.begin(), default_chunk_space.end());
+    apex_openmp_policy_space.add_defaults(defaults);
+    // Placement and wait policy are read once when the OpenMP runtime starts
+    // and have no setter, so they cannot be tuned per region.
+    static const char * const init_only[][2] = {
+        {"omp_proc_bind", "OMP_PROC_BIND"}, {"omp_places", "OMP_PLACES"}, {"omp_wait_policy", "OMP_WAIT_POLICY"}};
+    for(const auto & knob : init_only) {
+        if(apex_openmp_policy_space.remove_dimension(knob[0])) {
+            const char * value = std::getenv(knob[1]);
+            std::cerr << "WARNING: " << knob[0] << " can only be set through " << knob[1]
+                      << " before the OpenMP runtime starts (currently " << (value == nullptr ? "unset" : value)
+                      << "); not tuning it. Compare settings across runs instead." << std::endl;
+        }
+    }
+    // The modifier has no effect on the static schedule (always monotonic)
+    // and auto (implementation-defined).
+    space_constraint modifier;
+    modifier.when = "omp_schedule";
+    modifier.when_values = {"static", "auto"};
+    modifier.param = "omp_schedule_modifier";
+    modifier.fixed = "nonmonotonic";
+    apex_openmp_policy_space.add_constraint(modifier);
+    if(omp_sched_monotonic_flag == 0 && apex_openmp_policy_space.remove_dimension("omp_schedule_modifier")) {
+        std::cerr << "WARNING: omp_schedule_modifier needs OpenMP 5.0; not tuning it." << std::endl;
+    }
+    static const std::set<std::string> known{"omp_num_threads", "omp_schedule", "omp_chunk_size",
+        "omp_schedule_modifier", "omp_dynamic", "omp_max_active_levels"};
+    for(const search_dimension & dimension : apex_openmp_policy_space.global_space().dimensions) {
+        if(known.count(dimension.name) == 0) {
+            std::cerr << "WARNING: Tuning space parameter " << dimension.name << " is not an OpenMP setting this policy knows; it is tuned but has no effect." << std::endl;
+        }
+    }
 
     if(apex_openmp_policy_verbose) {
         print_tuning_space();
@@ -498,7 +2322,7 @@ int register_policy() {
     // Register the policy functions with APEX
     std::function<int(apex_context const&)> policy_fn{policy};
     start_policy = apex::register_policy(APEX_START_EVENT, policy_fn);    
-    stop_policy  = apex::register_policy(APEX_STOP_EVENT,  policy_fn);    
+    register_stop_policy();
     if(start_policy == nullptr || stop_policy == nullptr) {
         return APEX_ERROR;
     } else {
@@ -508,11 +2332,15 @@ int register_policy() {
  
 extern "C" {
 
+    void apex_openmp_policy_set_work_size(long long work_size) {
+        region_work_size = work_size < 0 ? 0 : work_size;
+    }
+
     int apex_plugin_init() {
 		std::cout << __func__ << std::endl;
         if(!apex_openmp_policy_running) {
             fprintf(stderr, "apex_openmp_policy init\n");
-            apex_openmp_policy_tuning_requests = new std::unordered_map<std::string, std::shared_ptr<apex_tuning_request>>(); 
+            apex_openmp_policy_regions = new region_registry<omp_region>(); 
             int status =  register_policy();
             apex_openmp_policy_running = true;
             return status;
@@ -528,8 +2356,30 @@ extern "C" {
             fprintf(stderr, "apex_openmp_policy finalize\n");
             //apex::deregister_policy(start_policy);
             //apex::deregister_policy(stop_policy);
+            if(apex_openmp_policy_async) {
+                apex_openmp_policy_tuner_stop.store(true);
+                apex_openmp_policy_tuner_wake.notify_one();
+                apex_openmp_policy_tuner.join();
+                delete apex_openmp_policy_trials;
+                apex_openmp_policy_trials = nullptr;
+            }
+            if(apex_openmp_policy_timer_overflows.load() > 0) {
+                fprintf(stderr, "WARNING: %llu region starts nested more than %d deep were not timed.\n",
+                        static_cast<unsigned long long>(apex_openmp_policy_timer_overflows.load()), max_timer_depth);
+            }
             print_summary();
-            delete apex_openmp_policy_tuning_requests;
+            trace_close();
+            delete apex_openmp_policy_shared;
+            apex_openmp_policy_shared = nullptr;
+            if(apex_openmp_policy_journal != nullptr) {
+                journal_tuning_regions(true);
+                compact_history(apex_openmp_policy_journal_path, apex_openmp_policy_journal->filename(), apex_openmp_policy_history_merge);
+                delete apex_openmp_policy_journal;
+                apex_openmp_policy_journal = nullptr;
+            }
+            delete apex_openmp_policy_regions;
+            delete apex_openmp_policy_history;
+            apex_openmp_policy_history = nullptr;
             apex_openmp_policy_running = false;
             return APEX_NOERROR;
         } else {
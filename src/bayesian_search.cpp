@@ -0,0 +1,342 @@
+//  APEX OpenMP Policy
+//
+//  Copyright (c) 2015 University of Oregon
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <algorithm>
+
+#include "bayesian_search.hpp"
+
+// Spaces larger than this are searched over a random sample of points.
+static const size_t max_enumerated = 50000;
+static const size_t sampled_candidates = 5000;
+// Observation noise, relative to the variance of the standardized values.
+static const double noise = 0.01;
+
+// Lower Cholesky factor of the n x n matrix a (row-major), in place.
+// Returns false if a is not positive definite.
+static bool cholesky(std::vector<double> & a, size_t n) {
+    for(size_t j = 0; j < n; ++j) {
+        double diagonal = a[j * n + j];
+        for(size_t k = 0; k < j; ++k) {
+            diagonal -= a[j * n + k] * a[j * n + k];
+        }
+        if(diagonal <= 0.0) {
+            return false;
+        }
+        a[j * n + j] = std::sqrt(diagonal);
+        for(size_t i = j + 1; i < n; ++i) {
+            double sum = a[i * n + j];
+            for(size_t k = 0; k < j; ++k) {
+                sum -= a[i * n + k] * a[j * n + k];
+            }
+            a[i * n + j] = sum / a[j * n + j];
+        }
+        for(size_t k = j + 1; k < n; ++k) {
+            a[j * n + k] = 0.0;
+        }
+    }
+    return true;
+}
+
+// Solves l x = b for lower triangular l.
+static std::vector<double> forward(const std::vector<double> & l, size_t n, const std::vector<double> & b) {
+    std::vector<double> x(b);
+    for(size_t i = 0; i < n; ++i) {
+        for(size_t k = 0; k < i; ++k) {
+            x[i] -= l[i * n + k] * x[k];
+        }
+        x[i] /= l[i * n + i];
+    }
+    return x;
+}
+
+// Solves l^T x = b for lower triangular l.
+static std::vector<double> backward(const std::vector<double> & l, size_t n, const std::vector<double> & b) {
+    std::vector<double> x(b);
+    for(size_t i = n; i-- > 0;) {
+        for(size_t k = i + 1; k < n; ++k) {
+            x[i] -= l[k * n + i] * x[k];
+        }
+        x[i] /= l[i * n + i];
+    }
+    return x;
+}
+
+static bool is_numeric(const search_dimension & dimension) {
+    for(const std::string & value : dimension.values) {
+        char * end = nullptr;
+        strtod(value.c_str(), &end);
+        if(end == value.c_str() || *end != '\0') {
+            return false;
+        }
+    }
+    return true;
+}
+
+bayesian_search::bayesian_search(const search_space & space, const search_point & start, const search_filter & filter,
+        size_t max_trials, double min_improvement, unsigned seed)
+    : space(space), filter(filter), max_trials(max_trials), min_improvement(min_improvement), random(seed),
+      initial_size(0), point(start), best_point(start), best_value(std::numeric_limits<double>::infinity()), done(false) {
+    for(const search_dimension & dimension : space) {
+        numeric.push_back(is_numeric(dimension));
+    }
+    if(this->filter) {
+        this->filter(point);
+        best_point = point;
+    }
+    enumerate_candidates();
+    if(this->max_trials == 0) {
+        this->max_trials = 10 + 5 * space.size();
+    }
+    this->max_trials = std::min(this->max_trials, candidates.size());
+    design_initial(point);
+}
+
+double bayesian_search::distance2(const search_point & a, const search_point & b) const {
+    double sum = 0.0;
+    for(size_t d = 0; d < space.size(); ++d) {
+        if(numeric[d]) {
+            const size_t size = space[d].values.size();
+            const double delta = size > 1 ? static_cast<double>(a[d] - b[d]) / (size - 1) : 0.0;
+            sum += delta * delta;
+        } else if(a[d] != b[d]) {
+            sum += 1.0;
+        }
+    }
+    return sum;
+}
+
+void bayesian_search::enumerate_candidates() {
+    double total = 1.0;
+    for(const search_dimension & dimension : space) {
+        total *= dimension.values.size();
+    }
+    std::set<search_point> unique;
+    search_point candidate(space.size(), 0);
+    if(total <= max_enumerated) {
+        for(size_t visited = 0; visited < total; ++visited) {
+            search_point normalized = candidate;
+            if(!filter || filter(normalized)) {
+                unique.insert(normalized);
+            }
+            for(size_t d = 0; d < space.size() && ++candidate[d] == static_cast<int>(space[d].values.size()); ++d) {
+                candidate[d] = 0;
+            }
+        }
+    } else {
+        for(size_t sample = 0; sample < sampled_candidates; ++sample) {
+            for(size_t d = 0; d < space.size(); ++d) {
+                candidate[d] = std::uniform_int_distribution<int>(0, space[d].values.size() - 1)(random);
+            }
+            if(!filter || filter(candidate)) {
+                unique.insert(candidate);
+            }
+        }
+    }
+    unique.insert(point);
+    candidates.assign(unique.begin(), unique.end());
+}
+
+// The start point, then points as far as possible from those chosen so far.
+void bayesian_search::design_initial(const search_point & start) {
+    initial_size = std::min(max_trials, std::max<size_t>(4, space.size() + 2));
+    std::vector<search_point> chosen{start};
+    while(chosen.size() < initial_size) {
+        double farthest = -1.0;
+        const search_point * next = nullptr;
+        // Random scan order breaks ties differently for different seeds.
+        const size_t offset = std::uniform_int_distribution<size_t>(0, candidates.size() - 1)(random);
+        for(size_t i = 0; i < candidates.size(); ++i) {
+            const search_point & candidate = candidates[(i + offset) % candidates.size()];
+            double nearest = std::numeric_limits<double>::infinity();
+            for(const search_point & other : chosen) {
+                nearest = std::min(nearest, distance2(candidate, other));
+            }
+            if(nearest > farthest) {
+                farthest = nearest;
+                next = &candidate;
+            }
+        }
+        if(next == nullptr || farthest <= 0.0) {
+            break;
+        }
+        chosen.push_back(*next);
+    }
+    initial.assign(chosen.begin() + 1, chosen.end());
+}
+
+const search_point & bayesian_search::current() const {
+    return point;
+}
+
+void bayesian_search::report(double value) {
+    if(done) {
+        return;
+    }
+    record(point, value);
+    advance();
+}
+
+void bayesian_search::observe(const search_point & measured_point, double value) {
+    if(done || measured.count(measured_point) != 0) {
+        return;
+    }
+    record(measured_point, value);
+    if(measured.count(point) != 0 || measured.size() >= max_trials) {
+        advance();
+    }
+}
+
+void bayesian_search::skip() {
+    if(done) {
+        return;
+    }
+    skipped.insert(point);
+    advance();
+}
+
+void bayesian_search::record(const search_point & measured_point, double value) {
+    const double y = std::log(std::max(value, std::numeric_limits<double>::min()));
+    if(measured.insert(measured_point).second) {
+        points.push_back(measured_point);
+        values.push_back(y);
+    }
+    if(y < best_value) {
+        best_value = y;
+        best_point = measured_point;
+    }
+}
+
+// Moves on to the next point that is neither measured nor skipped.
+void bayesian_search::advance() {
+    while(!initial.empty() && (measured.count(initial.front()) != 0 || skipped.count(initial.front()) != 0)) {
+        initial.pop_front();
+    }
+    if(measured.size() >= max_trials || measured.size() + skipped.size() >= candidates.size()) {
+        done = true;
+    } else if(!initial.empty()) {
+        point = initial.front();
+        initial.pop_front();
+    } else if(points.empty()) {
+        // Everything measured so far was skipped; take any other point.
+        done = true;
+        for(const search_point & candidate : candidates) {
+            if(skipped.count(candidate) == 0) {
+                point = candidate;
+                done = false;
+                break;
+            }
+        }
+    } else {
+        propose();
+    }
+    if(done) {
+        point = best_point;
+    }
+}
+
+void bayesian_search::propose() {
+    const size_t n = points.size();
+    double mean = 0.0;
+    for(double y : values) {
+        mean += y;
+    }
+    mean /= n;
+    double variance = 0.0;
+    for(double y : values) {
+        variance += (y - mean) * (y - mean);
+    }
+    const double scale = std::max(std::sqrt(variance / n), 1e-9);
+    std::vector<double> y(n);
+    for(size_t i = 0; i < n; ++i) {
+        y[i] = (values[i] - mean) / scale;
+    }
+
+    // Pick the length scale with the highest marginal likelihood.
+    static const double length_scales[] = {0.1, 0.2, 0.4, 0.8, 1.6};
+    std::vector<double> best_factor;
+    std::vector<double> best_alpha;
+    double best_scale = 0.0;
+    double best_likelihood = -std::numeric_limits<double>::infinity();
+    for(double length : length_scales) {
+        std::vector<double> k(n * n);
+        for(size_t i = 0; i < n; ++i) {
+            for(size_t j = 0; j < n; ++j) {
+                k[i * n + j] = std::exp(-distance2(points[i], points[j]) / (2.0 * length * length)) + (i == j ? noise : 0.0);
+            }
+        }
+        if(!cholesky(k, n)) {
+            continue;
+        }
+        std::vector<double> alpha = backward(k, n, forward(k, n, y));
+        double likelihood = 0.0;
+        for(size_t i = 0; i < n; ++i) {
+            likelihood -= 0.5 * y[i] * alpha[i] + std::log(k[i * n + i]);
+        }
+        if(likelihood > best_likelihood) {
+            best_likelihood = likelihood;
+            best_factor.swap(k);
+            best_alpha.swap(alpha);
+            best_scale = length;
+        }
+    }
+    if(best_factor.empty()) {
+        done = true;
+        return;
+    }
+
+    // Expected improvement over the best value, in standardized units.
+    const double incumbent = (best_value - mean) / scale;
+    double best_improvement = -1.0;
+    const search_point * next = nullptr;
+    std::vector<double> covariance(n);
+    for(const search_point & candidate : candidates) {
+        if(measured.count(candidate) != 0 || skipped.count(candidate) != 0) {
+            continue;
+        }
+        double mu = 0.0;
+        for(size_t i = 0; i < n; ++i) {
+            covariance[i] = std::exp(-distance2(candidate, points[i]) / (2.0 * best_scale * best_scale));
+            mu += covariance[i] * best_alpha[i];
+        }
+        const std::vector<double> v = forward(best_factor, n, covariance);
+        double sigma2 = 1.0 + noise;
+        for(double component : v) {
+            sigma2 -= component * component;
+        }
+        const double sigma = std::sqrt(std::max(sigma2, 1e-12));
+        const double gain = incumbent - mu;
+        const double z = gain / sigma;
+        const double improvement = gain * 0.5 * std::erfc(-z / std::sqrt(2.0))
+            + sigma * std::exp(-0.5 * z * z) / std::sqrt(2.0 * M_PI);
+        if(improvement > best_improvement) {
+            best_improvement = improvement;
+            next = &candidate;
+        }
+    }
+    // In log units, an expected improvement of e is a relative gain of
+    // about e.
+    if(next == nullptr || best_improvement * scale < min_improvement) {
+        done = true;
+        return;
+    }
+    point = *next;
+}
+
+bool bayesian_search::converged() const {
+    return done;
+}
+
+const search_point & bayesian_search::best() const {
+    return best_point;
+}
+
+size_t bayesian_search::trials() const {
+    return measured.size();
+}
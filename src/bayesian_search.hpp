@@ -0,0 +1,76 @@
+//  APEX OpenMP Policy
+//
+//  Copyright (c) 2015 University of Oregon
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <set>
+#include <deque>
+#include <random>
+
+#include "search.hpp"
+
+// Model-based search over a discrete space (APEX_OPENMP_STRATEGY=BAYESIAN).
+//
+// After a small space-filling initial design around the start point, a
+// Gaussian process is fit to the log of the measured values and the
+// admissible point with the highest expected improvement is measured next.
+// Numeric dimensions are encoded by their position in the value list and
+// the others as categories (distance 0 or 1). The length scale is chosen
+// by marginal likelihood each step; with at most a few dozen trials the
+// fit is a handful of tiny Cholesky factorizations.
+//
+// The search converges when the best expected improvement is below
+// min_improvement (relative), when max_trials points have been measured
+// or when every admissible point has been.
+class bayesian_search : public search_strategy {
+    private:
+        search_space space;
+        search_filter filter;
+        size_t max_trials;
+        double min_improvement;
+        std::mt19937 random;
+
+        std::vector<bool> numeric;
+        std::vector<search_point> candidates;
+        std::vector<search_point> points;
+        std::vector<double> values;     // log of the measured values
+        std::set<search_point> measured;
+        // Points left to other processes (see cooperative_search).
+        std::set<search_point> skipped;
+        std::deque<search_point> initial;
+        size_t initial_size;
+
+        search_point point;
+        search_point best_point;
+        double best_value;
+        bool done;
+
+        double distance2(const search_point & a, const search_point & b) const;
+        void enumerate_candidates();
+        void design_initial(const search_point & start);
+        void record(const search_point & measured_point, double value);
+        void advance();
+        void propose();
+
+    public:
+        // max_trials = 0 picks a budget from the number of dimensions.
+        bayesian_search(const search_space & space, const search_point & start,
+                const search_filter & filter = search_filter(), size_t max_trials = 0,
+                double min_improvement = 0.01, unsigned seed = 1);
+
+        const search_point & current() const;
+        void report(double value);
+        // Never proposes the current point again.
+        void skip();
+        bool converged() const;
+        const search_point & best() const;
+        // Adds a value measured elsewhere to the model; moves on if it was
+        // the current point.
+        void observe(const search_point & measured_point, double value);
+        // Number of points measured so far.
+        size_t trials() const;
+};
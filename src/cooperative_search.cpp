@@ -0,0 +1,89 @@
+//  APEX OpenMP Policy
+//
+//  Copyright (c) 2015 University of Oregon
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "cooperative_search.hpp"
+
+cooperative_search::cooperative_search(const search_space & space, const search_point & start, shared_region_slot * slot,
+        const search_filter & filter, size_t max_trials, unsigned seed, double claim_timeout)
+    : space(space), search(space, start, filter, max_trials, 0.01, seed), slot(slot),
+      claim_timeout_ns(static_cast<int64_t>(claim_timeout * 1e9)), final_point(start), measured_here(0), done(false) {
+    sync();
+}
+
+// Takes in what the other processes measured, then moves on until the
+// current point is one this process has claimed.
+void cooperative_search::sync() {
+    uint64_t key;
+    double value;
+    if(slot->converged_on(key, value)) {
+        final_point = shared_point(space, key);
+        done = true;
+        return;
+    }
+    slot->for_each_measured([this](uint64_t measured_key, double measured_value) {
+        if(observed.insert(measured_key).second) {
+            search.observe(shared_point(space, measured_key), measured_value);
+        }
+    });
+    while(!search.converged()) {
+        key = shared_point_key(space, search.current());
+        const shared_claim claim = slot->claim(key, claim_timeout_ns, value);
+        if(claim == shared_claim::CLAIMED) {
+            return;
+        } else if(claim == shared_claim::MEASURED) {
+            observed.insert(key);
+            search.observe(search.current(), value);
+        } else {
+            search.skip();
+        }
+    }
+    // Converged here: the result is the best point of the node, which may
+    // have been fixed by another process meanwhile.
+    slot->converge();
+    if(slot->converged_on(key, value)) {
+        final_point = shared_point(space, key);
+    } else {
+        final_point = search.best();
+    }
+    done = true;
+}
+
+const search_point & cooperative_search::current() const {
+    return done ? final_point : search.current();
+}
+
+void cooperative_search::report(double value) {
+    if(done) {
+        return;
+    }
+    const uint64_t key = shared_point_key(space, search.current());
+    slot->publish(key, value);
+    observed.insert(key);
+    ++measured_here;
+    search.report(value);
+    sync();
+}
+
+void cooperative_search::skip() {
+    if(done) {
+        return;
+    }
+    search.skip();
+    sync();
+}
+
+bool cooperative_search::converged() const {
+    return done;
+}
+
+const search_point & cooperative_search::best() const {
+    return done ? final_point : search.best();
+}
+
+size_t cooperative_search::trials() const {
+    return measured_here;
+}
@@ -0,0 +1,52 @@
+//  APEX OpenMP Policy
+//
+//  Copyright (c) 2015 University of Oregon
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <set>
+#include <cstdint>
+
+#include "search.hpp"
+#include "bayesian_search.hpp"
+#include "shared_table.hpp"
+
+// Model-based search shared by the processes of a node tuning the same
+// region (APEX_OPENMP_SHARED). Each process runs a bayesian_search, but
+// before measuring a point it claims it in the shared table: points
+// another process is measuring are skipped, so the processes split the
+// initial design and later proposals between them. Every result is
+// published, and those of the other processes are fed into the model at
+// each step, so the trial budget is spent once per node rather than once
+// per process. The first process to converge fixes the region's result
+// for all of them.
+class cooperative_search : public search_strategy {
+    private:
+        search_space space;
+        bayesian_search search;
+        shared_region_slot * slot;
+        int64_t claim_timeout_ns;
+        std::set<uint64_t> observed;
+        search_point final_point;
+        size_t measured_here;
+        bool done;
+
+        void sync();
+
+    public:
+        cooperative_search(const search_space & space, const search_point & start, shared_region_slot * slot,
+                const search_filter & filter = search_filter(), size_t max_trials = 0, unsigned seed = 1,
+                double claim_timeout = 60.0);
+
+        const search_point & current() const;
+        void report(double value);
+        // The claim on the skipped point is left to time out.
+        void skip();
+        bool converged() const;
+        const search_point & best() const;
+        // Number of points measured by this process.
+        size_t trials() const;
+};
@@ -0,0 +1,91 @@
+//  APEX OpenMP Policy
+//
+//  Copyright (c) 2015 University of Oregon
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include <fstream>
+#include <vector>
+#include <mutex>
+#include <cstring>
+#include <dirent.h>
+
+#include "energy_counter.hpp"
+
+namespace {
+
+struct energy_domain {
+    std::string path;
+    // Microjoules at which the counter wraps, or 0 if it does not.
+    double range;
+    double last;
+};
+
+std::vector<energy_domain> domains;
+double total = 0.0;
+std::mutex lock;
+
+bool read_counter(const std::string & path, double & value) {
+    std::ifstream counter(path);
+    return static_cast<bool>(counter >> value);
+}
+
+bool add_domain(const std::string & path, const std::string & range_path) {
+    energy_domain domain;
+    domain.path = path;
+    domain.range = 0.0;
+    if(!read_counter(path, domain.last)) {
+        return false;
+    }
+    if(!range_path.empty()) {
+        read_counter(range_path, domain.range);
+    }
+    domains.push_back(domain);
+    return true;
+}
+
+}
+
+bool energy_counter_init(const std::string & file) {
+    std::lock_guard<std::mutex> guard(lock);
+    domains.clear();
+    total = 0.0;
+    if(!file.empty()) {
+        return add_domain(file, std::string());
+    }
+    // Package domains are intel-rapl:N; their subdomains (core, uncore,
+    // dram) are intel-rapl:N:M and already counted in the package.
+    static const std::string powercap = "/sys/class/powercap/";
+    DIR * dir = opendir(powercap.c_str());
+    if(dir == nullptr) {
+        return false;
+    }
+    while(struct dirent * entry = readdir(dir)) {
+        const char * colon = strchr(entry->d_name, ':');
+        if(strncmp(entry->d_name, "intel-rapl:", 11) != 0 || strchr(colon + 1, ':') != nullptr) {
+            continue;
+        }
+        const std::string domain = powercap + entry->d_name;
+        add_domain(domain + "/energy_uj", domain + "/max_energy_range_uj");
+    }
+    closedir(dir);
+    return !domains.empty();
+}
+
+double energy_counter_read() {
+    std::lock_guard<std::mutex> guard(lock);
+    for(energy_domain & domain : domains) {
+        double value;
+        if(!read_counter(domain.path, value)) {
+            continue;
+        }
+        double delta = value - domain.last;
+        if(delta < 0.0) {
+            delta = domain.range > 0.0 ? delta + domain.range : 0.0;
+        }
+        total += delta;
+        domain.last = value;
+    }
+    return total * 1e-6;
+}
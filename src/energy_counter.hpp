@@ -0,0 +1,27 @@
+//  APEX OpenMP Policy
+//
+//  Copyright (c) 2015 University of Oregon
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <string>
+
+// Energy used by the node, for APEX_OPENMP_OBJECTIVE=ENERGY. By default it
+// is the sum of the package domains of the Linux powercap interface
+// (/sys/class/powercap/intel-rapl:N/energy_uj, also used for AMD
+// processors), whose wraparound is undone with max_energy_range_uj. If
+// file is not empty, it is read instead: a file holding a single
+// microjoule counter, which stands in for powercap in tests and where only
+// root may read the counters.
+//
+// The counters are node-wide and update about once a millisecond, so the
+// energy of a region is only meaningful for regions that take longer than
+// that and do not overlap with other regions being tuned.
+
+// Returns false if no counter can be read.
+bool energy_counter_init(const std::string & file);
+// Joules since energy_counter_init. Thread-safe.
+double energy_counter_read();
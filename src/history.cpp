@@ -0,0 +1,592 @@
+//  APEX OpenMP Policy
+//
+//  Copyright (c) 2015 University of Oregon
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+#include <limits>
+#include <iterator>
+#include <cerrno>
+#include <cstdio>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "history.hpp"
+
+uint64_t history_hash(const char * data, size_t length) {
+    // FNV-1a
+    uint64_t hash = UINT64_C(14695981039346656037);
+    for(size_t i = 0; i < length; ++i) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= UINT64_C(1099511628211);
+    }
+    return hash;
+}
+
+uint32_t history_encode_flags(const history_entry & entry) {
+    uint32_t flags = entry.converged ? history_flag_converged : 0;
+    if(entry.dynamic >= 0) {
+        flags |= history_flag_dynamic_set | (entry.dynamic ? history_flag_dynamic : 0);
+    }
+    if(entry.max_active_levels >= 0 && entry.max_active_levels < 255) {
+        flags |= static_cast<uint32_t>(entry.max_active_levels + 1) << history_flag_levels_shift;
+    }
+    flags |= static_cast<uint32_t>(history_objective_code(entry.objective)) << history_flag_objective_shift;
+    return flags;
+}
+
+void history_decode_flags(uint32_t flags, history_entry & entry) {
+    entry.converged = (flags & history_flag_converged) != 0;
+    entry.dynamic = (flags & history_flag_dynamic_set) ? ((flags & history_flag_dynamic) ? 1 : 0) : -1;
+    entry.max_active_levels = static_cast<int>((flags >> history_flag_levels_shift) & 0xff) - 1;
+    entry.objective = history_objective_name(static_cast<int32_t>((flags >> history_flag_objective_shift) & 0xff));
+}
+
+static const char * history_objectives[] = {"time", "core_seconds", "efficiency", "weighted", "energy"};
+
+int32_t history_objective_code(const std::string & objective) {
+    for(size_t i = 0; i < sizeof(history_objectives) / sizeof(history_objectives[0]); ++i) {
+        if(objective == history_objectives[i]) {
+            return static_cast<int32_t>(i + 1);
+        }
+    }
+    return 0;
+}
+
+std::string history_objective_name(int32_t code) {
+    if(code < 1 || code > static_cast<int32_t>(sizeof(history_objectives) / sizeof(history_objectives[0]))) {
+        return std::string();
+    }
+    return history_objectives[code - 1];
+}
+
+int32_t history_schedule_code(const std::string & schedule) {
+    static const std::string monotonic = "monotonic:";
+    static const std::string nonmonotonic = "nonmonotonic:";
+    if(schedule.compare(0, monotonic.size(), monotonic) == 0) {
+        const int32_t code = history_schedule_code(schedule.substr(monotonic.size()));
+        return code == 0 ? 0 : code | history_schedule_monotonic;
+    } else if(schedule.compare(0, nonmonotonic.size(), nonmonotonic) == 0) {
+        return history_schedule_code(schedule.substr(nonmonotonic.size()));
+    }
+    if(schedule == "static") {
+        return 1;
+    } else if(schedule == "dynamic") {
+        return 2;
+    } else if(schedule == "guided") {
+        return 3;
+    } else if(schedule == "auto") {
+        return 4;
+    }
+    return 0;
+}
+
+std::string history_schedule_name(int32_t code) {
+    if(code & history_schedule_monotonic) {
+        const std::string name = history_schedule_name(code & ~history_schedule_monotonic);
+        return name.empty() ? name : "monotonic:" + name;
+    }
+    switch(code) {
+        case 1: return "static";
+        case 2: return "dynamic";
+        case 3: return "guided";
+        case 4: return "auto";
+        default: return "";
+    }
+}
+
+static bool write_all(int fd, const char * data, size_t size) {
+    while(size > 0) {
+        const ssize_t written = write(fd, data, size);
+        if(written < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+static void Tokenize(const std::string& str,
+                      std::vector<std::string>& tokens,
+                      const std::string& delimiters = ",")
+{
+    // Empty fields are kept, so a column after an empty one stays in place.
+    std::string::size_type lastPos = 0;
+    std::string::size_type pos     = str.find_first_of(delimiters, lastPos);
+
+    while (std::string::npos != pos)
+    {
+        tokens.push_back(str.substr(lastPos, pos - lastPos));
+        lastPos = pos + 1;
+        pos = str.find_first_of(delimiters, lastPos);
+    }
+    tokens.push_back(str.substr(lastPos));
+}
+
+bool read_history_csv(const std::string & filename, std::vector<history_entry> & entries) {
+    std::ifstream results_file(filename, std::ifstream::in);
+    if(!results_file.good()) {
+        std::cerr << "Unable to open results file " << filename << std::endl;
+        return false;
+    }
+    std::string line;
+    std::getline(results_file, line); // ignore first line (header)
+    while(std::getline(results_file, line)) {
+        std::vector<std::string> parts;
+        Tokenize(line, parts);
+        if(parts.size() >= 5 && parts.size() <= 9) {
+            for(std::string & part : parts) {
+                // Remove quotes from strings
+                part.erase(std::remove(part.begin(), part.end(), '"'), part.end());
+            }
+            history_entry entry;
+            entry.name = parts[0];
+            entry.threads = atoi(parts[1].c_str());
+            entry.schedule = parts[2];
+            entry.chunk = atoi(parts[3].c_str());
+            entry.converged = (parts[4] == "CONVERGED");
+            entry.value = std::numeric_limits<double>::quiet_NaN();
+            if(parts.size() >= 6 && !parts[5].empty()) {
+                entry.value = atof(parts[5].c_str());
+            }
+            if(parts.size() >= 7 && !parts[6].empty()) {
+                entry.dynamic = (parts[6] == "true") ? 1 : (parts[6] == "false" ? 0 : -1);
+            }
+            if(parts.size() >= 8 && !parts[7].empty()) {
+                entry.max_active_levels = atoi(parts[7].c_str());
+            }
+            if(parts.size() >= 9) {
+                entry.objective = parts[8];
+            }
+            entries.push_back(entry);
+        }
+    }
+    return true;
+}
+
+static uint32_t byte_swap(uint32_t value) {
+    return (value >> 24) | ((value >> 8) & 0xff00) | ((value << 8) & 0xff0000) | (value << 24);
+}
+
+// Makes a rename in the directory of filename durable.
+static bool sync_parent_directory(const std::string & filename) {
+    const size_t slash = filename.rfind('/');
+    const std::string directory = slash == std::string::npos ? "." : (slash == 0 ? "/" : filename.substr(0, slash));
+    int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+    if(fd < 0) {
+        return false;
+    }
+    const bool ok = fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+}
+
+bool write_history_binary(const std::string & filename, const std::vector<history_entry> & input) {
+    // Later entries replace earlier ones with the same name.
+    std::vector<history_entry> unique;
+    std::unordered_map<std::string, size_t> index;
+    for(const history_entry & entry : input) {
+        auto search = index.find(entry.name);
+        if(search == index.end()) {
+            index.insert(std::make_pair(entry.name, unique.size()));
+            unique.push_back(entry);
+        } else {
+            unique[search->second] = entry;
+        }
+    }
+
+    uint32_t bucket_count = 16;
+    while(bucket_count < unique.size() * 2) {
+        bucket_count <<= 1;
+    }
+
+    std::vector<history_file_entry> records(unique.size());
+    std::vector<uint32_t> buckets(bucket_count, 0);
+    std::string strings;
+    for(size_t i = 0; i < unique.size(); ++i) {
+        const history_entry & entry = unique[i];
+        history_file_entry & record = records[i];
+        record.name_hash = history_hash(entry.name.data(), entry.name.size());
+        record.name_offset = static_cast<uint32_t>(strings.size());
+        record.name_length = static_cast<uint32_t>(entry.name.size());
+        record.threads = entry.threads;
+        record.schedule = history_schedule_code(entry.schedule);
+        record.chunk = entry.chunk;
+        record.flags = history_encode_flags(entry);
+        record.value = entry.value;
+        strings += entry.name;
+        for(uint32_t b = record.name_hash & (bucket_count - 1); ; b = (b + 1) & (bucket_count - 1)) {
+            if(buckets[b] == 0) {
+                buckets[b] = static_cast<uint32_t>(i + 1);
+                break;
+            }
+        }
+    }
+
+    history_file_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, history_magic, sizeof(header.magic));
+    header.version = history_version;
+    header.entry_count = static_cast<uint32_t>(records.size());
+    header.bucket_count = bucket_count;
+    header.entries_offset = sizeof(header);
+    header.buckets_offset = header.entries_offset + records.size() * sizeof(history_file_entry);
+    header.strings_offset = header.buckets_offset + buckets.size() * sizeof(uint32_t);
+    header.strings_size = strings.size();
+
+    std::string contents;
+    contents.append(reinterpret_cast<const char *>(&header), sizeof(header));
+    contents.append(reinterpret_cast<const char *>(records.data()), records.size() * sizeof(history_file_entry));
+    contents.append(reinterpret_cast<const char *>(buckets.data()), buckets.size() * sizeof(uint32_t));
+    contents.append(strings);
+
+    const std::string temp_filename = filename + ".tmp." + std::to_string(getpid());
+    int fd = ::open(temp_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0) {
+        std::cerr << "Unable to open history file " << temp_filename << " for writing" << std::endl;
+        return false;
+    }
+    bool ok = write_all(fd, contents.data(), contents.size()) && fsync(fd) == 0;
+    ok = (::close(fd) == 0) && ok;
+    if(ok && rename(temp_filename.c_str(), filename.c_str()) != 0) {
+        ok = false;
+    }
+    if(!ok) {
+        std::cerr << "Unable to write history file " << filename << std::endl;
+        unlink(temp_filename.c_str());
+        return false;
+    }
+    if(!sync_parent_directory(filename)) {
+        std::cerr << "Unable to sync the directory of history file " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool read_history(const std::string & filename, std::vector<history_entry> & entries) {
+    history_file history;
+    if(!history.open(filename)) {
+        return false;
+    }
+    history.for_each([&entries](const history_entry & entry) {
+        entries.push_back(entry);
+    });
+    return true;
+}
+
+static bool better_entry(const history_entry & candidate, const history_entry & incumbent) {
+    bool candidate_known = std::isfinite(candidate.value) && candidate.value > 0.0;
+    bool incumbent_known = std::isfinite(incumbent.value) && incumbent.value > 0.0;
+    if(candidate_known && incumbent_known && candidate.objective != incumbent.objective) {
+        // Values of different objectives cannot be compared.
+        candidate_known = incumbent_known = false;
+    }
+    if(candidate_known && incumbent_known) {
+        return candidate.value < incumbent.value;
+    }
+    if(candidate_known != incumbent_known) {
+        return candidate_known;
+    }
+    if(candidate.converged != incumbent.converged) {
+        return candidate.converged;
+    }
+    // Otherwise the newer entry wins.
+    return true;
+}
+
+std::vector<history_entry> merge_history(const std::vector<history_entry> & entries, history_merge mode) {
+    std::vector<history_entry> merged;
+    std::unordered_map<std::string, size_t> index;
+    for(const history_entry & entry : entries) {
+        auto search = index.find(entry.name);
+        if(search == index.end()) {
+            index.insert(std::make_pair(entry.name, merged.size()));
+            merged.push_back(entry);
+        } else if(mode == history_merge::LATEST || better_entry(entry, merged[search->second])) {
+            merged[search->second] = entry;
+        }
+    }
+    return merged;
+}
+
+static const uint32_t journal_magic = 0x4a504f41; // "AOPJ"
+
+history_journal::history_journal() : fd(-1) {
+}
+
+history_journal::~history_journal() {
+    close();
+}
+
+bool history_journal::open(const std::string & filename) {
+    close();
+    fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if(fd < 0) {
+        std::cerr << "Unable to open history journal " << filename << std::endl;
+        return false;
+    }
+    path = filename;
+    return true;
+}
+
+void history_journal::close() {
+    if(fd >= 0) {
+        ::close(fd);
+    }
+    fd = -1;
+}
+
+bool history_journal::is_open() const {
+    return fd >= 0;
+}
+
+const std::string & history_journal::filename() const {
+    return path;
+}
+
+bool history_journal::append(const history_entry & entry, bool sync) {
+    if(fd < 0) {
+        return false;
+    }
+    std::string payload;
+    const int32_t fields[3] = {entry.threads, history_schedule_code(entry.schedule), entry.chunk};
+    const uint32_t flags = history_encode_flags(entry);
+    payload.append(reinterpret_cast<const char *>(fields), sizeof(fields));
+    payload.append(reinterpret_cast<const char *>(&flags), sizeof(flags));
+    payload.append(reinterpret_cast<const char *>(&entry.value), sizeof(entry.value));
+    payload.append(entry.name);
+
+    const uint32_t header[2] = {journal_magic, static_cast<uint32_t>(payload.size())};
+    const uint64_t checksum = history_hash(payload.data(), payload.size());
+    std::string record;
+    record.append(reinterpret_cast<const char *>(header), sizeof(header));
+    record.append(reinterpret_cast<const char *>(&checksum), sizeof(checksum));
+    record.append(payload);
+    // Appends share the lock; compaction (possibly by another process
+    // using the same history path) holds it exclusively.
+    flock(fd, LOCK_SH);
+    bool ok = write_all(fd, record.data(), record.size());
+    if(ok && sync) {
+        ok = (fdatasync(fd) == 0);
+    }
+    flock(fd, LOCK_UN);
+    return ok;
+}
+
+bool history_journal::read(const std::string & filename, std::vector<history_entry> & entries) {
+    std::ifstream in(filename, std::ifstream::in | std::ifstream::binary);
+    if(!in.good()) {
+        return false;
+    }
+    const std::string contents((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    const size_t header_size = 2 * sizeof(uint32_t) + sizeof(uint64_t);
+    const size_t fixed_size = 3 * sizeof(int32_t) + sizeof(uint32_t) + sizeof(double);
+    size_t offset = 0;
+    while(offset + header_size <= contents.size()) {
+        uint32_t header[2];
+        uint64_t checksum;
+        memcpy(header, contents.data() + offset, sizeof(header));
+        memcpy(&checksum, contents.data() + offset + sizeof(header), sizeof(checksum));
+        const char * payload = contents.data() + offset + header_size;
+        if(header[0] != journal_magic || header[1] < fixed_size || offset + header_size + header[1] > contents.size()
+                || history_hash(payload, header[1]) != checksum) {
+            std::cerr << "Ignoring incomplete record at offset " << offset << " of history journal " << filename << std::endl;
+            break;
+        }
+        int32_t fields[3];
+        uint32_t flags;
+        history_entry entry;
+        memcpy(fields, payload, sizeof(fields));
+        memcpy(&flags, payload + sizeof(fields), sizeof(flags));
+        memcpy(&entry.value, payload + sizeof(fields) + sizeof(flags), sizeof(entry.value));
+        entry.name.assign(payload + fixed_size, header[1] - fixed_size);
+        entry.threads = fields[0];
+        entry.schedule = history_schedule_name(fields[1]);
+        entry.chunk = fields[2];
+        history_decode_flags(flags, entry);
+        entries.push_back(entry);
+        offset += header_size + header[1];
+    }
+    return true;
+}
+
+bool compact_history(const std::string & history_path, const std::string & journal_path, history_merge mode) {
+    int lock_fd = ::open(journal_path.c_str(), O_RDWR | O_CREAT, 0644);
+    if(lock_fd < 0) {
+        std::cerr << "Unable to open history journal " << journal_path << std::endl;
+        return false;
+    }
+    flock(lock_fd, LOCK_EX);
+    std::vector<history_entry> entries;
+    struct stat st;
+    bool ok = true;
+    if(stat(history_path.c_str(), &st) == 0 && st.st_size > 0) {
+        ok = read_history(history_path, entries);
+    }
+    if(ok) {
+        history_journal::read(journal_path, entries);
+        ok = write_history_binary(history_path, merge_history(entries, mode));
+    }
+    // Only drop the journal once the merged history is in place.
+    if(ok && ftruncate(lock_fd, 0) != 0) {
+        std::cerr << "Unable to truncate history journal " << journal_path << std::endl;
+    }
+    flock(lock_fd, LOCK_UN);
+    ::close(lock_fd);
+    return ok;
+}
+
+history_file::history_file() : mapping(nullptr), mapping_size(0), header(nullptr),
+    entries(nullptr), buckets(nullptr), strings(nullptr) {
+}
+
+history_file::~history_file() {
+    close();
+}
+
+void history_file::close() {
+    if(mapping != nullptr) {
+        munmap(mapping, mapping_size);
+    }
+    mapping = nullptr;
+    mapping_size = 0;
+    header = nullptr;
+    entries = nullptr;
+    buckets = nullptr;
+    strings = nullptr;
+    parsed.clear();
+}
+
+bool history_file::map_binary(int fd, size_t size, const std::string & filename) {
+    void * data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(data == MAP_FAILED) {
+        std::cerr << "Unable to map history file " << filename << std::endl;
+        return false;
+    }
+    const history_file_header * h = static_cast<const history_file_header *>(data);
+    const uint64_t entries_end = h->entries_offset + static_cast<uint64_t>(h->entry_count) * sizeof(history_file_entry);
+    const uint64_t buckets_end = h->buckets_offset + static_cast<uint64_t>(h->bucket_count) * sizeof(uint32_t);
+    if(h->version == byte_swap(history_version)) {
+        std::cerr << "History file " << filename << " was written on a machine of the other byte order" << std::endl;
+    } else if(h->version != history_version) {
+        std::cerr << "History file " << filename << " has unsupported version " << h->version << std::endl;
+    } else if(h->bucket_count == 0 || (h->bucket_count & (h->bucket_count - 1)) != 0
+            || entries_end > size || buckets_end > size || h->strings_offset + h->strings_size > size) {
+        std::cerr << "History file " << filename << " is corrupt" << std::endl;
+    } else {
+        mapping = data;
+        mapping_size = size;
+        header = h;
+        const char * base = static_cast<const char *>(data);
+        entries = reinterpret_cast<const history_file_entry *>(base + h->entries_offset);
+        buckets = reinterpret_cast<const uint32_t *>(base + h->buckets_offset);
+        strings = base + h->strings_offset;
+        return true;
+    }
+    munmap(data, size);
+    return false;
+}
+
+bool history_file::open(const std::string & filename) {
+    close();
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if(fd < 0) {
+        std::cerr << "Unable to open results file " << filename << std::endl;
+        return false;
+    }
+    struct stat st;
+    char magic[sizeof(history_magic)];
+    bool binary = false;
+    if(fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(history_file_header)
+            && pread(fd, magic, sizeof(magic), 0) == sizeof(magic)) {
+        binary = (memcmp(magic, history_magic, sizeof(magic)) == 0);
+    }
+    if(binary) {
+        const bool mapped = map_binary(fd, st.st_size, filename);
+        ::close(fd);
+        return mapped;
+    }
+    ::close(fd);
+    std::vector<history_entry> csv_entries;
+    if(!read_history_csv(filename, csv_entries)) {
+        return false;
+    }
+    for(const history_entry & entry : csv_entries) {
+        parsed[entry.name] = entry;
+    }
+    return true;
+}
+
+bool history_file::lookup(const std::string & name, history_entry & entry) const {
+    if(header == nullptr) {
+        auto search = parsed.find(name);
+        if(search == parsed.end()) {
+            return false;
+        }
+        entry = search->second;
+        return true;
+    }
+    const uint64_t hash = history_hash(name.data(), name.size());
+    const uint32_t mask = header->bucket_count - 1;
+    for(uint32_t b = hash & mask, probes = 0; probes < header->bucket_count; b = (b + 1) & mask, ++probes) {
+        const uint32_t slot = buckets[b];
+        if(slot == 0 || slot > header->entry_count) {
+            return false;
+        }
+        const history_file_entry & record = entries[slot - 1];
+        if(record.name_hash == hash && record.name_length == name.size()
+                && record.name_offset + static_cast<uint64_t>(record.name_length) <= header->strings_size
+                && memcmp(strings + record.name_offset, name.data(), name.size()) == 0) {
+            entry.name = name;
+            entry.threads = record.threads;
+            entry.schedule = history_schedule_name(record.schedule);
+            entry.chunk = record.chunk;
+            history_decode_flags(record.flags, entry);
+            entry.value = record.value;
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t history_file::size() const {
+    return header == nullptr ? parsed.size() : header->entry_count;
+}
+
+void history_file::for_each(const std::function<void(const history_entry &)> & visit) const {
+    if(header == nullptr) {
+        for(const auto & item : parsed) {
+            visit(item.second);
+        }
+        return;
+    }
+    for(uint32_t i = 0; i < header->entry_count; ++i) {
+        const history_file_entry & record = entries[i];
+        if(record.name_offset + static_cast<uint64_t>(record.name_length) > header->strings_size) {
+            continue;
+        }
+        history_entry entry;
+        entry.name.assign(strings + record.name_offset, record.name_length);
+        entry.threads = record.threads;
+        entry.schedule = history_schedule_name(record.schedule);
+        entry.chunk = record.chunk;
+        history_decode_flags(record.flags, entry);
+        entry.value = record.value;
+        visit(entry);
+    }
+}
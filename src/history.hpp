@@ -0,0 +1,187 @@
+//  APEX OpenMP Policy
+//
+//  Copyright (c) 2015 University of Oregon
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+
+// One region's tuned configuration as stored in a history file.
+struct history_entry {
+    std::string name;
+    int threads;
+    std::string schedule;
+    int chunk;
+    bool converged;
+    // Best time per call seen for this config, or NaN if unknown.
+    double value;
+    // omp_set_dynamic / omp_set_max_active_levels values, -1 if not tuned.
+    int dynamic = -1;
+    int max_active_levels = -1;
+    // Objective the value was measured with (see APEX_OPENMP_OBJECTIVE), or
+    // empty if unknown; entries written before objectives were selectable
+    // have time values.
+    std::string objective;
+};
+
+// Binary history format, version 1. Integers and doubles are stored in the
+// byte order of the machine that wrote the file, so it can be mapped
+// as is; a file from a machine of the other byte order is recognized by its
+// byte-swapped version and rejected. The same holds for the journal.
+//
+//   header
+//   entries[entry_count]
+//   buckets[bucket_count]   uint32 entry index + 1, 0 for an empty bucket;
+//                           open addressing with linear probing on name_hash
+//   strings[strings_size]   region names, not NUL-terminated
+//
+// The file is mapped read-only and entries are looked up on first use, so
+// opening a history with thousands of regions costs one mmap.
+static const char history_magic[8] = {'A', 'P', 'X', 'O', 'M', 'P', 'H', '\0'};
+static const uint32_t history_version = 1;
+
+struct history_file_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t entry_count;
+    uint32_t bucket_count;
+    uint32_t reserved;
+    uint64_t entries_offset;
+    uint64_t buckets_offset;
+    uint64_t strings_offset;
+    uint64_t strings_size;
+};
+
+struct history_file_entry {
+    uint64_t name_hash;
+    uint32_t name_offset;
+    uint32_t name_length;
+    int32_t threads;
+    int32_t schedule;
+    int32_t chunk;
+    uint32_t flags;
+    double value;
+};
+
+// Flag bits. The dynamic and max_active_levels settings and the objective
+// are kept in the flags so files without them stay valid: bits 8-15 hold
+// the levels + 1, or 0 if they were not tuned, and bits 16-23 the
+// objective code, or 0 if unknown.
+static const uint32_t history_flag_converged = 1;
+static const uint32_t history_flag_dynamic_set = 2;
+static const uint32_t history_flag_dynamic = 4;
+static const int history_flag_levels_shift = 8;
+static const int history_flag_objective_shift = 16;
+
+uint32_t history_encode_flags(const history_entry & entry);
+void history_decode_flags(uint32_t flags, history_entry & entry);
+
+uint64_t history_hash(const char * data, size_t length);
+
+// Schedule names are stored with the omp_sched_t numbering, plus
+// history_schedule_monotonic for a "monotonic:" modifier.
+static const int32_t history_schedule_monotonic = 0x100;
+int32_t history_schedule_code(const std::string & schedule);
+std::string history_schedule_name(int32_t code);
+
+// Objective names are stored as their index in history_objectives + 1.
+int32_t history_objective_code(const std::string & objective);
+std::string history_objective_name(int32_t code);
+
+// Reads the CSV written by print_summary(), with or without the trailing
+// value, dynamic, max_active_levels and objective columns. Returns false if
+// the file cannot be opened.
+bool read_history_csv(const std::string & filename, std::vector<history_entry> & entries);
+
+// Writes entries in the binary format. Later entries with the same name
+// replace earlier ones. The file is written under a temporary name, synced
+// and renamed over filename, so readers see either the old or the new file.
+// The directory is synced too, so the rename is on disk once this returns
+// true.
+bool write_history_binary(const std::string & filename, const std::vector<history_entry> & entries);
+
+// Reads every entry of a history file of either format.
+bool read_history(const std::string & filename, std::vector<history_entry> & entries);
+
+// How entries for the same region from several runs are combined.
+enum class history_merge {
+    LATEST, // the most recent entry wins
+    BEST    // the entry with the lowest known value wins; a converged entry
+            // beats an unconverged one when values are unknown or were
+            // measured with different objectives
+};
+
+// Returns entries with one entry per region, in first-seen order.
+std::vector<history_entry> merge_history(const std::vector<history_entry> & entries, history_merge mode);
+
+// Append-only journal of history entries written during a run, so tuning
+// results survive walltime limits and crashes. Each record is
+//
+//   uint32 magic, uint32 payload length, uint64 FNV-1a of the payload,
+//   payload: int32 threads, int32 schedule, int32 chunk, uint32 flags,
+//            double value, name bytes
+//
+// and is written with a single write() on an O_APPEND descriptor. Reading
+// stops at the first incomplete or corrupt record (a torn tail).
+class history_journal {
+    private:
+        int fd;
+        std::string path;
+
+    public:
+        history_journal();
+        ~history_journal();
+        history_journal(const history_journal &) = delete;
+        history_journal & operator=(const history_journal &) = delete;
+
+        bool open(const std::string & filename);
+        void close();
+        bool is_open() const;
+        // With sync, the record is on disk when append() returns.
+        bool append(const history_entry & entry, bool sync);
+        const std::string & filename() const;
+
+        static bool read(const std::string & filename, std::vector<history_entry> & entries);
+};
+
+// Merges the history at history_path (if any) with the journal at
+// journal_path, writes the result to history_path with an atomic rename and
+// then truncates the journal. Running it again after a crash at any point
+// gives the same history.
+bool compact_history(const std::string & history_path, const std::string & journal_path, history_merge mode);
+
+// A history file opened for lookups: binary files are memory-mapped, CSV
+// files are parsed into an in-memory index.
+class history_file {
+    private:
+        void * mapping;
+        size_t mapping_size;
+        const history_file_header * header;
+        const history_file_entry * entries;
+        const uint32_t * buckets;
+        const char * strings;
+        std::unordered_map<std::string, history_entry> parsed;
+
+        bool map_binary(int fd, size_t size, const std::string & filename);
+
+    public:
+        history_file();
+        ~history_file();
+        history_file(const history_file &) = delete;
+        history_file & operator=(const history_file &) = delete;
+
+        bool open(const std::string & filename);
+        void close();
+        bool lookup(const std::string & name, history_entry & entry) const;
+        size_t size() const;
+        // Visits every entry (in file order for binary files).
+        void for_each(const std::function<void(const history_entry &)> & visit) const;
+};
@@ -0,0 +1,63 @@
+//  Copyright (c) 2015 University of Oregon
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Converts a history CSV written by the APEX OpenMP policy (results-*.csv)
+// to the indexed binary history format, or prints a history file of either
+// format as CSV.
+//
+#include <stdlib.h>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "history.hpp"
+
+int main (int argc, char *argv[]) {
+    if (argc == 3 && std::string(argv[1]) == "--dump") {
+        history_file history;
+        if(!history.open(argv[2])) {
+            return 1;
+        }
+        std::cout << "\"name\",\"num_threads\",\"schedule\",\"chunk_size\",\"converged\",\"value\",\"dynamic\",\"max_active_levels\",\"objective\"" << std::endl;
+        history.for_each([](const history_entry & entry) {
+            std::cout << "\"" << entry.name << "\"," << entry.threads << ",\"" << entry.schedule << "\","
+                << entry.chunk << ",\"" << (entry.converged ? "CONVERGED" : "NOT CONVERGED") << "\","
+                << (std::isfinite(entry.value) ? entry.value : 0.0) << ","
+                << (entry.dynamic < 0 ? "" : (entry.dynamic ? "true" : "false")) << ","
+                << (entry.max_active_levels < 0 ? std::string() : std::to_string(entry.max_active_levels)) << ",\""
+                << entry.objective << "\"" << std::endl;
+        });
+        return 0;
+    }
+    if (argc != 3) {
+        std::cout << "Usage: " << argv[0] << " <results.csv> <history.bin>" << std::endl;
+        std::cout << "       " << argv[0] << " --dump <history file>" << std::endl;
+        exit(0);
+    }
+
+    std::vector<history_entry> entries;
+    if(!read_history_csv(argv[1], entries)) {
+        return 1;
+    }
+    if(!write_history_binary(argv[2], entries)) {
+        return 1;
+    }
+
+    // Check the result can be read back.
+    history_file history;
+    if(!history.open(argv[2])) {
+        return 1;
+    }
+    for(const history_entry & entry : entries) {
+        history_entry found;
+        if(!history.lookup(entry.name, found)) {
+            std::cerr << "Converted history is missing " << entry.name << std::endl;
+            return 1;
+        }
+    }
+    std::cerr << "Converted " << entries.size() << " entries (" << history.size() << " regions) to " << argv[2] << std::endl;
+    return 0;
+}
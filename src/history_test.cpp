@@ -0,0 +1,142 @@
+//  Copyright (c) 2015 University of Oregon
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Round trip of the binary history format: entries written with
+// write_history_binary are found again by a mapped history_file, and files
+// that are truncated or from a machine of the other byte order are rejected.
+//
+//   history_test [scratch directory]
+//
+#undef NDEBUG
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include "history.hpp"
+
+static history_entry make_entry(const std::string & name, int threads, const std::string & schedule, int chunk) {
+    history_entry entry;
+    entry.name = name;
+    entry.threads = threads;
+    entry.schedule = schedule;
+    entry.chunk = chunk;
+    entry.converged = true;
+    entry.value = 0.25;
+    return entry;
+}
+
+static void check_same(const history_entry & expected, const history_entry & actual) {
+    assert(actual.name == expected.name);
+    assert(actual.threads == expected.threads);
+    assert(actual.schedule == expected.schedule);
+    assert(actual.chunk == expected.chunk);
+    assert(actual.converged == expected.converged);
+    assert(std::isnan(expected.value) ? std::isnan(actual.value) : actual.value == expected.value);
+    assert(actual.dynamic == expected.dynamic);
+    assert(actual.max_active_levels == expected.max_active_levels);
+    assert(actual.objective == expected.objective);
+}
+
+static std::string read_file(const std::string & filename) {
+    std::ifstream in(filename, std::ifstream::in | std::ifstream::binary);
+    return std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+}
+
+static void write_file(const std::string & filename, const std::string & contents) {
+    std::ofstream out(filename, std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+    out.write(contents.data(), contents.size());
+}
+
+int main (int argc, char *argv[]) {
+    const std::string directory = argc > 1 ? argv[1] : "/tmp";
+    const std::string path = directory + "/history_test." + std::to_string(getpid());
+
+    std::vector<history_entry> entries;
+    entries.push_back(make_entry("OpenMP_PARALLEL_REGION: a.cpp:1", 4, "static", 0));
+    entries.push_back(make_entry("OpenMP_PARALLEL_REGION: a.cpp:2", 8, "monotonic:dynamic", 64));
+    entries.back().dynamic = 1;
+    entries.back().max_active_levels = 2;
+    entries.back().objective = "core_seconds";
+    entries.push_back(make_entry("OpenMP_PARALLEL_REGION: b.cpp:7", 2, "guided", 8));
+    entries.back().converged = false;
+    entries.back().value = std::numeric_limits<double>::quiet_NaN();
+    entries.back().dynamic = 0;
+    entries.back().objective = "energy";
+    // Enough regions to need more than the minimum bucket count.
+    for(int i = 0; i < 100; ++i) {
+        entries.push_back(make_entry("region " + std::to_string(i), 1 + i % 8, "dynamic", i));
+    }
+    // A later entry replaces an earlier one with the same name.
+    std::vector<history_entry> input = entries;
+    input.insert(input.begin(), make_entry("OpenMP_PARALLEL_REGION: a.cpp:1", 16, "guided", 1));
+
+    assert(write_history_binary(path, input));
+    {
+        history_file history;
+        assert(history.open(path));
+        assert(history.size() == entries.size());
+        for(const history_entry & expected : entries) {
+            history_entry actual;
+            assert(history.lookup(expected.name, actual));
+            check_same(expected, actual);
+        }
+        history_entry missing;
+        assert(!history.lookup("OpenMP_PARALLEL_REGION: c.cpp:1", missing));
+        size_t visited = 0;
+        history.for_each([&](const history_entry & entry) {
+            check_same(entries[visited], entry);
+            ++visited;
+        });
+        assert(visited == entries.size());
+    }
+
+    std::vector<history_entry> read_back;
+    assert(read_history(path, read_back));
+    assert(read_back.size() == entries.size());
+
+    const std::string contents = read_file(path);
+    const std::string broken = path + ".broken";
+    // A file cut short is rejected rather than read past its end.
+    write_file(broken, contents.substr(0, contents.size() - 16));
+    {
+        history_file history;
+        assert(!history.open(broken));
+    }
+    // So is a file whose integers are in the other byte order.
+    std::string swapped = contents;
+    std::swap(swapped[8], swapped[11]);
+    std::swap(swapped[9], swapped[10]);
+    write_file(broken, swapped);
+    {
+        history_file history;
+        assert(!history.open(broken));
+    }
+
+    // The CSV written by print_summary, including empty columns between
+    // set ones and files from before the later columns existed.
+    write_file(broken, "\"name\",\"num_threads\",\"schedule\",\"chunk_size\",\"converged\",\"value\",\"dynamic\",\"max_active_levels\",\"objective\"\n"
+            "\"x\",2,\"static\",4,\"CONVERGED\",0.5,,3,\"time\"\n"
+            "\"y\",1,\"dynamic\",8,\"NOT CONVERGED\"\n"
+            "\"z\",4,\"guided\",2,\"CONVERGED\",,,,\"time\"\n");
+    std::vector<history_entry> csv;
+    assert(read_history_csv(broken, csv));
+    assert(csv.size() == 3);
+    assert(csv[0].dynamic == -1 && csv[0].max_active_levels == 3 && csv[0].objective == "time" && csv[0].value == 0.5);
+    assert(!csv[1].converged && std::isnan(csv[1].value) && csv[1].objective.empty());
+    // A group member's row has no value of its own.
+    assert(csv[2].converged && std::isnan(csv[2].value) && csv[2].dynamic == -1 && csv[2].objective == "time");
+
+    unlink(broken.c_str());
+    unlink(path.c_str());
+    std::cerr << "Test passed." << std::endl;
+    return 0;
+}
@@ -0,0 +1,134 @@
+//  Copyright (c) 2015 University of Oregon
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// The history journal: records appended by history_journal are read back in
+// order, reading stops at a torn or corrupt tail, and compact_history merges
+// the journal into the history, empties it, and gives the same history when
+// run again.
+//
+//   journal_test [scratch directory]
+//
+#undef NDEBUG
+#include <cassert>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "history.hpp"
+
+static history_entry make_entry(const std::string & name, int threads, int chunk, double value) {
+    history_entry entry;
+    entry.name = name;
+    entry.threads = threads;
+    entry.schedule = "dynamic";
+    entry.chunk = chunk;
+    entry.converged = true;
+    entry.value = value;
+    return entry;
+}
+
+static std::string read_file(const std::string & filename) {
+    std::ifstream in(filename, std::ifstream::in | std::ifstream::binary);
+    return std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+}
+
+static void write_file(const std::string & filename, const std::string & contents) {
+    std::ofstream out(filename, std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+    out.write(contents.data(), contents.size());
+}
+
+static off_t file_size(const std::string & filename) {
+    struct stat st;
+    return stat(filename.c_str(), &st) == 0 ? st.st_size : -1;
+}
+
+int main (int argc, char *argv[]) {
+    const std::string directory = argc > 1 ? argv[1] : "/tmp";
+    const std::string history_path = directory + "/journal_test." + std::to_string(getpid());
+    const std::string journal_path = history_path + ".journal";
+    unlink(history_path.c_str());
+    unlink(journal_path.c_str());
+
+    std::vector<history_entry> written;
+    {
+        history_journal journal;
+        assert(journal.open(journal_path));
+        for(int i = 0; i < 10; ++i) {
+            written.push_back(make_entry("region " + std::to_string(i % 4), 1 + i, 8 * i, 1.0 + i));
+            written.back().max_active_levels = i % 3;
+            assert(journal.append(written.back(), i % 2 == 0));
+        }
+    }
+    std::vector<history_entry> entries;
+    assert(history_journal::read(journal_path, entries));
+    assert(entries.size() == written.size());
+    for(size_t i = 0; i < entries.size(); ++i) {
+        assert(entries[i].name == written[i].name);
+        assert(entries[i].threads == written[i].threads);
+        assert(entries[i].schedule == written[i].schedule);
+        assert(entries[i].chunk == written[i].chunk);
+        assert(entries[i].value == written[i].value);
+        assert(entries[i].max_active_levels == written[i].max_active_levels);
+    }
+
+    // A record cut short by a crash ends the journal; what precedes it is kept.
+    const std::string contents = read_file(journal_path);
+    write_file(journal_path, contents + contents.substr(0, 20));
+    entries.clear();
+    assert(history_journal::read(journal_path, entries));
+    assert(entries.size() == written.size());
+    // A flipped byte in the last record fails its checksum.
+    std::string corrupt = contents;
+    corrupt[corrupt.size() - 1] ^= 0x40;
+    write_file(journal_path, corrupt);
+    entries.clear();
+    assert(history_journal::read(journal_path, entries));
+    assert(entries.size() == written.size() - 1);
+
+    // Compaction keeps the latest entry per region and empties the journal.
+    write_file(journal_path, contents);
+    assert(compact_history(history_path, journal_path, history_merge::LATEST));
+    assert(file_size(journal_path) == 0);
+    std::vector<history_entry> history;
+    assert(read_history(history_path, history));
+    assert(history.size() == 4);
+    for(const history_entry & entry : history) {
+        const history_entry * latest = nullptr;
+        for(const history_entry & candidate : written) {
+            if(candidate.name == entry.name) {
+                latest = &candidate;
+            }
+        }
+        assert(latest != nullptr && entry.threads == latest->threads && entry.chunk == latest->chunk);
+    }
+    // A crash between the rename and the truncate leaves the journal in
+    // place; compacting again gives the same history.
+    const std::string compacted = read_file(history_path);
+    write_file(journal_path, contents);
+    assert(compact_history(history_path, journal_path, history_merge::LATEST));
+    assert(read_file(history_path) == compacted);
+    // With BEST, a slower later entry does not replace a faster one.
+    {
+        history_journal journal;
+        assert(journal.open(journal_path));
+        assert(journal.append(make_entry("region 0", 64, 1, 100.0), true));
+    }
+    assert(compact_history(history_path, journal_path, history_merge::BEST));
+    history_file merged;
+    assert(merged.open(history_path));
+    history_entry region0;
+    assert(merged.lookup("region 0", region0));
+    assert(region0.threads != 64);
+
+    unlink(history_path.c_str());
+    unlink(journal_path.c_str());
+    std::cerr << "Test passed." << std::endl;
+    return 0;
+}
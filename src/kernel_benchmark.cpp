@@ -0,0 +1,385 @@
+//  Copyright (c) 2015 University of Oregon
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Tunes real OpenMP kernels with each search strategy. For every kernel
+// the reference optimum is first found by an exhaustive sweep of the
+// tuning space; then each strategy tunes the kernel from scratch and the
+// benchmark reports the invocations it needed to converge, how far its
+// result is from the optimum, and the runtime it saves over a production
+// run at the OpenMP defaults, tuning cost included. Trials are measured
+// like the policy does, with a sample_evaluator. Run it without the
+// policy plugin loaded:
+//
+//   kernel_benchmark [problem scale] [production invocations]
+//
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <list>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "apex_api.hpp"
+#include "apex_policies.hpp"
+
+#include "sample_evaluator.hpp"
+#include "search.hpp"
+#include "neighborhood_search.hpp"
+#include "bayesian_search.hpp"
+#include "topology.hpp"
+
+struct kernel {
+    std::string name;
+    std::function<void()> run;
+};
+
+// Keeps results alive so the kernels are not optimized away.
+static double kernel_sink = 0.0;
+
+// Every loop uses schedule(runtime), so the ICVs set by apply() take effect.
+static std::vector<kernel> make_kernels(double scale) {
+    std::vector<kernel> kernels;
+    std::mt19937 random(42);
+
+    // STREAM triad: memory bound, saturates well below all cores.
+    {
+        const long n = static_cast<long>(scale * (1 << 22));
+        auto a = std::make_shared<std::vector<double>>(n, 0.0);
+        auto b = std::make_shared<std::vector<double>>(n, 1.0);
+        auto c = std::make_shared<std::vector<double>>(n, 2.0);
+        kernels.push_back(kernel{"triad", [n, a, b, c]() {
+            double * pa = a->data();
+            const double * pb = b->data();
+            const double * pc = c->data();
+            #pragma omp parallel for schedule(runtime)
+            for(long i = 0; i < n; ++i) {
+                pa[i] = pb[i] + 3.0 * pc[i];
+            }
+            kernel_sink += pa[n / 2];
+        }});
+    }
+
+    // Triangular: iteration i does i units of work.
+    {
+        const long n = static_cast<long>(scale * 4000);
+        auto x = std::make_shared<std::vector<double>>(n, 0.5);
+        auto y = std::make_shared<std::vector<double>>(n, 0.0);
+        kernels.push_back(kernel{"triangular", [n, x, y]() {
+            const double * px = x->data();
+            double * py = y->data();
+            #pragma omp parallel for schedule(runtime)
+            for(long i = 0; i < n; ++i) {
+                double sum = 0.0;
+                for(long j = 0; j <= i; ++j) {
+                    sum += px[j] * px[i - j];
+                }
+                py[i] = sum;
+            }
+            kernel_sink += py[n - 1];
+        }});
+    }
+
+    // Irregular: heavy-tailed per-iteration cost in random order.
+    {
+        const long n = static_cast<long>(scale * 100000);
+        auto cost = std::make_shared<std::vector<int>>(n);
+        std::lognormal_distribution<double> distribution(3.0, 1.2);
+        for(int & c : *cost) {
+            c = std::min(20000, static_cast<int>(distribution(random)));
+        }
+        auto out = std::make_shared<std::vector<double>>(n, 0.0);
+        kernels.push_back(kernel{"irregular", [n, cost, out]() {
+            const int * pc = cost->data();
+            double * po = out->data();
+            #pragma omp parallel for schedule(runtime)
+            for(long i = 0; i < n; ++i) {
+                double v = 1.0 + i;
+                for(int k = 0; k < pc[i]; ++k) {
+                    v = v * 0.999 + 0.5;
+                }
+                po[i] = v;
+            }
+            kernel_sink += po[n / 3];
+        }});
+    }
+
+    // SpMV on a CSR matrix with power-law row lengths.
+    {
+        const long rows = static_cast<long>(scale * 200000);
+        auto offsets = std::make_shared<std::vector<long>>(rows + 1, 0);
+        auto columns = std::make_shared<std::vector<int>>();
+        auto values = std::make_shared<std::vector<double>>();
+        std::uniform_real_distribution<double> uniform(0.0, 1.0);
+        std::uniform_int_distribution<int> column(0, static_cast<int>(rows) - 1);
+        for(long r = 0; r < rows; ++r) {
+            const int length = std::min(2000, static_cast<int>(2.0 / std::pow(1.0 - uniform(random), 0.8)));
+            for(int k = 0; k < length; ++k) {
+                columns->push_back(column(random));
+                values->push_back(uniform(random));
+            }
+            (*offsets)[r + 1] = columns->size();
+        }
+        auto x = std::make_shared<std::vector<double>>(rows, 1.0);
+        auto y = std::make_shared<std::vector<double>>(rows, 0.0);
+        kernels.push_back(kernel{"spmv", [rows, offsets, columns, values, x, y]() {
+            const long * po = offsets->data();
+            const int * pc = columns->data();
+            const double * pv = values->data();
+            const double * px = x->data();
+            double * py = y->data();
+            #pragma omp parallel for schedule(runtime)
+            for(long r = 0; r < rows; ++r) {
+                double sum = 0.0;
+                for(long k = po[r]; k < po[r + 1]; ++k) {
+                    sum += pv[k] * px[pc[k]];
+                }
+                py[r] = sum;
+            }
+            kernel_sink += py[rows / 2];
+        }});
+    }
+
+    // Reduction: compute bound, uniform.
+    {
+        const long n = static_cast<long>(scale * (1 << 22));
+        auto x = std::make_shared<std::vector<double>>(n);
+        for(long i = 0; i < n; ++i) {
+            (*x)[i] = 1.0 + i % 1000;
+        }
+        kernels.push_back(kernel{"reduction", [n, x]() {
+            const double * px = x->data();
+            double sum = 0.0;
+            #pragma omp parallel for schedule(runtime) reduction(+:sum)
+            for(long i = 0; i < n; ++i) {
+                sum += std::sqrt(px[i]);
+            }
+            kernel_sink += sum;
+        }});
+    }
+
+    // Small trip count: fewer iterations than most team sizes, so the fork
+    // and barrier cost of a large team dominates.
+    {
+        const long n = 48;
+        auto out = std::make_shared<std::vector<double>>(n, 0.0);
+        kernels.push_back(kernel{"small", [n, out]() {
+            double * po = out->data();
+            #pragma omp parallel for schedule(runtime)
+            for(long i = 0; i < n; ++i) {
+                double v = 1.0 + i;
+                for(int k = 0; k < 2000; ++k) {
+                    v = v * 0.999 + 0.5;
+                }
+                po[i] = v;
+            }
+            kernel_sink += po[n - 1];
+        }});
+    }
+    return kernels;
+}
+
+static search_space make_space() {
+    search_space space(3);
+    space[0].name = "omp_num_threads";
+    for(const std::string & threads : topology_thread_space(read_topology())) {
+        space[0].values.push_back(threads);
+    }
+    space[1].name = "omp_schedule";
+    space[1].values = {"static", "dynamic", "guided"};
+    space[2].name = "omp_chunk_size";
+    space[2].values = {"1", "8", "32", "64", "128", "256", "512"};
+    return space;
+}
+
+static void apply(const search_space & space, const search_point & point) {
+    const std::string & schedule = space[1].values[point[1]];
+    omp_set_num_threads(atoi(space[0].values[point[0]].c_str()));
+    omp_set_schedule(schedule == "static" ? omp_sched_static : (schedule == "dynamic" ? omp_sched_dynamic : omp_sched_guided),
+            atoi(space[2].values[point[2]].c_str()));
+}
+
+// Invocations and time spent so far, across all measurements.
+struct run_cost {
+    size_t calls = 0;
+    double seconds = 0.0;
+};
+
+static const sample_evaluator_settings settings;
+
+// The best trial so far, which later trials race against.
+struct run_incumbent {
+    double value = 0.0;
+    double spread = 0.0;
+    successive_halving rungs;
+};
+
+// Runs the kernel until the evaluator has an estimate of its time, racing
+// against the incumbent if there is one.
+static double measure(const kernel & k, run_cost & cost, run_incumbent * incumbent = nullptr) {
+    sample_evaluator samples;
+    while(incumbent == nullptr ? !samples.done(settings, 0.0)
+            : !samples.done(settings, incumbent->value, incumbent->spread)) {
+        const auto start = std::chrono::steady_clock::now();
+        k.run();
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        samples.add(elapsed.count());
+        if(incumbent != nullptr) {
+            samples.record_rung(settings, incumbent->rungs);
+        }
+        ++cost.calls;
+        cost.seconds += elapsed.count();
+    }
+    const double value = samples.estimate(settings);
+    if(incumbent != nullptr && (incumbent->value <= 0.0 || value < incumbent->value)) {
+        incumbent->value = value;
+        incumbent->spread = samples.relative_spread(settings);
+    }
+    return value;
+}
+
+static double measure_point(const kernel & k, const search_space & space, const search_point & point, run_cost & cost,
+        run_incumbent * incumbent = nullptr) {
+    apply(space, point);
+    return measure(k, cost, incumbent);
+}
+
+struct run_result {
+    size_t trials;
+    run_cost cost;
+    search_point point;
+};
+
+static const size_t max_trials = 1000;
+
+static run_result run_plugin(search_strategy & search, const kernel & k, const search_space & space) {
+    run_result result{0, run_cost(), search_point()};
+    run_incumbent best;
+    while(!search.converged() && result.trials < max_trials) {
+        search.report(measure_point(k, space, search.current(), result.cost, &best));
+        ++result.trials;
+    }
+    result.point = search.best();
+    return result;
+}
+
+static run_result run_apex(apex_ah_tuning_strategy strategy, const std::string & name, const kernel & k,
+        const search_space & space, const search_point & start) {
+    apex_tuning_request request(name);
+    request.set_trigger(apex::register_custom_event(name));
+    request.set_strategy(strategy);
+    for(size_t d = 0; d < space.size(); ++d) {
+        const std::list<std::string> values(space[d].values.begin(), space[d].values.end());
+        request.add_param_enum(space[d].name, space[d].values[start[d]], values);
+    }
+    auto current = [&]() {
+        search_point point(space.size());
+        for(size_t d = 0; d < space.size(); ++d) {
+            const std::string value = std::static_pointer_cast<apex_param_enum>(request.get_param(space[d].name))->get_value();
+            point[d] = search_index_of(space[d], value);
+        }
+        return point;
+    };
+    run_result result{0, run_cost(), search_point()};
+    run_incumbent best;
+    request.set_metric([&]() {
+        ++result.trials;
+        return measure_point(k, space, current(), result.cost, &best);
+    });
+    apex::setup_custom_tuning(request);
+    while(!request.has_converged() && result.trials < max_trials) {
+        apex::custom_event(request.get_trigger(), NULL);
+    }
+    result.point = current();
+    return result;
+}
+
+int main (int argc, char *argv[]) {
+    double scale = 1.0;
+    double production = 10000;
+    if (argc > 3) {
+        std::cout << "Usage: " << argv[0] << " [problem scale] [production invocations]" << std::endl;
+        exit(0);
+    }
+    if (argc > 1) {
+        scale = atof(argv[1]);
+    }
+    if (argc > 2) {
+        production = atof(argv[2]);
+    }
+
+    apex::init("kernel_benchmark", 0, 1);
+
+    const search_space space = make_space();
+    // All threads, static, chunk 64.
+    const search_point start{static_cast<int>(space[0].values.size()) - 1, 0, 3};
+    const std::vector<std::string> strategies{"BAYESIAN", "NEIGHBORHOOD", "NELDER_MEAD", "RANDOM", "PARALLEL_RANK_ORDER"};
+    // The ICVs the program started with.
+    const int default_threads = omp_get_max_threads();
+    omp_sched_t default_schedule;
+    int default_chunk;
+    omp_get_schedule(&default_schedule, &default_chunk);
+
+    printf("%-12s %-20s %8s %8s %10s %10s %10s\n", "kernel", "strategy", "trials", "calls", "time s", "gap %", "saved %");
+    for(const kernel & k : make_kernels(scale)) {
+        run_cost unused;
+        omp_set_num_threads(default_threads);
+        omp_set_schedule(default_schedule, default_chunk);
+        const double baseline = measure(k, unused);
+
+        // The exhaustive sweep is the reference.
+        run_cost sweep;
+        double optimum = std::numeric_limits<double>::infinity();
+        search_point best(space.size(), 0);
+        search_point point(space.size(), 0);
+        for(point[0] = 0; point[0] < static_cast<int>(space[0].values.size()); ++point[0]) {
+            for(point[1] = 0; point[1] < static_cast<int>(space[1].values.size()); ++point[1]) {
+                for(point[2] = 0; point[2] < static_cast<int>(space[2].values.size()); ++point[2]) {
+                    const double value = measure_point(k, space, point, sweep);
+                    if(value < optimum) {
+                        optimum = value;
+                        best = point;
+                    }
+                }
+            }
+        }
+        printf("%-12s %-20s %8s %8s %10.6f %10s %10.2f   (%s, %s, %s; default %.6f s)\n", k.name.c_str(), "optimum", "",
+                "", optimum, "", 100.0 * (1.0 - optimum / baseline), space[0].values[best[0]].c_str(),
+                space[1].values[best[1]].c_str(), space[2].values[best[2]].c_str(), baseline);
+
+        for(const std::string & strategy : strategies) {
+            run_result result;
+            if(strategy == "BAYESIAN") {
+                bayesian_search search(space, start, search_filter());
+                result = run_plugin(search, k, space);
+            } else if(strategy == "NEIGHBORHOOD") {
+                neighborhood_search search(space, start, 2, 0.0, 0.0);
+                result = run_plugin(search, k, space);
+            } else if(strategy == "NELDER_MEAD") {
+                result = run_apex(apex_ah_tuning_strategy::NELDER_MEAD, k.name + "/" + strategy, k, space, start);
+            } else if(strategy == "RANDOM") {
+                result = run_apex(apex_ah_tuning_strategy::RANDOM, k.name + "/" + strategy, k, space, start);
+            } else {
+                result = run_apex(apex_ah_tuning_strategy::PARALLEL_RANK_ORDER, k.name + "/" + strategy, k, space, start);
+            }
+            const double tuned = measure_point(k, space, result.point, unused);
+            // A production run: tuning first, then the rest at the result.
+            const double remaining = std::max(0.0, production - result.cost.calls);
+            const double saved = 1.0 - (result.cost.seconds + remaining * tuned) / (production * baseline);
+            printf("%-12s %-20s %8zu %8zu %10.6f %10.2f %10.2f\n", k.name.c_str(), strategy.c_str(), result.trials,
+                    result.cost.calls, tuned, 100.0 * (tuned / optimum - 1.0), 100.0 * saved);
+        }
+    }
+
+    apex::finalize();
+    return 0;
+}
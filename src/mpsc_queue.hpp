@@ -0,0 +1,78 @@
+//  APEX OpenMP Policy
+//
+//  Copyright (c) 2015 University of Oregon
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+// Unbounded multi-producer single-consumer queue, after Vyukov's MPSC
+// node-based queue. Any number of threads may push; a push is a
+// single atomic exchange plus a store, so producers never wait for each
+// other or for the consumer. Only one thread may pop. The queue always
+// holds a dummy node at the consumer's end: popping takes the value out of
+// the node after it, which then becomes the dummy.
+//
+// A push that has exchanged the head but not yet linked its node is not
+// visible to pop() until it does; the value is then popped on a later
+// call, so the consumer has to poll rather than take an empty queue as
+// final.
+template<typename T>
+class mpsc_queue {
+    private:
+        struct node {
+            std::atomic<node *> next;
+            T value;
+
+            node() : next(nullptr), value() {
+            }
+
+            explicit node(T value) : next(nullptr), value(std::move(value)) {
+            }
+        };
+
+        std::atomic<node *> head;
+        node * tail;
+
+    public:
+        mpsc_queue() : head(new node()), tail(head.load()) {
+        }
+
+        ~mpsc_queue() {
+            while(tail != nullptr) {
+                node * next = tail->next.load(std::memory_order_relaxed);
+                delete tail;
+                tail = next;
+            }
+        }
+
+        mpsc_queue(const mpsc_queue &) = delete;
+        mpsc_queue & operator=(const mpsc_queue &) = delete;
+
+        void push(T value) {
+            node * added = new node(std::move(value));
+            node * previous = head.exchange(added, std::memory_order_acq_rel);
+            previous->next.store(added, std::memory_order_release);
+        }
+
+        // Consumer only.
+        bool pop(T & value) {
+            node * next = tail->next.load(std::memory_order_acquire);
+            if(next == nullptr) {
+                return false;
+            }
+            value = std::move(next->value);
+            delete tail;
+            tail = next;
+            return true;
+        }
+
+        // Consumer only.
+        bool empty() const {
+            return tail->next.load(std::memory_order_acquire) == nullptr;
+        }
+};
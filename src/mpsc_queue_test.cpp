@@ -0,0 +1,109 @@
+//  Copyright (c) 2015 University of Oregon
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// The queue between the timer callbacks and the tuner thread: values come
+// out in the order they went in, and with many threads pushing at once the
+// consumer gets every value exactly once, in each producer's order.
+//
+//   mpsc_queue_test [producers] [values per producer]
+//
+#undef NDEBUG
+#include <atomic>
+#include <cassert>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mpsc_queue.hpp"
+
+struct message {
+    int producer;
+    int sequence;
+};
+
+int main (int argc, char *argv[]) {
+    const int producers = argc > 1 ? atoi(argv[1]) : 8;
+    const int count = argc > 2 ? atoi(argv[2]) : 100000;
+    assert(producers > 0 && count > 0);
+
+    {
+        mpsc_queue<int> queue;
+        int value = -1;
+        assert(queue.empty());
+        assert(!queue.pop(value) && value == -1);
+        for(int i = 0; i < 10; ++i) {
+            queue.push(i);
+        }
+        assert(!queue.empty());
+        for(int i = 0; i < 5; ++i) {
+            assert(queue.pop(value) && value == i);
+        }
+        queue.push(10);
+        for(int i = 5; i <= 10; ++i) {
+            assert(queue.pop(value) && value == i);
+        }
+        assert(queue.empty());
+        assert(!queue.pop(value));
+    }
+
+    // Values left in the queue are freed with it.
+    std::shared_ptr<int> shared = std::make_shared<int>(1);
+    {
+        mpsc_queue<std::shared_ptr<int>> queue;
+        queue.push(shared);
+        queue.push(shared);
+        std::shared_ptr<int> popped;
+        assert(queue.pop(popped) && popped == shared);
+        popped.reset();
+        assert(shared.use_count() == 2);
+    }
+    assert(shared.use_count() == 1);
+
+    {
+        mpsc_queue<message> queue;
+        std::atomic<int> started{0};
+        std::vector<std::thread> threads;
+        for(int p = 0; p < producers; ++p) {
+            threads.emplace_back([&, p]() {
+                ++started;
+                while(started.load() < producers) {
+                    std::this_thread::yield();
+                }
+                for(int i = 0; i < count; ++i) {
+                    queue.push(message{p, i});
+                }
+            });
+        }
+        // Pop while the producers push; an empty queue is not the end until
+        // every value has arrived.
+        std::vector<int> next(producers, 0);
+        long long received = 0;
+        const long long total = static_cast<long long>(producers) * count;
+        message popped;
+        while(received < total) {
+            if(!queue.pop(popped)) {
+                std::this_thread::yield();
+                continue;
+            }
+            assert(popped.producer >= 0 && popped.producer < producers);
+            assert(popped.sequence == next[popped.producer]);
+            ++next[popped.producer];
+            ++received;
+        }
+        for(std::thread & thread : threads) {
+            thread.join();
+        }
+        assert(queue.empty());
+        for(int p = 0; p < producers; ++p) {
+            assert(next[p] == count);
+        }
+    }
+
+    std::cerr << "Test passed." << std::endl;
+    return 0;
+}
@@ -0,0 +1,98 @@
+//  APEX OpenMP Policy
+//
+//  Copyright (c) 2015 University of Oregon
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include <algorithm>
+#include <limits>
+
+#include "neighborhood_search.hpp"
+
+neighborhood_search::neighborhood_search(const search_space & space, const search_point & start, int radius,
+        double reference, double tolerance, double min_gain, const search_filter & filter)
+    : space(space), radius(radius < 1 ? 1 : radius), reference(reference), tolerance(tolerance), min_gain(min_gain),
+      filter(filter), center(start), center_value(std::numeric_limits<double>::infinity()), point(start), done(false) {
+}
+
+void neighborhood_search::enqueue_neighbors() {
+    candidates.clear();
+    for(size_t d = 0; d < space.size(); ++d) {
+        const int size = static_cast<int>(space[d].values.size());
+        for(int step = 1; step <= radius; ++step) {
+            for(int sign = -1; sign <= 1; sign += 2) {
+                const int index = center[d] + sign * step;
+                if(index < 0 || index >= size) {
+                    continue;
+                }
+                search_point neighbor = center;
+                neighbor[d] = index;
+                if(filter && !filter(neighbor)) {
+                    continue;
+                }
+                if(neighbor != center && measured.find(neighbor) == measured.end()
+                        && std::find(candidates.begin(), candidates.end(), neighbor) == candidates.end()) {
+                    candidates.push_back(neighbor);
+                }
+            }
+        }
+    }
+}
+
+void neighborhood_search::advance() {
+    if(candidates.empty()) {
+        done = true;
+        point = center;
+    } else {
+        point = candidates.front();
+        candidates.pop_front();
+    }
+}
+
+const search_point & neighborhood_search::current() const {
+    return point;
+}
+
+void neighborhood_search::report(double value) {
+    if(done) {
+        return;
+    }
+    measured[point] = value;
+    if(measured.size() == 1 && point == center) {
+        // The start point.
+        center_value = value;
+        if(reference > 0.0 && value <= reference * (1.0 + tolerance)) {
+            done = true;
+            return;
+        }
+        enqueue_neighbors();
+    } else if(value < center_value * (1.0 - min_gain)) {
+        center = point;
+        center_value = value;
+        enqueue_neighbors();
+    }
+    advance();
+}
+
+void neighborhood_search::skip() {
+    if(done) {
+        return;
+    }
+    if(measured.empty() && point == center) {
+        enqueue_neighbors();
+    }
+    advance();
+}
+
+bool neighborhood_search::converged() const {
+    return done;
+}
+
+const search_point & neighborhood_search::best() const {
+    return center;
+}
+
+size_t neighborhood_search::trials() const {
+    return measured.size();
+}
@@ -0,0 +1,61 @@
+//  APEX OpenMP Policy
+//
+//  Copyright (c) 2015 University of Oregon
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <map>
+#include <deque>
+
+#include "search.hpp"
+
+// Local search from a known starting point, used to warm-start tuning from
+// a history entry.
+//
+// The start point is measured first. If a reference value is known and the
+// start point is within tolerance of it, the search converges right away.
+// Otherwise the points within radius steps of the center along each
+// dimension are measured one at a time; whenever one improves on the center
+// by more than min_gain it becomes the new center. The search converges
+// when no point around the center improves on it. Exploration therefore
+// starts in the neighborhood of the start point but can follow the
+// optimum anywhere in the full space. Neighbors are passed through the
+// filter, if any, so excluded and equivalent points are never measured.
+class neighborhood_search : public search_strategy {
+    private:
+        search_space space;
+        int radius;
+        double reference;
+        double tolerance;
+        double min_gain;
+        search_filter filter;
+
+        search_point center;
+        double center_value;
+        search_point point;
+        std::deque<search_point> candidates;
+        std::map<search_point, double> measured;
+        bool done;
+
+        void enqueue_neighbors();
+        void advance();
+
+    public:
+        // reference <= 0 means no reference value is known.
+        neighborhood_search(const search_space & space, const search_point & start, int radius,
+                double reference, double tolerance, double min_gain = 0.02,
+                const search_filter & filter = search_filter());
+
+        const search_point & current() const;
+        void report(double value);
+        // A skipped start point leaves the search without a reference; the
+        // first neighbor measured becomes the center.
+        void skip();
+        bool converged() const;
+        const search_point & best() const;
+        // Number of points measured so far.
+        size_t trials() const;
+};
@@ -0,0 +1,380 @@
+//  APEX OpenMP Policy
+//
+//  Copyright (c) 2015 University of Oregon
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "ompt_imbalance.hpp"
+
+static thread_local ompt_imbalance_totals thread_totals = {0, 0.0};
+
+#ifdef APEX_OPENMP_OMPT
+
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <memory>
+#include <cstring>
+
+#include <dlfcn.h>
+
+#include <omp-tools.h>
+
+namespace {
+
+std::atomic<bool> active{false};
+
+// One parallel region, found through parallel_data->ptr. The next tool
+// gets next_data in place of the region's parallel_data, so the two tools
+// never overwrite each other's pointer. Each thread running an implicit
+// task of the region holds a reference, as does the region itself until
+// it ends, so late callbacks from threads leaving it stay safe.
+struct parallel_accumulator {
+    std::atomic<int> references{1};
+    std::atomic<uint32_t> loops{0};
+    unsigned threads;
+    std::unique_ptr<std::atomic<int64_t>[]> busy;
+    ompt_data_t next_data = ompt_data_none;
+
+    explicit parallel_accumulator(unsigned threads) : threads(threads), busy(new std::atomic<int64_t>[threads]) {
+        for(unsigned i = 0; i < threads; ++i) {
+            busy[i].store(0, std::memory_order_relaxed);
+        }
+    }
+};
+
+void release(parallel_accumulator * region) {
+    if(region->references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        delete region;
+    }
+}
+
+// Implicit tasks of this thread, innermost last. Nesting deeper than the
+// stack is counted but not timed.
+struct task_frame {
+    parallel_accumulator * region;
+    unsigned index;
+    int64_t segment_start;
+};
+const int max_task_depth = 16;
+thread_local task_frame tasks[max_task_depth];
+thread_local int task_depth = 0;
+
+int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+task_frame * current_task() {
+    return task_depth > 0 && task_depth <= max_task_depth ? &tasks[task_depth - 1] : nullptr;
+}
+
+ompt_data_t * next_parallel_data(ompt_data_t * parallel_data) {
+    if(parallel_data == nullptr || parallel_data->ptr == nullptr) {
+        return parallel_data;
+    }
+    return &static_cast<parallel_accumulator *>(parallel_data->ptr)->next_data;
+}
+
+// Barriers the threads of a region wait at for each other.
+bool is_barrier(ompt_sync_region_t kind) {
+    switch(static_cast<int>(kind)) {
+        case 1: // ompt_sync_region_barrier
+        case 2: // ompt_sync_region_barrier_implicit
+        case ompt_sync_region_barrier_explicit:
+        case ompt_sync_region_barrier_implementation:
+        case ompt_sync_region_barrier_implicit_workshare:
+        case ompt_sync_region_barrier_implicit_parallel:
+        case ompt_sync_region_barrier_teams:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// OpenMP 5.2 runtimes report ompt_work_loop_static, _dynamic, _guided and
+// _other (10 to 13) instead of ompt_work_loop.
+bool is_loop(ompt_work_t wstype) {
+    return wstype == ompt_work_loop || (wstype >= 10 && wstype <= 13);
+}
+
+// The tool started after this one in the process, if any, and the
+// callbacks it registered for the events this tool also uses.
+ompt_start_tool_result_t * next_tool = nullptr;
+ompt_function_lookup_t runtime_lookup = nullptr;
+ompt_set_callback_t runtime_set_callback = nullptr;
+ompt_get_parallel_info_t runtime_get_parallel_info = nullptr;
+ompt_set_result_t own_results[64];
+ompt_callback_parallel_begin_t next_parallel_begin = nullptr;
+ompt_callback_parallel_end_t next_parallel_end = nullptr;
+ompt_callback_implicit_task_t next_implicit_task = nullptr;
+ompt_callback_sync_region_t next_sync_region_wait = nullptr;
+ompt_callback_work_t next_work = nullptr;
+ompt_callback_sync_region_t next_sync_region = nullptr;
+ompt_callback_sync_region_t next_reduction = nullptr;
+ompt_callback_masked_t next_masked = nullptr;
+ompt_callback_dispatch_t next_dispatch = nullptr;
+
+void on_parallel_begin(ompt_data_t * encountering_task_data, const ompt_frame_t * encountering_task_frame,
+        ompt_data_t * parallel_data, unsigned int requested_parallelism, int flags, const void * codeptr_ra) {
+    parallel_accumulator * region = new parallel_accumulator(requested_parallelism);
+    parallel_data->ptr = region;
+    if(next_parallel_begin != nullptr) {
+        next_parallel_begin(encountering_task_data, encountering_task_frame, &region->next_data, requested_parallelism, flags, codeptr_ra);
+    }
+}
+
+// Called on the primary thread once every thread has reached the region's
+// final barrier, so all busy times are in.
+void on_parallel_end(ompt_data_t * parallel_data, ompt_data_t * encountering_task_data, int flags, const void * codeptr_ra) {
+    parallel_accumulator * region = static_cast<parallel_accumulator *>(parallel_data->ptr);
+    if(region != nullptr && region->loops.load(std::memory_order_relaxed) > 0) {
+        int64_t longest = 0;
+        int64_t total = 0;
+        unsigned threads = 0;
+        for(unsigned i = 0; i < region->threads; ++i) {
+            const int64_t busy = region->busy[i].load(std::memory_order_relaxed);
+            if(busy > 0) {
+                longest = std::max(longest, busy);
+                total += busy;
+                ++threads;
+            }
+        }
+        thread_totals.regions += 1;
+        if(threads > 1) {
+            thread_totals.sum += 1.0 - static_cast<double>(total) / threads / longest;
+        }
+    }
+    if(next_parallel_end != nullptr) {
+        next_parallel_end(next_parallel_data(parallel_data), encountering_task_data, flags, codeptr_ra);
+    }
+    if(region != nullptr) {
+        release(region);
+    }
+}
+
+void on_implicit_task(ompt_scope_endpoint_t endpoint, ompt_data_t * parallel_data, ompt_data_t * task_data,
+        unsigned int actual_parallelism, unsigned int index, int flags) {
+    if(endpoint == ompt_scope_begin) {
+        parallel_accumulator * region = nullptr;
+        if((flags & ompt_task_initial) != 0) {
+            // The implicit parallel region around the initial task has no
+            // begin event; give it an accumulator too, only to hold the next
+            // tool's data. It lives as long as the thread.
+            if(parallel_data != nullptr && parallel_data->ptr == nullptr) {
+                parallel_data->ptr = new parallel_accumulator(0);
+            }
+        } else if(parallel_data != nullptr && parallel_data->ptr != nullptr) {
+            region = static_cast<parallel_accumulator *>(parallel_data->ptr);
+            region->references.fetch_add(1, std::memory_order_relaxed);
+        }
+        if(task_depth < max_task_depth) {
+            tasks[task_depth] = task_frame{region, index, now_ns()};
+        } else if(region != nullptr) {
+            release(region);
+        }
+        ++task_depth;
+        if(next_implicit_task != nullptr) {
+            next_implicit_task(endpoint, next_parallel_data(parallel_data), task_data, actual_parallelism, index, flags);
+        }
+        return;
+    }
+    // The end event may come with no parallel data, after the region ended.
+    if(next_implicit_task != nullptr) {
+        next_implicit_task(endpoint, next_parallel_data(parallel_data), task_data, actual_parallelism, index, flags);
+    }
+    if(task_depth > 0) {
+        --task_depth;
+        if(task_depth < max_task_depth && tasks[task_depth].region != nullptr) {
+            release(tasks[task_depth].region);
+            tasks[task_depth].region = nullptr;
+        }
+    }
+}
+
+void on_sync_region_wait(ompt_sync_region_t kind, ompt_scope_endpoint_t endpoint, ompt_data_t * parallel_data,
+        ompt_data_t * task_data, const void * codeptr_ra) {
+    task_frame * task = current_task();
+    if(task != nullptr && task->region != nullptr && is_barrier(kind)) {
+        const int64_t now = now_ns();
+        if(endpoint == ompt_scope_begin) {
+            if(task->index < task->region->threads && task->segment_start > 0) {
+                task->region->busy[task->index].fetch_add(now - task->segment_start, std::memory_order_relaxed);
+            }
+            task->segment_start = 0;
+        } else {
+            task->segment_start = now;
+        }
+    }
+    if(next_sync_region_wait != nullptr) {
+        next_sync_region_wait(kind, endpoint, next_parallel_data(parallel_data), task_data, codeptr_ra);
+    }
+}
+
+void on_work(ompt_work_t wstype, ompt_scope_endpoint_t endpoint, ompt_data_t * parallel_data, ompt_data_t * task_data,
+        uint64_t count, const void * codeptr_ra) {
+    task_frame * task = current_task();
+    if(endpoint == ompt_scope_begin && task != nullptr && task->region != nullptr && task->index == 0 && is_loop(wstype)) {
+        task->region->loops.fetch_add(1, std::memory_order_relaxed);
+    }
+    if(next_work != nullptr) {
+        next_work(wstype, endpoint, next_parallel_data(parallel_data), task_data, count, codeptr_ra);
+    }
+}
+
+// The other events that carry parallel data, registered only if the next
+// tool asks for them.
+void on_sync_region(ompt_sync_region_t kind, ompt_scope_endpoint_t endpoint, ompt_data_t * parallel_data,
+        ompt_data_t * task_data, const void * codeptr_ra) {
+    next_sync_region(kind, endpoint, next_parallel_data(parallel_data), task_data, codeptr_ra);
+}
+
+void on_reduction(ompt_sync_region_t kind, ompt_scope_endpoint_t endpoint, ompt_data_t * parallel_data,
+        ompt_data_t * task_data, const void * codeptr_ra) {
+    next_reduction(kind, endpoint, next_parallel_data(parallel_data), task_data, codeptr_ra);
+}
+
+void on_masked(ompt_scope_endpoint_t endpoint, ompt_data_t * parallel_data, ompt_data_t * task_data, const void * codeptr_ra) {
+    next_masked(endpoint, next_parallel_data(parallel_data), task_data, codeptr_ra);
+}
+
+void on_dispatch(ompt_data_t * parallel_data, ompt_data_t * task_data, ompt_dispatch_t kind, ompt_data_t instance) {
+    next_dispatch(next_parallel_data(parallel_data), task_data, kind, instance);
+}
+
+// ompt_set_callback as seen by the next tool. Its callbacks for the events
+// this tool registered are called from this tool's; the others go to the
+// runtime, through a wrapper if they carry parallel data.
+ompt_set_result_t chained_set_callback(ompt_callbacks_t event, ompt_callback_t callback) {
+    const bool own = event < 64 && own_results[event] >= ompt_set_sometimes;
+    switch(event) {
+        case ompt_callback_parallel_begin:
+            if(own) {
+                next_parallel_begin = reinterpret_cast<ompt_callback_parallel_begin_t>(callback);
+                return own_results[event];
+            }
+            break;
+        case ompt_callback_parallel_end:
+            if(own) {
+                next_parallel_end = reinterpret_cast<ompt_callback_parallel_end_t>(callback);
+                return own_results[event];
+            }
+            break;
+        case ompt_callback_implicit_task:
+            if(own) {
+                next_implicit_task = reinterpret_cast<ompt_callback_implicit_task_t>(callback);
+                return own_results[event];
+            }
+            break;
+        case ompt_callback_sync_region_wait:
+            if(own) {
+                next_sync_region_wait = reinterpret_cast<ompt_callback_sync_region_t>(callback);
+                return own_results[event];
+            }
+            break;
+        case ompt_callback_work:
+            if(own) {
+                next_work = reinterpret_cast<ompt_callback_work_t>(callback);
+                return own_results[event];
+            }
+            break;
+        case ompt_callback_sync_region:
+            next_sync_region = reinterpret_cast<ompt_callback_sync_region_t>(callback);
+            return runtime_set_callback(event, callback == nullptr ? nullptr : reinterpret_cast<ompt_callback_t>(&on_sync_region));
+        case ompt_callback_reduction:
+            next_reduction = reinterpret_cast<ompt_callback_sync_region_t>(callback);
+            return runtime_set_callback(event, callback == nullptr ? nullptr : reinterpret_cast<ompt_callback_t>(&on_reduction));
+        case ompt_callback_masked:
+            next_masked = reinterpret_cast<ompt_callback_masked_t>(callback);
+            return runtime_set_callback(event, callback == nullptr ? nullptr : reinterpret_cast<ompt_callback_t>(&on_masked));
+        case ompt_callback_dispatch:
+            next_dispatch = reinterpret_cast<ompt_callback_dispatch_t>(callback);
+            return runtime_set_callback(event, callback == nullptr ? nullptr : reinterpret_cast<ompt_callback_t>(&on_dispatch));
+        default:
+            break;
+    }
+    return runtime_set_callback(event, callback);
+}
+
+int chained_get_parallel_info(int ancestor_level, ompt_data_t ** parallel_data, int * team_size) {
+    const int result = runtime_get_parallel_info(ancestor_level, parallel_data, team_size);
+    if(result != 0 && parallel_data != nullptr) {
+        *parallel_data = next_parallel_data(*parallel_data);
+    }
+    return result;
+}
+
+ompt_interface_fn_t chained_lookup(const char * interface_function_name) {
+    if(strcmp(interface_function_name, "ompt_set_callback") == 0) {
+        return reinterpret_cast<ompt_interface_fn_t>(&chained_set_callback);
+    }
+    if(strcmp(interface_function_name, "ompt_get_parallel_info") == 0 && runtime_get_parallel_info != nullptr) {
+        return reinterpret_cast<ompt_interface_fn_t>(&chained_get_parallel_info);
+    }
+    return runtime_lookup(interface_function_name);
+}
+
+int initialize(ompt_function_lookup_t lookup, int initial_device_num, ompt_data_t * tool_data) {
+    (void) tool_data;
+    runtime_lookup = lookup;
+    runtime_set_callback = reinterpret_cast<ompt_set_callback_t>(lookup("ompt_set_callback"));
+    runtime_get_parallel_info = reinterpret_cast<ompt_get_parallel_info_t>(lookup("ompt_get_parallel_info"));
+    if(runtime_set_callback == nullptr) {
+        return 0;
+    }
+    own_results[ompt_callback_parallel_begin] = runtime_set_callback(ompt_callback_parallel_begin,
+            reinterpret_cast<ompt_callback_t>(&on_parallel_begin));
+    own_results[ompt_callback_parallel_end] = runtime_set_callback(ompt_callback_parallel_end,
+            reinterpret_cast<ompt_callback_t>(&on_parallel_end));
+    own_results[ompt_callback_implicit_task] = runtime_set_callback(ompt_callback_implicit_task,
+            reinterpret_cast<ompt_callback_t>(&on_implicit_task));
+    own_results[ompt_callback_sync_region_wait] = runtime_set_callback(ompt_callback_sync_region_wait,
+            reinterpret_cast<ompt_callback_t>(&on_sync_region_wait));
+    own_results[ompt_callback_work] = runtime_set_callback(ompt_callback_work, reinterpret_cast<ompt_callback_t>(&on_work));
+    active = own_results[ompt_callback_parallel_begin] >= ompt_set_sometimes && own_results[ompt_callback_parallel_end] >= ompt_set_sometimes
+        && own_results[ompt_callback_implicit_task] >= ompt_set_sometimes && own_results[ompt_callback_sync_region_wait] >= ompt_set_sometimes
+        && own_results[ompt_callback_work] >= ompt_set_sometimes;
+    if(next_tool != nullptr && next_tool->initialize(&chained_lookup, initial_device_num, &next_tool->tool_data) == 0) {
+        next_tool = nullptr;
+    }
+    return 1;
+}
+
+void finalize(ompt_data_t * tool_data) {
+    (void) tool_data;
+    active = false;
+    if(next_tool != nullptr && next_tool->finalize != nullptr) {
+        next_tool->finalize(&next_tool->tool_data);
+    }
+}
+
+typedef ompt_start_tool_result_t * (*start_tool_function)(unsigned int, const char *);
+
+}
+
+extern "C" ompt_start_tool_result_t * ompt_start_tool(unsigned int omp_version, const char * runtime_version) {
+    // The next definition in the search order: another tool, such as APEX,
+    // or the runtime's own, which looks further.
+    start_tool_function next = reinterpret_cast<start_tool_function>(dlsym(RTLD_NEXT, "ompt_start_tool"));
+    if(next != nullptr && next != &ompt_start_tool) {
+        next_tool = next(omp_version, runtime_version);
+    }
+    static ompt_start_tool_result_t result = {&initialize, &finalize, ompt_data_none};
+    return &result;
+}
+
+bool ompt_imbalance_active() {
+    return active.load(std::memory_order_relaxed);
+}
+
+#else
+
+bool ompt_imbalance_active() {
+    return false;
+}
+
+#endif
+
+ompt_imbalance_totals ompt_imbalance_thread_totals() {
+    return thread_totals;
+}
@@ -0,0 +1,36 @@
+//  APEX OpenMP Policy
+//
+//  Copyright (c) 2015 University of Oregon
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <cstdint>
+
+// Load imbalance of parallel regions, measured with OMPT. The plugin is an
+// OMPT tool (built with APEX_OPENMP_OMPT when omp-tools.h is found) that
+// times each thread of a parallel region outside of barrier waits. When
+// the region ends, its imbalance is 1 - mean / max of those busy times:
+// 0 when every thread worked equally long, approaching 1 when one thread
+// did all the work while the others waited. Only regions running a
+// worksharing loop are counted, since the schedule cannot help the others.
+//
+// The runtime looks for tools when it starts, before APEX loads its
+// plugins, so the plugin has to be named in OMP_TOOL_LIBRARIES or, with an
+// APEX that is itself an OMPT tool, preloaded (LD_PRELOAD) so that the
+// runtime finds it first. The tool passes every event on to the next tool
+// in the process, so APEX still sees the regions.
+
+// Imbalance of the regions that ended on the calling thread since it
+// started: their number and the sum of their imbalance. Take the
+// difference of two readings for the regions in between.
+struct ompt_imbalance_totals {
+    uint64_t regions;
+    double sum;
+};
+
+// True once the OpenMP runtime has started the tool.
+bool ompt_imbalance_active();
+ompt_imbalance_totals ompt_imbalance_thread_totals();
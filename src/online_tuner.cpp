@@ -0,0 +1,110 @@
+//  APEX OpenMP Policy
+//
+//  Copyright (c) 2015 University of Oregon
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#include "online_tuner.hpp"
+
+// Observations before the detector may fire.
+static const size_t detector_warmup = 4;
+// Weight of the newest batch in an arm's mean.
+static const double arm_weight = 0.3;
+// Width of the confidence bonus, in log time (about 5%).
+static const double exploration_width = 0.05;
+
+change_detector::change_detector(double tolerance, double threshold)
+    : tolerance(tolerance), threshold(threshold) {
+    reset();
+}
+
+void change_detector::reset() {
+    count = 0;
+    mean = 0.0;
+    sum = 0.0;
+    minimum = 0.0;
+}
+
+bool change_detector::add(double value) {
+    ++count;
+    mean += (value - mean) / count;
+    sum += value - mean - tolerance;
+    minimum = std::min(minimum, sum);
+    if(count > detector_warmup && sum - minimum > threshold) {
+        reset();
+        return true;
+    }
+    return false;
+}
+
+online_tuner::online_tuner(const std::vector<std::pair<search_point, double>> & measured, double explore_budget,
+        double drift_threshold)
+    : explore_budget(explore_budget), batches(0), explored(0), incumbent_arm(0), current_arm(0),
+      detector(0.02, drift_threshold) {
+    for(const auto & item : measured) {
+        arms.push_back(arm{item.first, std::log(std::max(item.second, std::numeric_limits<double>::min())), 1});
+    }
+    incumbent_arm = best_arm();
+    current_arm = incumbent_arm;
+}
+
+size_t online_tuner::best_arm() const {
+    size_t best = 0;
+    for(size_t i = 1; i < arms.size(); ++i) {
+        if(arms[i].mean < arms[best].mean) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+const search_point & online_tuner::current() const {
+    return arms[current_arm].point;
+}
+
+const search_point & online_tuner::incumbent() const {
+    return arms[incumbent_arm].point;
+}
+
+double online_tuner::incumbent_value() const {
+    return std::exp(arms[incumbent_arm].mean);
+}
+
+bool online_tuner::report(double value) {
+    const double y = std::log(std::max(value, std::numeric_limits<double>::min()));
+    arm & pulled = arms[current_arm];
+    pulled.mean = (1.0 - arm_weight) * pulled.mean + arm_weight * y;
+    ++pulled.pulls;
+    ++batches;
+    const size_t best = best_arm();
+    // Only a sustained shift of the incumbent calls for a new search. An
+    // arm that is merely ahead, which among arms within noise of each other
+    // happens all the time, just takes over.
+    if(current_arm == incumbent_arm && detector.add(y)) {
+        return true;
+    }
+    if(best != incumbent_arm) {
+        incumbent_arm = best;
+        detector.reset();
+    }
+    current_arm = incumbent_arm;
+    if(explored + 1 <= explore_budget * (batches + 1)) {
+        double lowest = std::numeric_limits<double>::infinity();
+        for(size_t i = 0; i < arms.size(); ++i) {
+            const double bound = arms[i].mean - exploration_width * std::sqrt(std::log(batches + 1.0) / arms[i].pulls);
+            if(bound < lowest) {
+                lowest = bound;
+                current_arm = i;
+            }
+        }
+        if(current_arm != incumbent_arm) {
+            ++explored;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,75 @@
+//  APEX OpenMP Policy
+//
+//  Copyright (c) 2015 University of Oregon
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <utility>
+
+#include "search.hpp"
+
+// Page-Hinkley test for an upward shift in the mean of a series, used on
+// the log of a region's batch times. Increases smaller than tolerance per
+// observation are ignored; the test fires once the accumulated excess
+// over the running mean reaches threshold.
+class change_detector {
+    private:
+        double tolerance;
+        double threshold;
+        size_t count;
+        double mean;
+        double sum;
+        double minimum;
+
+    public:
+        change_detector(double tolerance = 0.02, double threshold = 0.5);
+        // Returns true when a shift is detected; the test then restarts.
+        bool add(double value);
+        void reset();
+};
+
+// Online tuning after convergence (APEX_OPENMP_ONLINE): a bandit over the
+// best few configs found by the search.
+//
+// Each report is the estimate of one batch of calls on current(). Arms
+// keep an exponentially weighted mean of their log times so old phases are
+// forgotten, and the next arm is picked by a lower confidence bound
+// (UCB for minimization). At most explore_budget of the batches go to arms
+// other than the incumbent, the arm with the lowest mean; an arm whose mean
+// drops below the incumbent's takes its place. Batches on the incumbent
+// feed a change_detector; report() returns true when it fires, meaning the
+// incumbent got slower and the region should search again.
+class online_tuner {
+    private:
+        struct arm {
+            search_point point;
+            double mean;
+            size_t pulls;
+        };
+
+        std::vector<arm> arms;
+        double explore_budget;
+        size_t batches;
+        size_t explored;
+        size_t incumbent_arm;
+        size_t current_arm;
+        change_detector detector;
+
+        size_t best_arm() const;
+
+    public:
+        // arms: points with their measured values, best first.
+        online_tuner(const std::vector<std::pair<search_point, double>> & arms, double explore_budget,
+                double drift_threshold);
+
+        const search_point & current() const;
+        const search_point & incumbent() const;
+        // Lowest mean time of any arm.
+        double incumbent_value() const;
+        bool report(double value);
+};
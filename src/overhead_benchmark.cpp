@@ -0,0 +1,215 @@
+//  Copyright (c) 2015 University of Oregon
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Measures what the policy adds to each region start/stop pair, across
+// thread counts, region counts, and regions that are still tuning or have
+// converged. Every configuration runs in a child process, once without the
+// plugin (the baseline cost of APEX itself) and once with it:
+//
+//   APEX_PLUGINS_PATH=<dir of libapex_openmp_policy.so> overhead_benchmark [max threads] [pairs per thread]
+//
+// Tuning regions use the EXHAUSTIVE strategy and a fresh set of regions
+// every few dozen calls, so they never converge during the measurement;
+// their cost includes the tuner steps. Converged regions are pinned from a
+// generated history file. The plugin's output goes to a scratch directory.
+//
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "apex_api.hpp"
+
+enum class benchmark_mode {BASELINE, TUNING, CONVERGED};
+
+static std::string region_name(int round, int region) {
+    return "OpenMP_PARALLEL_REGION: overhead_benchmark.cpp:" + std::to_string(round) + ":" + std::to_string(region);
+}
+
+// Calls per region per round, summed over all threads; well below what
+// an exhaustive search of the default space needs to converge.
+static const int calls_per_round = 32;
+
+// Runs in the child process: returns the mean nanoseconds per start/stop
+// pair over all threads.
+static double measure(benchmark_mode mode, int num_threads, int num_regions, long pairs) {
+    const int per_round = std::max(1, calls_per_round / num_threads);
+    const long rounds = std::max(1L, pairs / (static_cast<long>(num_regions) * per_round));
+    std::vector<std::vector<std::string>> names(mode == benchmark_mode::TUNING ? rounds : 1);
+    for(size_t round = 0; round < names.size(); ++round) {
+        for(int r = 0; r < num_regions; ++r) {
+            names[round].push_back(region_name(round, r));
+        }
+    }
+
+    apex::init("overhead_benchmark", 0, 1);
+
+    std::atomic<long> arrived{0};
+    std::vector<double> per_thread(num_threads, 0.0);
+    std::vector<std::thread> threads;
+    for(int t = 0; t < num_threads; ++t) {
+        threads.emplace_back([&, t]() {
+            apex::register_thread("overhead thread " + std::to_string(t));
+            double seconds = 0.0;
+            long timed = 0;
+            for(long round = 0; round < rounds; ++round) {
+                const std::vector<std::string> & round_names = names[mode == benchmark_mode::TUNING ? round : 0];
+                // Untimed: the first entry of each region, which registers it
+                // and starts its session.
+                for(int r = t; r < num_regions; r += num_threads) {
+                    apex::stop(apex::start(round_names[r]));
+                }
+                arrived.fetch_add(1);
+                while(arrived.load() < (round + 1) * num_threads) {
+                    std::this_thread::yield();
+                }
+                const auto start = std::chrono::steady_clock::now();
+                for(int call = 0; call < per_round; ++call) {
+                    for(int r = 0; r < num_regions; ++r) {
+                        apex::profiler * profiler = apex::start(round_names[(r + t) % num_regions]);
+                        apex::stop(profiler);
+                    }
+                }
+                const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+                seconds += elapsed.count();
+                timed += static_cast<long>(per_round) * num_regions;
+            }
+            per_thread[t] = 1e9 * seconds / timed;
+            apex::exit_thread();
+        });
+    }
+    for(auto & thread : threads) {
+        thread.join();
+    }
+    apex::finalize();
+
+    double total = 0.0;
+    for(double ns : per_thread) {
+        total += ns;
+    }
+    return total / num_threads;
+}
+
+// Runs measure() in a child process so that every configuration starts
+// with a fresh APEX and plugin. Returns a negative value on failure.
+static double run_child(benchmark_mode mode, int num_threads, int num_regions, long pairs,
+        const std::string & scratch, const std::string & history) {
+    int fds[2];
+    if(pipe(fds) != 0) {
+        return -1.0;
+    }
+    const pid_t pid = fork();
+    if(pid == 0) {
+        close(fds[0]);
+        if(chdir(scratch.c_str()) != 0 || freopen("plugin.log", "a", stdout) == nullptr
+                || freopen("plugin.log", "a", stderr) == nullptr) {
+            _exit(1);
+        }
+        if(mode == benchmark_mode::BASELINE) {
+            unsetenv("APEX_PLUGINS_PATH");
+        } else if(mode == benchmark_mode::TUNING) {
+            setenv("APEX_OPENMP_STRATEGY", "EXHAUSTIVE", 1);
+            unsetenv("APEX_OPENMP_HISTORY");
+        } else {
+            setenv("APEX_OPENMP_HISTORY", history.c_str(), 1);
+        }
+        const double ns = measure(mode, num_threads, num_regions, pairs);
+        const ssize_t written = write(fds[1], &ns, sizeof(ns));
+        _exit(written == sizeof(ns) ? 0 : 1);
+    }
+    close(fds[1]);
+    double ns = -1.0;
+    if(pid < 0 || read(fds[0], &ns, sizeof(ns)) != sizeof(ns)) {
+        ns = -1.0;
+    }
+    close(fds[0]);
+    if(pid > 0) {
+        waitpid(pid, nullptr, 0);
+    }
+    return ns;
+}
+
+// Pins every region of the first round to the ICVs already in effect, so
+// entering a converged region changes nothing.
+static bool write_history(const std::string & filename, int num_regions) {
+    std::ofstream history(filename);
+    omp_sched_t schedule;
+    int chunk;
+    omp_get_schedule(&schedule, &chunk);
+    const char * schedule_names[] = {"", "static", "dynamic", "guided", "auto"};
+    const int kind = static_cast<int>(schedule) & 0x7;
+    history << "\"name\",\"num_threads\",\"schedule\",\"chunk_size\",\"converged\",\"value\"" << std::endl;
+    for(int r = 0; r < num_regions; ++r) {
+        history << "\"" << region_name(0, r) << "\"," << omp_get_max_threads() << ",\""
+            << (kind <= 4 ? schedule_names[kind] : "static") << "\"," << chunk << ",\"CONVERGED\",0" << std::endl;
+    }
+    return history.good();
+}
+
+int main (int argc, char *argv[]) {
+    int max_threads = omp_get_num_procs();
+    long pairs = 200000;
+    if (argc > 3) {
+        std::cout << "Usage: " << argv[0] << " [max threads] [pairs per thread]" << std::endl;
+        exit(0);
+    }
+    if (argc > 1) {
+        max_threads = std::max(1, atoi(argv[1]));
+    }
+    if (argc > 2) {
+        pairs = std::max(1L, atol(argv[2]));
+    }
+    if (std::getenv("APEX_PLUGINS_PATH") == nullptr) {
+        std::cerr << "Set APEX_PLUGINS_PATH to the directory of the policy plugin." << std::endl;
+        exit(1);
+    }
+
+    char scratch_template[] = "/tmp/overhead_benchmark.XXXXXX";
+    if (mkdtemp(scratch_template) == nullptr) {
+        std::cerr << "Unable to create a scratch directory" << std::endl;
+        exit(1);
+    }
+    const std::string scratch{scratch_template};
+    const std::vector<int> region_counts{1, 16, 256};
+    const std::string history = scratch + "/history.csv";
+    if (!write_history(history, region_counts.back())) {
+        std::cerr << "Unable to write " << history << std::endl;
+        exit(1);
+    }
+
+    printf("%-10s %8s %8s %12s %12s %12s\n", "state", "threads", "regions", "total ns", "baseline ns", "policy ns");
+    fflush(stdout);
+    std::vector<int> thread_counts;
+    for(int threads = 1; threads < max_threads; threads *= 2) {
+        thread_counts.push_back(threads);
+    }
+    thread_counts.push_back(max_threads);
+    for(int threads : thread_counts) {
+        for(int regions : region_counts) {
+            const double baseline = run_child(benchmark_mode::BASELINE, threads, regions, pairs, scratch, history);
+            for(benchmark_mode mode : {benchmark_mode::TUNING, benchmark_mode::CONVERGED}) {
+                const double total = run_child(mode, threads, regions, pairs, scratch, history);
+                if(baseline < 0.0 || total < 0.0) {
+                    std::cerr << "A benchmark run failed; see " << scratch << "/plugin.log" << std::endl;
+                    exit(1);
+                }
+                printf("%-10s %8d %8d %12.1f %12.1f %12.1f\n", mode == benchmark_mode::TUNING ? "tuning" : "converged",
+                        threads, regions, total, baseline, total - baseline);
+                fflush(stdout);
+            }
+        }
+    }
+    std::cout << "Plugin output is in " << scratch << std::endl;
+    return 0;
+}
@@ -0,0 +1,126 @@
+//  APEX OpenMP Policy
+//
+//  Copyright (c) 2015 University of Oregon
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include <set>
+#include <limits>
+#include <random>
+#include <algorithm>
+
+#include "record_search.hpp"
+
+// Spaces up to this size are enumerated; larger ones are sampled.
+static const double max_enumerated = 50000;
+static const size_t sampled_candidates = 20000;
+
+record_search::record_search(const search_space & space, const search_point & start, const search_filter & filter,
+        size_t max_points, unsigned seed)
+    : next(0), skipped(0), best_point(start), best_value(std::numeric_limits<double>::infinity()) {
+    search_point first = start;
+    if(filter) {
+        filter(first);
+    }
+    best_point = first;
+
+    double total = 1.0;
+    for(const search_dimension & dimension : space) {
+        total *= dimension.values.size();
+    }
+    std::set<search_point> unique;
+    search_point candidate(space.size(), 0);
+    std::mt19937 random(seed);
+    if(total <= max_enumerated) {
+        for(double visited = 0; visited < total; ++visited) {
+            search_point normalized = candidate;
+            if(!filter || filter(normalized)) {
+                unique.insert(normalized);
+            }
+            for(size_t d = 0; d < space.size() && ++candidate[d] == static_cast<int>(space[d].values.size()); ++d) {
+                candidate[d] = 0;
+            }
+        }
+    } else {
+        for(size_t sample = 0; sample < sampled_candidates; ++sample) {
+            for(size_t d = 0; d < space.size(); ++d) {
+                candidate[d] = std::uniform_int_distribution<int>(0, space[d].values.size() - 1)(random);
+            }
+            if(!filter || filter(candidate)) {
+                unique.insert(candidate);
+            }
+        }
+    }
+    unique.erase(first);
+    std::vector<search_point> candidates(unique.begin(), unique.end());
+    points.push_back(first);
+    if(candidates.size() + 1 <= max_points) {
+        points.insert(points.end(), candidates.begin(), candidates.end());
+        return;
+    }
+
+    // Greedy maximin, keeping each candidate's distance to the nearest
+    // chosen point up to date.
+    auto distance2 = [&space](const search_point & a, const search_point & b) {
+        double sum = 0.0;
+        for(size_t d = 0; d < space.size(); ++d) {
+            const size_t size = space[d].values.size();
+            const double delta = size > 1 ? static_cast<double>(a[d] - b[d]) / (size - 1) : 0.0;
+            sum += delta * delta;
+        }
+        return sum;
+    };
+    std::vector<double> nearest(candidates.size(), std::numeric_limits<double>::infinity());
+    points.reserve(max_points);
+    const search_point * last = &points.back();
+    while(points.size() < max_points) {
+        size_t farthest = candidates.size();
+        for(size_t i = 0; i < candidates.size(); ++i) {
+            nearest[i] = std::min(nearest[i], distance2(candidates[i], *last));
+            if(nearest[i] > 0.0 && (farthest == candidates.size() || nearest[i] > nearest[farthest])) {
+                farthest = i;
+            }
+        }
+        if(farthest == candidates.size()) {
+            break;
+        }
+        points.push_back(candidates[farthest]);
+        nearest[farthest] = 0.0;
+        last = &points.back();
+    }
+}
+
+const search_point & record_search::current() const {
+    return next < points.size() ? points[next] : best_point;
+}
+
+void record_search::report(double value) {
+    if(next >= points.size()) {
+        return;
+    }
+    if(value < best_value) {
+        best_value = value;
+        best_point = points[next];
+    }
+    ++next;
+}
+
+void record_search::skip() {
+    if(next < points.size()) {
+        ++next;
+        ++skipped;
+    }
+}
+
+bool record_search::converged() const {
+    return next >= points.size();
+}
+
+const search_point & record_search::best() const {
+    return best_point;
+}
+
+size_t record_search::trials() const {
+    return next - skipped;
+}
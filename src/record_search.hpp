@@ -0,0 +1,39 @@
+//  APEX OpenMP Policy
+//
+//  Copyright (c) 2015 University of Oregon
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <vector>
+
+#include "search.hpp"
+
+// Measures a fixed set of points for the replay tool (APEX_OPENMP_RECORD)
+// rather than looking for the optimum quickly. When the space has at most
+// max_points admissible points all of them are measured; otherwise the
+// start point and then, greedily, the candidate farthest from those chosen
+// so far, which spreads the points over the whole space. Afterwards the
+// best point measured is kept.
+class record_search : public search_strategy {
+    private:
+        std::vector<search_point> points;
+        size_t next;
+        size_t skipped;
+        search_point best_point;
+        double best_value;
+
+    public:
+        record_search(const search_space & space, const search_point & start,
+                const search_filter & filter = search_filter(), size_t max_points = 128, unsigned seed = 1);
+
+        const search_point & current() const;
+        void report(double value);
+        void skip();
+        bool converged() const;
+        const search_point & best() const;
+        // Number of points measured so far.
+        size_t trials() const;
+};
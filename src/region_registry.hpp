@@ -0,0 +1,261 @@
+//  APEX OpenMP Policy
+//
+//  Copyright (c) 2015 University of Oregon
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+
+// Maps APEX task identifiers to region records.
+//
+// APEX interns its task identifiers, so the identifier pointer is stable for
+// the lifetime of the run and can be used as the key on the hot path. APEX
+// may deliver events from several OS threads, so the registry is sharded:
+//
+//  - The pointer index is split into shards, each an open-addressed table
+//    whose slots are published with release stores. Lookups of identifiers
+//    that have already been seen take no lock and never allocate. Inserting
+//    an identifier takes only its shard's lock; a full table is copied into
+//    a larger one which is then published, and the old one is retired until
+//    the registry is destroyed so concurrent readers never see freed memory.
+//  - The name index (used once per identifier, and for history entries
+//    loaded before any identifier is seen) is sharded by name hash, each
+//    shard behind its own lock.
+//  - Regions are numbered with a compact integer ID and stored in a paged
+//    directory that is extended without locking.
+template<typename Region>
+class region_registry {
+    private:
+        static const size_t num_shards = 64;
+        static const size_t page_size = 1024;
+        static const size_t max_pages = 4096;
+
+        struct slot {
+            std::atomic<const void *> key;
+            std::atomic<Region *> value;
+        };
+
+        struct table {
+            size_t mask;
+            size_t used;
+            slot * slots;
+
+            table(size_t capacity) : mask(capacity - 1), used(0), slots(new slot[capacity]) {
+                for(size_t i = 0; i < capacity; ++i) {
+                    slots[i].key.store(nullptr, std::memory_order_relaxed);
+                    slots[i].value.store(nullptr, std::memory_order_relaxed);
+                }
+            }
+
+            ~table() {
+                delete[] slots;
+            }
+        };
+
+        struct pointer_shard {
+            std::mutex lock;
+            std::atomic<table *> current;
+            std::vector<table *> retired;
+        };
+
+        struct name_shard {
+            std::mutex lock;
+            std::unordered_map<std::string, Region *> regions;
+        };
+
+        pointer_shard pointer_shards[num_shards];
+        name_shard name_shards[num_shards];
+        std::atomic<std::atomic<Region *> *> pages[max_pages];
+        std::atomic<uint32_t> next_id;
+
+        static uint64_t hash_key(const void * key) {
+            // Fibonacci hashing of the pointer; the low bits of heap addresses
+            // are mostly zero so they are shifted out first.
+            uint64_t h = reinterpret_cast<uintptr_t>(key) >> 4;
+            h *= UINT64_C(0x9E3779B97F4A7C15);
+            return h ^ (h >> 29);
+        }
+
+        // The top bits select the shard, the low bits the slot.
+        static size_t shard_of(uint64_t hash) {
+            return static_cast<size_t>(hash >> 58) & (num_shards - 1);
+        }
+
+        // Caller holds the shard lock and has ensured there is room.
+        static void insert_slot(table & t, const void * key, Region * value, uint64_t hash) {
+            for(size_t i = hash & t.mask; ; i = (i + 1) & t.mask) {
+                if(t.slots[i].key.load(std::memory_order_relaxed) == nullptr) {
+                    t.slots[i].value.store(value, std::memory_order_relaxed);
+                    t.slots[i].key.store(key, std::memory_order_release);
+                    ++t.used;
+                    return;
+                }
+            }
+        }
+
+        static Region * probe(const table & t, const void * key, uint64_t hash) {
+            for(size_t i = hash & t.mask; ; i = (i + 1) & t.mask) {
+                const void * k = t.slots[i].key.load(std::memory_order_acquire);
+                if(k == key) {
+                    return t.slots[i].value.load(std::memory_order_relaxed);
+                }
+                if(k == nullptr) {
+                    return nullptr;
+                }
+            }
+        }
+
+        void publish(uint32_t id, Region * region) {
+            const size_t page_index = id / page_size;
+            std::atomic<Region *> * page = pages[page_index].load(std::memory_order_acquire);
+            if(page == nullptr) {
+                std::atomic<Region *> * fresh = new std::atomic<Region *>[page_size];
+                for(size_t i = 0; i < page_size; ++i) {
+                    fresh[i].store(nullptr, std::memory_order_relaxed);
+                }
+                if(pages[page_index].compare_exchange_strong(page, fresh, std::memory_order_acq_rel)) {
+                    page = fresh;
+                } else {
+                    delete[] fresh;
+                }
+            }
+            page[id % page_size].store(region, std::memory_order_release);
+        }
+
+    public:
+        region_registry(size_t initial_capacity = 1024) : next_id(0) {
+            size_t capacity = 16;
+            while(capacity * num_shards < initial_capacity) {
+                capacity <<= 1;
+            }
+            for(size_t i = 0; i < num_shards; ++i) {
+                pointer_shards[i].current.store(new table(capacity), std::memory_order_relaxed);
+            }
+            for(size_t i = 0; i < max_pages; ++i) {
+                pages[i].store(nullptr, std::memory_order_relaxed);
+            }
+        }
+
+        region_registry(const region_registry &) = delete;
+        region_registry & operator=(const region_registry &) = delete;
+
+        // Hot path: returns nullptr if the identifier has never been seen.
+        // Lock-free and allocation-free.
+        Region * find(const void * key) const {
+            const uint64_t hash = hash_key(key);
+            const table * t = pointer_shards[shard_of(hash)].current.load(std::memory_order_acquire);
+            return probe(*t, key, hash);
+        }
+
+        // Associates an identifier with a region (which may be a sentinel).
+        // If another thread bound the identifier first, its region wins and
+        // is returned.
+        Region * bind(const void * key, Region * value) {
+            const uint64_t hash = hash_key(key);
+            pointer_shard & shard = pointer_shards[shard_of(hash)];
+            std::lock_guard<std::mutex> guard(shard.lock);
+            table * t = shard.current.load(std::memory_order_relaxed);
+            Region * existing = probe(*t, key, hash);
+            if(existing != nullptr) {
+                return existing;
+            }
+            if((t->used + 1) * 2 > t->mask + 1) {
+                table * bigger = new table((t->mask + 1) * 2);
+                for(size_t i = 0; i <= t->mask; ++i) {
+                    const void * k = t->slots[i].key.load(std::memory_order_relaxed);
+                    if(k != nullptr) {
+                        insert_slot(*bigger, k, t->slots[i].value.load(std::memory_order_relaxed), hash_key(k));
+                    }
+                }
+                shard.retired.push_back(t);
+                shard.current.store(bigger, std::memory_order_release);
+                t = bigger;
+            }
+            insert_slot(*t, key, value, hash);
+            return value;
+        }
+
+        Region * find_name(const std::string & name) {
+            name_shard & shard = name_shards[std::hash<std::string>()(name) & (num_shards - 1)];
+            std::lock_guard<std::mutex> guard(shard.lock);
+            auto search = shard.regions.find(name);
+            return search == shard.regions.end() ? nullptr : search->second;
+        }
+
+        // Returns the region with this name, creating it with make() (and
+        // assigning its ID) if it does not exist yet.
+        Region * find_or_add(const std::string & name, const std::function<Region *(void)> & make) {
+            name_shard & shard = name_shards[std::hash<std::string>()(name) & (num_shards - 1)];
+            std::lock_guard<std::mutex> guard(shard.lock);
+            auto search = shard.regions.find(name);
+            if(search != shard.regions.end()) {
+                return search->second;
+            }
+            // The ID is only taken once this thread owns the name, and never
+            // past the directory's capacity, so IDs stay dense.
+            uint32_t id = next_id.load(std::memory_order_relaxed);
+            do {
+                if(id >= page_size * max_pages) {
+                    return nullptr;
+                }
+            } while(!next_id.compare_exchange_weak(id, id + 1, std::memory_order_relaxed));
+            Region * region = make();
+            region->id = id;
+            shard.regions.insert(std::make_pair(name, region));
+            publish(id, region);
+            return region;
+        }
+
+        // Returns nullptr for IDs that are out of range or not yet published.
+        Region * get(uint32_t id) const {
+            if(id >= page_size * max_pages) {
+                return nullptr;
+            }
+            const std::atomic<Region *> * page = pages[id / page_size].load(std::memory_order_acquire);
+            return page == nullptr ? nullptr : page[id % page_size].load(std::memory_order_acquire);
+        }
+
+        uint32_t size() const {
+            return next_id.load(std::memory_order_acquire);
+        }
+
+        // Visits every published region in ID order.
+        template<typename F>
+        void for_each(F f) const {
+            const uint32_t count = size();
+            for(uint32_t id = 0; id < count; ++id) {
+                Region * region = get(id);
+                if(region != nullptr) {
+                    f(*region);
+                }
+            }
+        }
+
+        ~region_registry() {
+            for(size_t i = 0; i < num_shards; ++i) {
+                delete pointer_shards[i].current.load(std::memory_order_relaxed);
+                for(table * t : pointer_shards[i].retired) {
+                    delete t;
+                }
+            }
+            for(size_t i = 0; i < max_pages; ++i) {
+                std::atomic<Region *> * page = pages[i].load(std::memory_order_relaxed);
+                if(page != nullptr) {
+                    for(size_t j = 0; j < page_size; ++j) {
+                        delete page[j].load(std::memory_order_relaxed);
+                    }
+                    delete[] page;
+                }
+            }
+        }
+};
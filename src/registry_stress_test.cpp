@@ -0,0 +1,121 @@
+//  Copyright (c) 2015 University of Oregon
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Hammers the policy with concurrent start/stop events for many regions from
+// many OS threads, including nested regions. Run with the plugin loaded, e.g.
+//
+//   APEX_PLUGINS_PATH=<dir of libapex_openmp_policy.so> registry_stress_test [threads] [regions] [iterations]
+//
+// Before each region start the thread sets a schedule chunk size that is
+// not in any tuning space; the test fails unless the policy replaced it on
+// every thread, which it cannot do without the plugin loaded.
+//
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "apex_api.hpp"
+
+int main (int argc, char *argv[]) {
+    int num_threads = 16;
+    int num_regions = 256;
+    int iters = 20000;
+
+    if (argc > 4) {
+        std::cout << "Usage: " << argv[0] << " [threads] [regions] [iterations per thread]" << std::endl;
+        exit(0);
+    }
+    if (argc > 1) {
+        num_threads = atoi(argv[1]);
+    }
+    if (argc > 2) {
+        num_regions = atoi(argv[2]);
+    }
+    if (argc > 3) {
+        iters = atoi(argv[3]);
+    }
+
+    std::vector<std::string> names;
+    for(int r = 0; r < num_regions; ++r) {
+        names.push_back("OpenMP_PARALLEL_REGION: stress.cpp:" + std::to_string(r));
+    }
+    // Events that are not parallel regions must be ignored by the policy.
+    const std::string other_name{"stress_outer_loop"};
+    const int sentinel_chunk = 99991;
+
+    apex::init("registry_stress_test", 0, 1);
+
+    std::atomic<long> bad_settings{0};
+    std::vector<long> applied(num_threads, 0);
+    std::vector<std::thread> threads;
+    for(int t = 0; t < num_threads; ++t) {
+        threads.emplace_back([&, t]() {
+            apex::register_thread("stress thread " + std::to_string(t));
+            unsigned int seed = t * 7919 + 1;
+            for(int i = 0; i < iters; ++i) {
+                apex::profiler * other = apex::start(other_name);
+                // Every thread touches some shared regions and some that
+                // only it uses, so new regions keep appearing while other
+                // threads look up known ones.
+                const int outer = (i & 1) ? rand_r(&seed) % num_regions : (t + i * num_threads) % num_regions;
+                const int inner = rand_r(&seed) % num_regions;
+                omp_set_schedule(omp_sched_dynamic, sentinel_chunk);
+                apex::profiler * p = apex::start(names[outer]);
+                if(omp_get_max_threads() < 1) {
+                    ++bad_settings;
+                }
+                omp_sched_t outer_sched;
+                int outer_chunk;
+                omp_get_schedule(&outer_sched, &outer_chunk);
+                if(outer_chunk != sentinel_chunk) {
+                    ++applied[t];
+                }
+                apex::profiler * q = apex::start(names[inner]);
+                omp_sched_t sched;
+                int chunk_size;
+                omp_get_schedule(&sched, &chunk_size);
+                if(chunk_size < 0) {
+                    ++bad_settings;
+                }
+                apex::stop(q);
+                apex::stop(p);
+                apex::stop(other);
+            }
+            apex::exit_thread();
+        });
+    }
+    for(auto & thread : threads) {
+        thread.join();
+    }
+
+    apex::finalize();
+
+    std::cerr << std::endl;
+    std::cerr << num_threads << " threads x " << iters << " iterations over " << num_regions << " regions" << std::endl;
+    int idle_threads = 0;
+    for(int t = 0; t < num_threads; ++t) {
+        if(applied[t] == 0) {
+            ++idle_threads;
+        }
+    }
+    if(idle_threads > 0) {
+        std::cerr << "Test failed: the policy set no OpenMP schedule on " << idle_threads << " of " << num_threads
+            << " threads. Is the plugin loaded (APEX_PLUGINS_PATH)?" << std::endl;
+        std::cerr << std::endl;
+        return 1;
+    }
+    if(bad_settings == 0) {
+        std::cerr << "Test passed." << std::endl;
+    } else {
+        std::cerr << "Test failed: " << bad_settings << " invalid OpenMP settings observed." << std::endl;
+    }
+    std::cerr << std::endl;
+    return bad_settings == 0 ? 0 : 1;
+}
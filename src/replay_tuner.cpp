@@ -0,0 +1,382 @@
+//  Copyright (c) 2015 University of Oregon
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Replays the tuning of an application offline from a trace recorded with
+// APEX_OPENMP_RECORD, to compare strategies and windows without running
+// the application again. Every region is tuned from scratch by each
+// strategy, with trials measured by the policy's sample_evaluator on
+// invocation times drawn from the ones recorded for that config. Configs
+// that were not recorded get the log time interpolated from the nearest
+// recorded ones, times a residual drawn from the recorded spread. For each
+// strategy and window it reports the trials and invocations to converge,
+// the tuning overhead (time beyond what the best recorded config would
+// have taken) and how far the final config is from the best recorded one.
+// Run it without the policy plugin loaded:
+//
+//   replay_tuner <trace file> [runs] [windows, e.g. 1,3,5,8]
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <list>
+#include <map>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "apex_api.hpp"
+#include "apex_policies.hpp"
+
+#include "history.hpp"
+#include "sample_evaluator.hpp"
+#include "search.hpp"
+#include "bayesian_search.hpp"
+#include "trace.hpp"
+
+// Nearest recorded configs used to interpolate an unrecorded one.
+static const size_t interpolation_neighbors = 4;
+static const size_t max_trials = 10000;
+
+// The recorded timings of one region, as a function of its config.
+struct replay_region {
+    std::string name;
+    search_space space;
+    std::vector<bool> numeric;
+    std::map<search_point, std::vector<double>> pools;
+    std::map<search_point, double> log_means;
+    // Recorded times relative to the mean of their config.
+    std::vector<double> residuals;
+    double optimum = std::numeric_limits<double>::infinity();
+    size_t calls = 0;
+
+    double distance2(const search_point & a, const search_point & b) const {
+        double sum = 0.0;
+        for(size_t d = 0; d < space.size(); ++d) {
+            if(numeric[d]) {
+                const size_t size = space[d].values.size();
+                const double delta = size > 1 ? static_cast<double>(a[d] - b[d]) / (size - 1) : 0.0;
+                sum += delta * delta;
+            } else if(a[d] != b[d]) {
+                sum += 1.0;
+            }
+        }
+        return sum;
+    }
+
+    // Inverse-distance weighted log mean of the nearest recorded configs.
+    double log_mean(const search_point & point) const {
+        const auto recorded = log_means.find(point);
+        if(recorded != log_means.end()) {
+            return recorded->second;
+        }
+        std::vector<std::pair<double, double>> nearest;
+        for(const auto & item : log_means) {
+            nearest.emplace_back(distance2(point, item.first), item.second);
+        }
+        const size_t k = std::min(interpolation_neighbors, nearest.size());
+        std::partial_sort(nearest.begin(), nearest.begin() + k, nearest.end());
+        double weights = 0.0;
+        double sum = 0.0;
+        for(size_t i = 0; i < k; ++i) {
+            const double weight = 1.0 / nearest[i].first;
+            weights += weight;
+            sum += weight * nearest[i].second;
+        }
+        return sum / weights;
+    }
+
+    // The expected time of a call with this config.
+    double value(const search_point & point) const {
+        const auto recorded = pools.find(point);
+        if(recorded != pools.end()) {
+            double sum = 0.0;
+            for(double time : recorded->second) {
+                sum += time;
+            }
+            return sum / recorded->second.size();
+        }
+        return std::exp(log_mean(point));
+    }
+
+    // A simulated call with this config.
+    double draw(const search_point & point, std::mt19937 & random) const {
+        const auto recorded = pools.find(point);
+        if(recorded != pools.end()) {
+            const std::vector<double> & pool = recorded->second;
+            return pool[std::uniform_int_distribution<size_t>(0, pool.size() - 1)(random)];
+        }
+        return std::exp(log_mean(point)) * residuals[std::uniform_int_distribution<size_t>(0, residuals.size() - 1)(random)];
+    }
+};
+
+static std::string schedule_of(const trace_record & record) {
+    int32_t code = record.schedule & ~trace_schedule_monotonic;
+    if(record.schedule & trace_schedule_monotonic) {
+        code |= history_schedule_monotonic;
+    }
+    const std::string name = history_schedule_name(code);
+    return name.empty() ? std::to_string(record.schedule) : name;
+}
+
+static const size_t replay_dimensions = 5;
+
+// The value of each dimension for a record, in the order of make_regions().
+static std::vector<std::string> values_of(const trace_record & record) {
+    return {std::to_string(record.threads), schedule_of(record), std::to_string(record.chunk),
+        std::to_string(record.dynamic), std::to_string(record.max_active_levels)};
+}
+
+// Builds the replay model of every region with at least two recorded
+// configs. The space of a region is the product of the values recorded for
+// each dimension; dimensions with a single value are kept (they have no
+// effect on the search) so every region has the same layout.
+static std::vector<replay_region> make_regions(const std::vector<trace_record> & records,
+        const std::unordered_map<uint32_t, std::string> & names) {
+    static const char * dimension_names[replay_dimensions] = {"omp_num_threads", "omp_schedule", "omp_chunk_size",
+        "omp_dynamic", "omp_max_active_levels"};
+    static const bool dimension_numeric[replay_dimensions] = {true, false, true, false, true};
+    std::map<uint32_t, std::vector<const trace_record *>> by_region;
+    for(const trace_record & record : records) {
+        by_region[record.region].push_back(&record);
+    }
+    std::vector<replay_region> regions;
+    for(const auto & item : by_region) {
+        std::vector<std::set<std::string>> distinct(replay_dimensions);
+        for(const trace_record * record : item.second) {
+            const std::vector<std::string> values = values_of(*record);
+            for(size_t d = 0; d < replay_dimensions; ++d) {
+                distinct[d].insert(values[d]);
+            }
+        }
+        replay_region region;
+        const auto name = names.find(item.first);
+        region.name = name == names.end() ? std::to_string(item.first) : name->second;
+        for(size_t d = 0; d < replay_dimensions; ++d) {
+            search_dimension dimension;
+            dimension.name = dimension_names[d];
+            dimension.values.assign(distinct[d].begin(), distinct[d].end());
+            if(dimension_numeric[d]) {
+                std::sort(dimension.values.begin(), dimension.values.end(), [](const std::string & a, const std::string & b) {
+                    return atoi(a.c_str()) < atoi(b.c_str());
+                });
+            }
+            region.space.push_back(dimension);
+            region.numeric.push_back(dimension_numeric[d]);
+        }
+        for(const trace_record * record : item.second) {
+            const std::vector<std::string> values = values_of(*record);
+            search_point point(replay_dimensions);
+            for(size_t d = 0; d < replay_dimensions; ++d) {
+                point[d] = search_index_of(region.space[d], values[d]);
+            }
+            region.pools[point].push_back((record->stop - record->start) * 1e-9);
+            ++region.calls;
+        }
+        if(region.pools.size() < 2) {
+            continue;
+        }
+        for(const auto & pool : region.pools) {
+            const double mean = region.value(pool.first);
+            double log_sum = 0.0;
+            for(double time : pool.second) {
+                log_sum += std::log(std::max(time, 1e-12));
+                region.residuals.push_back(time / mean);
+            }
+            region.log_means[pool.first] = log_sum / pool.second.size();
+            region.optimum = std::min(region.optimum, mean);
+        }
+        regions.push_back(region);
+    }
+    return regions;
+}
+
+struct replay_result {
+    size_t trials = 0;
+    size_t calls = 0;
+    double seconds = 0.0;
+    search_point point;
+};
+
+// The best trial so far, which later trials race against.
+struct replay_incumbent {
+    double value = 0.0;
+    double spread = 0.0;
+    successive_halving rungs;
+};
+
+// One trial, measured the way the policy does.
+static double run_trial(const replay_region & region, const search_point & point, const sample_evaluator_settings & settings,
+        replay_incumbent & incumbent, std::mt19937 & random, replay_result & result) {
+    sample_evaluator samples;
+    while(!samples.done(settings, incumbent.value, incumbent.spread)) {
+        const double time = region.draw(point, random);
+        samples.add(time);
+        samples.record_rung(settings, incumbent.rungs);
+        ++result.calls;
+        result.seconds += time;
+    }
+    ++result.trials;
+    const double value = samples.estimate(settings);
+    if(incumbent.value <= 0.0 || value < incumbent.value) {
+        incumbent.value = value;
+        incumbent.spread = samples.relative_spread(settings);
+    }
+    return value;
+}
+
+static replay_result run_plugin(search_strategy & search, const replay_region & region,
+        const sample_evaluator_settings & settings, std::mt19937 & random) {
+    replay_result result;
+    replay_incumbent best;
+    while(!search.converged() && result.trials < max_trials) {
+        search.report(run_trial(region, search.current(), settings, best, random, result));
+    }
+    result.point = search.best();
+    return result;
+}
+
+static replay_result run_apex(apex_ah_tuning_strategy strategy, const std::string & name, const replay_region & region,
+        const search_point & start, const sample_evaluator_settings & settings, std::mt19937 & random) {
+    const search_space & space = region.space;
+    apex_tuning_request request(name);
+    request.set_trigger(apex::register_custom_event(name));
+    request.set_strategy(strategy);
+    for(size_t d = 0; d < space.size(); ++d) {
+        const std::list<std::string> values(space[d].values.begin(), space[d].values.end());
+        request.add_param_enum(space[d].name, space[d].values[start[d]], values);
+    }
+    auto current = [&]() {
+        search_point point(space.size());
+        for(size_t d = 0; d < space.size(); ++d) {
+            const std::string value = std::static_pointer_cast<apex_param_enum>(request.get_param(space[d].name))->get_value();
+            point[d] = search_index_of(space[d], value);
+        }
+        return point;
+    };
+    replay_result result;
+    replay_incumbent best;
+    request.set_metric([&]() {
+        return run_trial(region, current(), settings, best, random, result);
+    });
+    apex::setup_custom_tuning(request);
+    while(!request.has_converged() && result.trials < max_trials) {
+        apex::custom_event(request.get_trigger(), NULL);
+    }
+    result.point = current();
+    return result;
+}
+
+// The policy's cold start: 16 threads, static, chunk 64, or the closest.
+static search_point start_point(const search_space & space) {
+    const char * preferred[replay_dimensions] = {"16", "static", "64", "", ""};
+    search_point start(space.size(), 0);
+    for(size_t d = 0; d < space.size(); ++d) {
+        start[d] = std::max(0, search_index_of(space[d], preferred[d]));
+    }
+    return start;
+}
+
+int main (int argc, char *argv[]) {
+    if (argc < 2 || argc > 4) {
+        std::cout << "Usage: " << argv[0] << " <trace file> [runs] [windows, e.g. 1,3,5,8]" << std::endl;
+        exit(0);
+    }
+    int runs = 5;
+    if (argc > 2) {
+        runs = std::max(1, atoi(argv[2]));
+    }
+    std::vector<int> windows{1, 3, 5, 8};
+    if (argc > 3) {
+        windows.clear();
+        std::stringstream list(argv[3]);
+        std::string item;
+        while(std::getline(list, item, ',')) {
+            if(atoi(item.c_str()) > 0) {
+                windows.push_back(atoi(item.c_str()));
+            }
+        }
+    }
+
+    std::vector<trace_record> records;
+    std::unordered_map<uint32_t, std::string> names;
+    uint64_t dropped = 0;
+    if(!read_trace(argv[1], records, names, dropped)) {
+        return 1;
+    }
+    const std::vector<replay_region> regions = make_regions(records, names);
+    std::cout << "Replaying " << regions.size() << " regions with " << records.size() << " recorded invocations";
+    if(dropped > 0) {
+        std::cout << " (" << dropped << " dropped)";
+    }
+    std::cout << std::endl;
+    if(regions.empty()) {
+        std::cerr << "No region was recorded with more than one config; record with APEX_OPENMP_RECORD." << std::endl;
+        return 1;
+    }
+    for(const replay_region & region : regions) {
+        size_t combinations = 1;
+        for(const search_dimension & dimension : region.space) {
+            combinations *= dimension.values.size();
+        }
+        std::cout << "  " << region.name << ": " << region.pools.size() << " of " << combinations
+            << " configs recorded, best " << region.optimum << " s" << std::endl;
+    }
+
+    apex::init("replay_tuner", 0, 1);
+
+    const std::vector<std::string> strategies{"BAYESIAN", "NELDER_MEAD", "EXHAUSTIVE", "RANDOM", "PARALLEL_RANK_ORDER"};
+    printf("%-20s %6s %10s %10s %14s %10s\n", "strategy", "window", "trials", "calls", "overhead s", "gap %");
+    for(const std::string & strategy : strategies) {
+        for(int window : windows) {
+            sample_evaluator_settings settings;
+            settings.min_samples = window;
+            settings.max_samples = std::max(settings.max_samples, window);
+            double trials = 0.0;
+            double calls = 0.0;
+            double overhead = 0.0;
+            double gap = 0.0;
+            for(int run = 0; run < runs; ++run) {
+                for(size_t r = 0; r < regions.size(); ++r) {
+                    const replay_region & region = regions[r];
+                    std::mt19937 random(run * 7919 + r + 1);
+                    const search_point start = start_point(region.space);
+                    replay_result result;
+                    if(strategy == "BAYESIAN") {
+                        bayesian_search search(region.space, start, search_filter(), 0, 0.01, run + 1);
+                        result = run_plugin(search, region, settings, random);
+                    } else {
+                        const std::string name = region.name + "/" + strategy + "/" + std::to_string(window) + "/" + std::to_string(run);
+                        apex_ah_tuning_strategy apex_strategy = apex_ah_tuning_strategy::NELDER_MEAD;
+                        if(strategy == "EXHAUSTIVE") {
+                            apex_strategy = apex_ah_tuning_strategy::EXHAUSTIVE;
+                        } else if(strategy == "RANDOM") {
+                            apex_strategy = apex_ah_tuning_strategy::RANDOM;
+                        } else if(strategy == "PARALLEL_RANK_ORDER") {
+                            apex_strategy = apex_ah_tuning_strategy::PARALLEL_RANK_ORDER;
+                        }
+                        result = run_apex(apex_strategy, name, region, start, settings, random);
+                    }
+                    trials += result.trials;
+                    calls += result.calls;
+                    overhead += result.seconds - result.calls * region.optimum;
+                    gap += region.value(result.point) / region.optimum - 1.0;
+                }
+            }
+            const double count = static_cast<double>(runs) * regions.size();
+            printf("%-20s %6d %10.1f %10.1f %14.6f %10.2f\n", strategy.c_str(), window, trials / count, calls / count,
+                    overhead / runs, 100.0 * gap / count);
+        }
+    }
+
+    apex::finalize();
+    return 0;
+}
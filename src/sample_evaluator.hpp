@@ -0,0 +1,267 @@
+//  APEX OpenMP Policy
+//
+//  Copyright (c) 2015 University of Oregon
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+enum class sample_estimator {MEAN, MEDIAN, TRIMMED_MEAN};
+
+struct sample_evaluator_settings {
+    // A trial always takes at least min_samples and at most max_samples.
+    int min_samples = 3;
+    int max_samples = 16;
+    // Stop once the 95% confidence half-width is within this fraction of
+    // the estimate.
+    double precision = 0.05;
+    // Stop at min_samples if the trial is, even at its confidence bound,
+    // this fraction slower than the best trial seen so far.
+    double bad_margin = 0.5;
+    // Racing: stop before min_samples once the samples so far are
+    // significantly slower than that, judged with the incumbent's spread.
+    bool race = true;
+    // Successive halving of trial lengths (see successive_halving); 0 or 1
+    // turns it off.
+    int halving_eta = 2;
+    sample_estimator estimator = sample_estimator::MEDIAN;
+    // Fraction dropped from each end for TRIMMED_MEAN.
+    double trim = 0.2;
+};
+
+// Asynchronous successive halving of trial lengths. Rung k is reached at
+// min_samples * eta^k samples; a trial reaching a rung only goes on if its
+// estimate there is among the best 1/eta of those recorded at the same rung
+// by earlier trials (the first trials at a rung always go on). Promising
+// configs thus get the longer trials a precise estimate needs, while
+// mediocre ones stop early. One per search, shared by its trials.
+class successive_halving {
+    private:
+        std::vector<std::vector<double>> rungs;
+
+    public:
+        // The rung reached at count samples, or -1 if count is not a rung.
+        static int rung(int count, const sample_evaluator_settings & settings) {
+            if(settings.halving_eta < 2) {
+                return -1;
+            }
+            int size = settings.min_samples;
+            for(int k = 0; size <= count && size < settings.max_samples; ++k, size *= settings.halving_eta) {
+                if(size == count) {
+                    return k;
+                }
+            }
+            return -1;
+        }
+
+        // Records the estimate of a trial at the rung; returns true if the
+        // trial should go on.
+        bool promote(int rung, double value, int eta) {
+            if(static_cast<int>(rungs.size()) <= rung) {
+                rungs.resize(rung + 1);
+            }
+            std::vector<double> & earlier = rungs[rung];
+            size_t better = 0;
+            for(double other : earlier) {
+                if(other < value) {
+                    ++better;
+                }
+            }
+            const size_t kept = (earlier.size() + eta) / eta;
+            const bool promoted = earlier.size() < static_cast<size_t>(eta) || better < kept;
+            earlier.push_back(value);
+            return promoted;
+        }
+
+        void reset() {
+            rungs.clear();
+        }
+};
+
+// Keeps the per-invocation times of one trial (one point of the tuning
+// space) and decides when enough samples have been taken. The mean and
+// variance are kept with Welford's method; the robust estimators work on a
+// copy of the samples so adding a sample stays O(1).
+class sample_evaluator {
+    public:
+        enum { capacity = 64 };
+
+    private:
+        double samples[capacity];
+        int count;
+        double running_mean;
+        double m2;
+        // Set once the trial was not promoted at a rung (see record_rung).
+        bool demoted;
+
+        // Two-sided 95% Student t quantiles for 1..30 degrees of freedom.
+        static double t_quantile(int dof) {
+            static const double table[] = {
+                12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+                2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+                2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+            if(dof < 1) {
+                return std::numeric_limits<double>::infinity();
+            }
+            return dof <= 30 ? table[dof - 1] : 1.96;
+        }
+
+    public:
+        sample_evaluator() {
+            reset();
+        }
+
+        void reset() {
+            count = 0;
+            running_mean = 0.0;
+            m2 = 0.0;
+            demoted = false;
+        }
+
+        void add(double value) {
+            if(count < capacity) {
+                samples[count] = value;
+            } else {
+                // Overwrite the oldest sample; only happens if max_samples is
+                // larger than the capacity.
+                samples[count % capacity] = value;
+            }
+            ++count;
+            const double delta = value - running_mean;
+            running_mean += delta / count;
+            m2 += delta * (value - running_mean);
+        }
+
+        int size() const {
+            return count;
+        }
+
+        double mean() const {
+            return running_mean;
+        }
+
+        double variance() const {
+            return count > 1 ? m2 / (count - 1) : 0.0;
+        }
+
+        double estimate(const sample_evaluator_settings & settings) const {
+            const int n = std::min(count, static_cast<int>(capacity));
+            if(n == 0) {
+                return 0.0;
+            }
+            if(settings.estimator == sample_estimator::MEAN || n < 3) {
+                return running_mean;
+            }
+            double sorted[capacity];
+            std::copy(samples, samples + n, sorted);
+            if(settings.estimator == sample_estimator::MEDIAN) {
+                std::nth_element(sorted, sorted + n / 2, sorted + n);
+                const double upper = sorted[n / 2];
+                if(n % 2 == 1) {
+                    return upper;
+                }
+                return (upper + *std::max_element(sorted, sorted + n / 2)) / 2.0;
+            }
+            std::sort(sorted, sorted + n);
+            const int drop = static_cast<int>(settings.trim * n);
+            double sum = 0.0;
+            for(int i = drop; i < n - drop; ++i) {
+                sum += sorted[i];
+            }
+            return sum / (n - 2 * drop);
+        }
+
+        // Standard deviation estimated from the median absolute deviation,
+        // which a single outlier cannot inflate.
+        double robust_sigma() const {
+            const int n = std::min(count, static_cast<int>(capacity));
+            if(n < 3) {
+                return std::sqrt(variance());
+            }
+            double deviations[capacity];
+            std::copy(samples, samples + n, deviations);
+            std::nth_element(deviations, deviations + n / 2, deviations + n);
+            const double median = deviations[n / 2];
+            for(int i = 0; i < n; ++i) {
+                deviations[i] = std::fabs(samples[i] - median);
+            }
+            std::nth_element(deviations, deviations + n / 2, deviations + n);
+            return 1.4826 * deviations[n / 2];
+        }
+
+        // Half-width of the 95% confidence interval of the estimate. The
+        // robust estimators use the MAD-based spread; the median's standard
+        // error is about sqrt(pi/2) times the mean's.
+        double half_width(const sample_evaluator_settings & settings) const {
+            if(count < 2) {
+                return std::numeric_limits<double>::infinity();
+            }
+            double se;
+            if(settings.estimator == sample_estimator::MEAN) {
+                se = std::sqrt(variance() / count);
+            } else {
+                se = robust_sigma() / std::sqrt(static_cast<double>(count));
+                if(settings.estimator == sample_estimator::MEDIAN) {
+                    se *= 1.2533;
+                }
+            }
+            return t_quantile(count - 1) * se;
+        }
+
+        // Spread of the samples relative to the estimate, for racing later
+        // trials against this one.
+        double relative_spread(const sample_evaluator_settings & settings) const {
+            const double value = estimate(settings);
+            if(count < 2 || value <= 0.0) {
+                return 0.0;
+            }
+            const double sigma = settings.estimator == sample_estimator::MEAN ? std::sqrt(variance()) : robust_sigma();
+            return sigma / value;
+        }
+
+        // With successive halving, records the trial in halving if the
+        // sample just added reached a rung; a trial that is not promoted
+        // there is done. Call exactly once after each add().
+        void record_rung(const sample_evaluator_settings & settings, successive_halving & halving) {
+            const int rung = successive_halving::rung(count, settings);
+            if(rung >= 0 && !halving.promote(rung, estimate(settings), settings.halving_eta)) {
+                demoted = true;
+            }
+        }
+
+        // True once the trial has enough samples. incumbent is the best
+        // estimate of any earlier trial (or <= 0 if there is none) and
+        // incumbent_spread its relative_spread() (0 if unknown, which turns
+        // racing off).
+        bool done(const sample_evaluator_settings & settings, double incumbent, double incumbent_spread = 0.0) const {
+            if(count >= settings.max_samples) {
+                return true;
+            }
+            const double threshold = incumbent * (1.0 + settings.bad_margin);
+            if(count < settings.min_samples) {
+                if(!settings.race || incumbent <= 0.0 || incumbent_spread <= 0.0 || count == 0) {
+                    return false;
+                }
+                // One-sided test at about 99%, with the incumbent's spread
+                // (at least 5%) standing in for this trial's.
+                const double sigma = std::max(incumbent_spread, 0.05) * incumbent;
+                return estimate(settings) - threshold > 2.33 * sigma / std::sqrt(static_cast<double>(count));
+            }
+            const double value = estimate(settings);
+            const double width = half_width(settings);
+            if(width <= settings.precision * value) {
+                return true;
+            }
+            if(incumbent > 0.0 && count >= 2 && value - width > threshold) {
+                // Clearly worse than the best known point; not worth refining.
+                return true;
+            }
+            return demoted;
+        }
+};
@@ -0,0 +1,41 @@
+//  APEX OpenMP Policy
+//
+//  Copyright (c) 2015 University of Oregon
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+
+#include "search.hpp"
+
+int search_index_of(const search_dimension & dimension, const std::string & value) {
+    for(size_t i = 0; i < dimension.values.size(); ++i) {
+        if(dimension.values[i] == value) {
+            return static_cast<int>(i);
+        }
+    }
+    // Numeric dimensions: the closest value.
+    char * end = nullptr;
+    const double target = strtod(value.c_str(), &end);
+    if(end == value.c_str()) {
+        return -1;
+    }
+    int closest = -1;
+    double closest_distance = std::numeric_limits<double>::infinity();
+    for(size_t i = 0; i < dimension.values.size(); ++i) {
+        const char * text = dimension.values[i].c_str();
+        const double candidate = strtod(text, &end);
+        if(end == text) {
+            continue;
+        }
+        const double distance = std::fabs(candidate - target);
+        if(distance < closest_distance) {
+            closest_distance = distance;
+            closest = static_cast<int>(i);
+        }
+    }
+    return closest;
+}
@@ -0,0 +1,53 @@
+//  APEX OpenMP Policy
+//
+//  Copyright (c) 2015 University of Oregon
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+
+// One tunable parameter and its possible values, in the same string form
+// the APEX tuning requests use.
+struct search_dimension {
+    std::string name;
+    std::vector<std::string> values;
+};
+
+typedef std::vector<search_dimension> search_space;
+
+// A point in a search_space: one value index per dimension.
+typedef std::vector<int> search_point;
+
+// Maps a point to its canonical form, or returns false if the point must
+// not be measured (see tuning_space::normalize).
+typedef std::function<bool(search_point &)> search_filter;
+
+// Returns the index of value in the dimension, or for numeric dimensions
+// the index of the closest value; -1 if there is no sensible match.
+int search_index_of(const search_dimension & dimension, const std::string & value);
+
+// A search strategy implemented inside the plugin, as opposed to the APEX
+// strategies driven through apex_tuning_request. The policy measures
+// current(), reports the result, and moves on to the new current() until
+// the strategy has converged, after which best() is kept. Strategies are
+// not thread-safe; the policy calls them with the region lock held.
+class search_strategy {
+    public:
+        virtual ~search_strategy() {}
+        // The point to measure next.
+        virtual const search_point & current() const = 0;
+        // Reports the measured value (lower is better) of current().
+        virtual void report(double value) = 0;
+        // Moves on without measuring current(), for points the policy
+        // rules out after the strategy proposed them. Unlike reporting a
+        // made-up value, this leaves the strategy's model untouched.
+        virtual void skip() = 0;
+        virtual bool converged() const = 0;
+        // The best point measured so far (current() before any report).
+        virtual const search_point & best() const = 0;
+};
@@ -0,0 +1,213 @@
+//  Copyright (c) 2015 University of Oregon
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Compares the plugin-side search strategies with the APEX ones on
+// synthetic models of parallel loops, reporting the trials each needs and
+// how close its result is to the exhaustive optimum. Run it without the
+// policy plugin loaded:
+//
+//   search_benchmark [runs per model] [noise]
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "apex_api.hpp"
+#include "apex_policies.hpp"
+
+#include "search.hpp"
+#include "neighborhood_search.hpp"
+#include "bayesian_search.hpp"
+
+// A modeled machine with 32 cores and 2-way SMT.
+static const int cores = 32;
+
+typedef std::function<double(int threads, const std::string & schedule, int chunk)> loop_model;
+
+// Time of a loop of n iterations where iteration i costs cost(i), given
+// round-robin static chunks or dynamically handed out chunks.
+static double loop_time(int threads, const std::string & schedule, int chunk, long n,
+        const std::function<double(long)> & cost, double dispatch) {
+    const double oversubscribed = threads > cores ? 1.25 : 1.0;
+    const int workers = std::min(threads, 2 * cores);
+    const double fork = 2e-6 * threads;
+    double total = 0.0;
+    std::vector<double> load(workers, 0.0);
+    long chunks = 0;
+    long start = 0;
+    long size = chunk;
+    while(start < n) {
+        if(schedule == "guided") {
+            size = std::max<long>(chunk, (n - start) / (2 * workers));
+        }
+        const long end = std::min(n, start + size);
+        const double work = (cost(start) + cost(end - 1)) * 0.5 * (end - start);
+        total += work;
+        if(schedule == "static") {
+            load[chunks % workers] += work;
+        } else {
+            // The least loaded worker takes the next chunk.
+            *std::min_element(load.begin(), load.end()) += work + dispatch * (1.0 + 0.02 * workers);
+        }
+        ++chunks;
+        start = end;
+    }
+    return *std::max_element(load.begin(), load.end()) * oversubscribed + fork;
+}
+
+static std::vector<std::pair<std::string, loop_model>> make_models() {
+    std::vector<std::pair<std::string, loop_model>> models;
+    models.emplace_back("uniform", [](int threads, const std::string & schedule, int chunk) {
+        return loop_time(threads, schedule, chunk, 200000, [](long) { return 5e-8; }, 1e-7);
+    });
+    models.emplace_back("triangular", [](int threads, const std::string & schedule, int chunk) {
+        const long n = 200000;
+        return loop_time(threads, schedule, chunk, n, [n](long i) { return 1e-7 * i / n; }, 1e-7);
+    });
+    models.emplace_back("bandwidth", [](int threads, const std::string & schedule, int chunk) {
+        // Memory bandwidth saturates at 12 cores; small dynamic chunks lose
+        // locality.
+        const double compute = loop_time(threads, schedule, chunk, 200000, [](long) { return 2e-8; }, 1e-7);
+        const double memory = 200000 * 6e-8 / std::min(threads, 12);
+        const double locality = (schedule != "static" && chunk < 64) ? 1.3 : 1.0;
+        return std::max(compute, memory) * locality + 1e-6 * threads;
+    });
+    return models;
+}
+
+static search_space make_space() {
+    search_space space(3);
+    space[0].name = "omp_num_threads";
+    space[0].values = {"1", "2", "4", "8", "12", "16", "24", "32", "48", "64"};
+    space[1].name = "omp_schedule";
+    space[1].values = {"static", "dynamic", "guided"};
+    space[2].name = "omp_chunk_size";
+    space[2].values = {"1", "8", "32", "64", "128", "256", "512"};
+    return space;
+}
+
+static double evaluate(const loop_model & model, const search_space & space, const search_point & point) {
+    return model(atoi(space[0].values[point[0]].c_str()), space[1].values[point[1]], atoi(space[2].values[point[2]].c_str()));
+}
+
+struct run_result {
+    size_t trials;
+    double value;
+};
+
+static run_result run_plugin(search_strategy & search, const loop_model & model, const search_space & space,
+        std::function<double()> noise) {
+    size_t trials = 0;
+    while(!search.converged() && trials < 10000) {
+        search.report(evaluate(model, space, search.current()) * noise());
+        ++trials;
+    }
+    return run_result{trials, evaluate(model, space, search.best())};
+}
+
+static run_result run_apex(apex_ah_tuning_strategy strategy, const std::string & name, const loop_model & model,
+        const search_space & space, std::function<double()> noise) {
+    apex_tuning_request request(name);
+    request.set_trigger(apex::register_custom_event(name));
+    request.set_strategy(strategy);
+    for(const search_dimension & dimension : space) {
+        const std::list<std::string> values(dimension.values.begin(), dimension.values.end());
+        request.add_param_enum(dimension.name, dimension.values[dimension.values.size() / 2], values);
+    }
+    auto current = [&]() {
+        search_point point(space.size());
+        for(size_t d = 0; d < space.size(); ++d) {
+            const std::string value = std::static_pointer_cast<apex_param_enum>(request.get_param(space[d].name))->get_value();
+            point[d] = search_index_of(space[d], value);
+        }
+        return point;
+    };
+    size_t trials = 0;
+    request.set_metric([&]() {
+        ++trials;
+        return evaluate(model, space, current()) * noise();
+    });
+    apex::setup_custom_tuning(request);
+    while(!request.has_converged() && trials < 10000) {
+        apex::custom_event(request.get_trigger(), NULL);
+    }
+    return run_result{trials, evaluate(model, space, current())};
+}
+
+int main (int argc, char *argv[]) {
+    int runs = 10;
+    double noise_level = 0.02;
+    if (argc > 3) {
+        std::cout << "Usage: " << argv[0] << " [runs per model] [noise]" << std::endl;
+        exit(0);
+    }
+    if (argc > 1) {
+        runs = atoi(argv[1]);
+    }
+    if (argc > 2) {
+        noise_level = atof(argv[2]);
+    }
+
+    apex::init("search_benchmark", 0, 1);
+
+    const search_space space = make_space();
+    const search_point start{5, 0, 3};
+    const std::vector<std::string> strategies{"BAYESIAN", "NEIGHBORHOOD", "NELDER_MEAD", "EXHAUSTIVE", "RANDOM", "PARALLEL_RANK_ORDER"};
+    printf("%-12s %-20s %8s %10s %10s\n", "model", "strategy", "trials", "gap %", "within 5%");
+    for(const auto & model : make_models()) {
+        // The exhaustive optimum without noise.
+        double optimum = std::numeric_limits<double>::infinity();
+        search_point point(space.size(), 0);
+        for(point[0] = 0; point[0] < static_cast<int>(space[0].values.size()); ++point[0]) {
+            for(point[1] = 0; point[1] < static_cast<int>(space[1].values.size()); ++point[1]) {
+                for(point[2] = 0; point[2] < static_cast<int>(space[2].values.size()); ++point[2]) {
+                    optimum = std::min(optimum, evaluate(model.second, space, point));
+                }
+            }
+        }
+        for(const std::string & strategy : strategies) {
+            double trials = 0.0;
+            double gap = 0.0;
+            int within = 0;
+            for(int run = 0; run < runs; ++run) {
+                std::mt19937 random(run + 1);
+                std::lognormal_distribution<double> distribution(0.0, noise_level);
+                std::function<double()> noise = [&]() { return distribution(random); };
+                run_result result;
+                const std::string name = model.first + "/" + strategy + "/" + std::to_string(run);
+                if(strategy == "BAYESIAN") {
+                    bayesian_search search(space, start, search_filter(), 0, 0.01, run + 1);
+                    result = run_plugin(search, model.second, space, noise);
+                } else if(strategy == "NEIGHBORHOOD") {
+                    neighborhood_search search(space, start, 2, 0.0, 0.0);
+                    result = run_plugin(search, model.second, space, noise);
+                } else if(strategy == "NELDER_MEAD") {
+                    result = run_apex(apex_ah_tuning_strategy::NELDER_MEAD, name, model.second, space, noise);
+                } else if(strategy == "EXHAUSTIVE") {
+                    result = run_apex(apex_ah_tuning_strategy::EXHAUSTIVE, name, model.second, space, noise);
+                } else if(strategy == "RANDOM") {
+                    result = run_apex(apex_ah_tuning_strategy::RANDOM, name, model.second, space, noise);
+                } else {
+                    result = run_apex(apex_ah_tuning_strategy::PARALLEL_RANK_ORDER, name, model.second, space, noise);
+                }
+                trials += result.trials;
+                gap += result.value / optimum - 1.0;
+                within += (result.value <= optimum * 1.05) ? 1 : 0;
+            }
+            printf("%-12s %-20s %8.1f %10.2f %9d/%d\n", model.first.c_str(), strategy.c_str(), trials / runs,
+                    100.0 * gap / runs, within, runs);
+        }
+    }
+
+    apex::finalize();
+    return 0;
+}
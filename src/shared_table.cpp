@@ -0,0 +1,282 @@
+//  APEX OpenMP Policy
+//
+//  Copyright (c) 2015 University of Oregon
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <limits>
+#include <cstring>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "shared_table.hpp"
+#include "history.hpp"
+
+static const size_t shared_table_size = sizeof(shared_table_header) + shared_region_slots * sizeof(shared_region_slot);
+
+static uint64_t double_bits(double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static double bits_double(uint64_t bits) {
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static int64_t steady_now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Mixes a key so that neighboring points spread over the table.
+static uint32_t point_bucket(uint64_t key) {
+    key ^= key >> 33;
+    key *= UINT64_C(0xff51afd7ed558ccd);
+    key ^= key >> 33;
+    return static_cast<uint32_t>(key) & (shared_point_slots - 1);
+}
+
+shared_claim shared_region_slot::claim(uint64_t key, int64_t timeout_ns, double & value) {
+    for(uint32_t b = point_bucket(key), probes = 0; probes < shared_point_slots; b = (b + 1) & (shared_point_slots - 1), ++probes) {
+        shared_point_slot & slot = points[b];
+        uint64_t found = slot.key.load(std::memory_order_acquire);
+        if(found == 0) {
+            if(slot.key.compare_exchange_strong(found, key, std::memory_order_acq_rel)) {
+                slot.claimed.store(steady_now(), std::memory_order_release);
+                return shared_claim::CLAIMED;
+            }
+        }
+        if(found != key) {
+            continue;
+        }
+        if(slot.measured.load(std::memory_order_acquire) != 0) {
+            value = bits_double(slot.value.load(std::memory_order_relaxed));
+            return shared_claim::MEASURED;
+        }
+        // A claim time of 0 is a claim still being written.
+        int64_t claimed = slot.claimed.load(std::memory_order_acquire);
+        const int64_t now = steady_now();
+        if(claimed != 0 && now - claimed > timeout_ns && slot.claimed.compare_exchange_strong(claimed, now)) {
+            return shared_claim::CLAIMED;
+        }
+        return shared_claim::BUSY;
+    }
+    return shared_claim::CLAIMED;
+}
+
+void shared_region_slot::publish(uint64_t key, double value) {
+    for(uint32_t b = point_bucket(key), probes = 0; probes < shared_point_slots; b = (b + 1) & (shared_point_slots - 1), ++probes) {
+        shared_point_slot & slot = points[b];
+        uint64_t found = slot.key.load(std::memory_order_acquire);
+        // A failed exchange leaves the key that won in found.
+        if(found == 0 && slot.key.compare_exchange_strong(found, key, std::memory_order_acq_rel)) {
+            found = key;
+        }
+        if(found == key) {
+            slot.value.store(double_bits(value), std::memory_order_relaxed);
+            slot.measured.store(1, std::memory_order_release);
+            return;
+        }
+    }
+}
+
+void shared_region_slot::for_each_measured(const std::function<void(uint64_t, double)> & fn) const {
+    for(const shared_point_slot & slot : points) {
+        const uint64_t key = slot.key.load(std::memory_order_acquire);
+        if(key != 0 && slot.measured.load(std::memory_order_acquire) != 0) {
+            fn(key, bits_double(slot.value.load(std::memory_order_relaxed)));
+        }
+    }
+}
+
+bool shared_region_slot::converge() {
+    uint64_t key = 0;
+    double value = std::numeric_limits<double>::infinity();
+    for_each_measured([&](uint64_t measured_key, double measured_value) {
+        if(measured_value < value) {
+            key = measured_key;
+            value = measured_value;
+        }
+    });
+    if(key == 0) {
+        return false;
+    }
+    // Claim the right to write the result, then publish it.
+    uint32_t expected = 0;
+    if(converged.compare_exchange_strong(expected, 1, std::memory_order_acq_rel)) {
+        best_key.store(key, std::memory_order_relaxed);
+        best_value.store(double_bits(value), std::memory_order_relaxed);
+        converged.store(2, std::memory_order_release);
+    }
+    return true;
+}
+
+bool shared_region_slot::converged_on(uint64_t & key, double & value) const {
+    if(converged.load(std::memory_order_acquire) != 2) {
+        return false;
+    }
+    key = best_key.load(std::memory_order_relaxed);
+    value = bits_double(best_value.load(std::memory_order_relaxed));
+    return true;
+}
+
+shared_table::shared_table() : fd(-1), base(nullptr), size(0) {
+}
+
+shared_table::~shared_table() {
+    close();
+}
+
+bool shared_table::open(const std::string & name) {
+    close();
+    const std::string path = name.empty() || name[0] != '/' ? "/" + name : name;
+    bool created = true;
+    fd = shm_open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if(fd < 0 && errno == EEXIST) {
+        created = false;
+        fd = shm_open(path.c_str(), O_RDWR, 0600);
+    }
+    if(fd < 0) {
+        std::cerr << "Unable to open shared memory segment " << path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    if(created && ftruncate(fd, shared_table_size) != 0) {
+        std::cerr << "Unable to size shared memory segment " << path << ": " << strerror(errno) << std::endl;
+        close();
+        shm_unlink(path.c_str());
+        return false;
+    }
+    // Another process may have just created the segment; give it a moment
+    // to size and initialize it.
+    struct stat st;
+    for(int attempt = 0; !created && attempt < 1000; ++attempt) {
+        if(fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= shared_table_size) {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    if(fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) != shared_table_size) {
+        std::cerr << "Shared memory segment " << path << " has the wrong size; remove it or use another name" << std::endl;
+        close();
+        return false;
+    }
+    base = mmap(nullptr, shared_table_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(base == MAP_FAILED) {
+        std::cerr << "Unable to map shared memory segment " << path << std::endl;
+        base = nullptr;
+        close();
+        return false;
+    }
+    size = shared_table_size;
+    // The segment starts zeroed, so only the header needs writing.
+    shared_table_header * header = static_cast<shared_table_header *>(base);
+    if(created) {
+        memcpy(header->magic, shared_magic, sizeof(shared_magic));
+        header->version = shared_version;
+        header->region_slots = shared_region_slots;
+        header->point_slots = shared_point_slots;
+        header->ready.store(1, std::memory_order_release);
+    }
+    for(int attempt = 0; attempt < 1000 && header->ready.load(std::memory_order_acquire) == 0; ++attempt) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    if(header->ready.load(std::memory_order_acquire) == 0 || memcmp(header->magic, shared_magic, sizeof(shared_magic)) != 0
+            || header->version != shared_version || header->region_slots != shared_region_slots
+            || header->point_slots != shared_point_slots) {
+        std::cerr << "Shared memory segment " << path << " is not a tuning table of this version; remove it or use another name" << std::endl;
+        close();
+        return false;
+    }
+    header->processes.fetch_add(1);
+    return true;
+}
+
+void shared_table::close() {
+    if(base != nullptr) {
+        munmap(base, size);
+    }
+    if(fd >= 0) {
+        ::close(fd);
+    }
+    base = nullptr;
+    size = 0;
+    fd = -1;
+}
+
+bool shared_table::is_open() const {
+    return base != nullptr;
+}
+
+shared_region_slot * shared_table::region(const std::string & name, uint64_t space_hash) {
+    if(base == nullptr) {
+        return nullptr;
+    }
+    uint64_t hash = history_hash(name.data(), name.size()) ^ space_hash;
+    if(hash == 0) {
+        hash = 1;
+    }
+    shared_region_slot * regions = reinterpret_cast<shared_region_slot *>(static_cast<char *>(base) + sizeof(shared_table_header));
+    for(uint32_t b = hash & (shared_region_slots - 1), probes = 0; probes < shared_region_slots;
+            b = (b + 1) & (shared_region_slots - 1), ++probes) {
+        shared_region_slot & slot = regions[b];
+        uint64_t found = slot.hash.load(std::memory_order_acquire);
+        if(found == 0 && slot.hash.compare_exchange_strong(found, hash, std::memory_order_acq_rel)) {
+            // The name is only for people inspecting the segment.
+            strncpy(slot.name, name.c_str(), shared_name_length - 1);
+            return &slot;
+        }
+        if(found == hash) {
+            return &slot;
+        }
+    }
+    return nullptr;
+}
+
+uint32_t shared_table::processes() const {
+    return base == nullptr ? 0 : static_cast<const shared_table_header *>(base)->processes.load();
+}
+
+uint64_t shared_space_hash(const search_space & space) {
+    std::string signature;
+    for(const search_dimension & dimension : space) {
+        signature += dimension.name + "=";
+        for(const std::string & value : dimension.values) {
+            signature += value + ",";
+        }
+        signature += ";";
+    }
+    return history_hash(signature.data(), signature.size());
+}
+
+uint64_t shared_point_key(const search_space & space, const search_point & point) {
+    uint64_t key = 0;
+    for(size_t d = space.size(); d-- > 0;) {
+        const uint64_t radix = space[d].values.size();
+        if(key > (std::numeric_limits<uint64_t>::max() - 1 - point[d]) / radix) {
+            return 0;
+        }
+        key = key * radix + point[d];
+    }
+    return key + 1;
+}
+
+search_point shared_point(const search_space & space, uint64_t key) {
+    search_point point(space.size(), 0);
+    key -= 1;
+    for(size_t d = 0; d < space.size(); ++d) {
+        const uint64_t radix = space[d].values.size();
+        point[d] = static_cast<int>(key % radix);
+        key /= radix;
+    }
+    return point;
+}
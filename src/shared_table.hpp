@@ -0,0 +1,110 @@
+//  APEX OpenMP Policy
+//
+//  Copyright (c) 2015 University of Oregon
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <functional>
+
+#include "search.hpp"
+
+// Table of tuning results shared by the processes of a node
+// (APEX_OPENMP_SHARED), in a POSIX shared memory segment:
+//
+//   shared_table_header
+//   shared_region_slot[shared_region_slots]
+//
+// Regions are found by a hash of their name and search space, points by a
+// key encoding their indices (shared_point_key), both with open addressing
+// and linear probing. Slots are only ever added, with a compare-and-swap
+// on the key, so no locks are needed. The segment outlives the processes
+// using it, so a later job on the node starts from what earlier ones
+// measured; remove it (rm /dev/shm/<name>) to start over.
+static const char shared_magic[8] = {'A', 'P', 'X', 'O', 'M', 'P', 'S', '\0'};
+static const uint32_t shared_version = 1;
+static const uint32_t shared_region_slots = 256;
+static const uint32_t shared_point_slots = 512;
+static const size_t shared_name_length = 232;
+
+struct shared_table_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t region_slots;
+    uint32_t point_slots;
+    std::atomic<uint32_t> ready;
+    std::atomic<uint32_t> processes;
+};
+
+// What claim() found for a point.
+enum class shared_claim {
+    CLAIMED,  // the caller should measure it
+    MEASURED, // another process already has; value is set
+    BUSY      // another process is measuring it
+};
+
+// One point of a region. value holds the bits of a double once measured.
+struct shared_point_slot {
+    std::atomic<uint64_t> key;
+    std::atomic<uint64_t> value;
+    std::atomic<int64_t> claimed;   // steady clock nanoseconds
+    std::atomic<uint32_t> measured;
+};
+
+struct shared_region_slot {
+    std::atomic<uint64_t> hash;
+    std::atomic<uint32_t> converged;
+    std::atomic<uint64_t> best_key;
+    std::atomic<uint64_t> best_value;
+    char name[shared_name_length];
+    shared_point_slot points[shared_point_slots];
+
+    // Claims a point for measurement. Claims older than timeout_ns are
+    // taken to belong to a process that died and can be claimed again.
+    // A full table claims every point, without sharing it.
+    shared_claim claim(uint64_t key, int64_t timeout_ns, double & value);
+    void publish(uint64_t key, double value);
+    // Calls fn with every point measured so far.
+    void for_each_measured(const std::function<void(uint64_t, double)> & fn) const;
+    // Marks the region converged on the best point measured, unless another
+    // process did first. Returns false if nothing was measured.
+    bool converge();
+    // The point the region converged on, if it has.
+    bool converged_on(uint64_t & key, double & value) const;
+};
+
+class shared_table {
+    private:
+        int fd;
+        void * base;
+        size_t size;
+
+    public:
+        shared_table();
+        ~shared_table();
+        shared_table(const shared_table &) = delete;
+        shared_table & operator=(const shared_table &) = delete;
+
+        // Attaches to the named segment, creating it if needed.
+        bool open(const std::string & name);
+        void close();
+        bool is_open() const;
+        // The region's slot, added if needed; nullptr if the table is full.
+        shared_region_slot * region(const std::string & name, uint64_t space_hash);
+        // Processes that have attached since the segment was created.
+        uint32_t processes() const;
+};
+
+// Identifies a space, so processes tuning the same region over different
+// spaces do not mix their results.
+uint64_t shared_space_hash(const search_space & space);
+// 1 + the point's index in the space in mixed radix, or 0 if that does
+// not fit in 64 bits (only possible in spaces of more than 2^64 points).
+uint64_t shared_point_key(const search_space & space, const search_point & point);
+search_point shared_point(const search_space & space, uint64_t key);
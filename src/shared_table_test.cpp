@@ -0,0 +1,113 @@
+//  Copyright (c) 2015 University of Oregon
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// The node-wide table of APEX_OPENMP_SHARED: point keys encode and decode
+// every point of a space, a claimed point is busy for other processes
+// until it is measured or its claim times out, and a second attachment
+// sees what the first published.
+//
+//   shared_table_test
+//
+#undef NDEBUG
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <set>
+#include <string>
+#include <thread>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "shared_table.hpp"
+
+static search_dimension make_dimension(const std::string & name, size_t count) {
+    search_dimension dimension;
+    dimension.name = name;
+    for(size_t i = 0; i < count; ++i) {
+        dimension.values.push_back(std::to_string(i));
+    }
+    return dimension;
+}
+
+int main () {
+    search_space space = {make_dimension("omp_num_threads", 3), make_dimension("omp_schedule", 4), make_dimension("omp_chunk_size", 5)};
+
+    // Every point has its own nonzero key, which decodes back to it.
+    std::set<uint64_t> keys;
+    search_point point(space.size(), 0);
+    for(point[0] = 0; point[0] < 3; ++point[0]) {
+        for(point[1] = 0; point[1] < 4; ++point[1]) {
+            for(point[2] = 0; point[2] < 5; ++point[2]) {
+                const uint64_t key = shared_point_key(space, point);
+                assert(key != 0 && key <= 3 * 4 * 5);
+                assert(shared_point(space, key) == point);
+                keys.insert(key);
+            }
+        }
+    }
+    assert(keys.size() == 3 * 4 * 5);
+    // In a space with more points than a key can number, the points past
+    // the last key have none.
+    search_space huge;
+    for(int d = 0; d < 8; ++d) {
+        huge.push_back(make_dimension("d" + std::to_string(d), 1 << 9));
+    }
+    assert(shared_point_key(huge, search_point(huge.size(), (1 << 9) - 1)) == 0);
+    // Different spaces do not share results.
+    search_space smaller = space;
+    smaller[2].values.pop_back();
+    assert(shared_space_hash(space) != shared_space_hash(smaller));
+
+    const std::string name = "/apex_openmp_shared_test." + std::to_string(getpid());
+    shm_unlink(name.c_str());
+    shared_table table;
+    assert(table.open(name));
+    assert(table.processes() == 1);
+    shared_region_slot * region = table.region("OpenMP_PARALLEL_REGION: a.cpp:1", shared_space_hash(space));
+    assert(region != nullptr);
+    assert(table.region("OpenMP_PARALLEL_REGION: a.cpp:1", shared_space_hash(space)) == region);
+    assert(table.region("OpenMP_PARALLEL_REGION: a.cpp:1", shared_space_hash(smaller)) != region);
+
+    const int64_t hour = INT64_C(3600000000000);
+    const uint64_t key = shared_point_key(space, {1, 2, 3});
+    double value = 0.0;
+    assert(region->claim(key, hour, value) == shared_claim::CLAIMED);
+    assert(region->claim(key, hour, value) == shared_claim::BUSY);
+    uint64_t best_key = 0;
+    assert(!region->converge());
+    assert(!region->converged_on(best_key, value));
+    // A claim older than the timeout is taken over, as if its process died.
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    assert(region->claim(key, 1000000, value) == shared_claim::CLAIMED);
+    assert(region->claim(key, 1000000, value) == shared_claim::BUSY);
+    region->publish(key, 0.5);
+    assert(region->claim(key, 0, value) == shared_claim::MEASURED && value == 0.5);
+    const uint64_t other = shared_point_key(space, {2, 0, 0});
+    region->publish(other, 0.25);
+
+    // A second attachment finds the region and its results.
+    {
+        shared_table second;
+        assert(second.open(name));
+        assert(second.processes() == 2);
+        shared_region_slot * same = second.region("OpenMP_PARALLEL_REGION: a.cpp:1", shared_space_hash(space));
+        assert(same != nullptr);
+        size_t measured = 0;
+        same->for_each_measured([&](uint64_t measured_key, double measured_value) {
+            assert((measured_key == key && measured_value == 0.5) || (measured_key == other && measured_value == 0.25));
+            ++measured;
+        });
+        assert(measured == 2);
+        assert(same->converge());
+    }
+    assert(region->converged_on(best_key, value));
+    assert(best_key == other && value == 0.25);
+
+    table.close();
+    assert(!table.is_open());
+    shm_unlink(name.c_str());
+    std::cerr << "Test passed." << std::endl;
+    return 0;
+}
@@ -0,0 +1,202 @@
+//  APEX OpenMP Policy
+//
+//  Copyright (c) 2015 University of Oregon
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include <fstream>
+#include <map>
+#include <utility>
+#include <algorithm>
+#include <iterator>
+#include <cstdlib>
+#include <sched.h>
+#include <unistd.h>
+
+#include "topology.hpp"
+
+std::set<int> parse_cpu_list(const std::string & list) {
+    std::set<int> cpus;
+    size_t position = 0;
+    while(position < list.size()) {
+        size_t end = list.find(',', position);
+        if(end == std::string::npos) {
+            end = list.size();
+        }
+        const std::string range = list.substr(position, end - position);
+        position = end + 1;
+        if(range.find_first_of("0123456789") == std::string::npos) {
+            continue;
+        }
+        const size_t dash = range.find('-');
+        const int first = atoi(range.c_str());
+        const int last = dash == std::string::npos ? first : atoi(range.c_str() + dash + 1);
+        for(int cpu = first; cpu <= last; ++cpu) {
+            cpus.insert(cpu);
+        }
+    }
+    return cpus;
+}
+
+static bool read_line(const std::string & filename, std::string & line) {
+    std::ifstream file(filename);
+    return file.good() && std::getline(file, line) && !line.empty();
+}
+
+static int read_int(const std::string & filename, int fallback) {
+    std::string line;
+    if(!read_line(filename, line)) {
+        return fallback;
+    }
+    return atoi(line.c_str());
+}
+
+static std::set<int> affinity_cpus() {
+    std::set<int> cpus;
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    if(sched_getaffinity(0, sizeof(mask), &mask) == 0) {
+        for(int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if(CPU_ISSET(cpu, &mask)) {
+                cpus.insert(cpu);
+            }
+        }
+    }
+    if(cpus.empty()) {
+        const long online = sysconf(_SC_NPROCESSORS_ONLN);
+        for(long cpu = 0; cpu < std::max(1L, online); ++cpu) {
+            cpus.insert(static_cast<int>(cpu));
+        }
+    }
+    return cpus;
+}
+
+// The cgroup's cpuset, or an empty set if there is none.
+static std::set<int> cgroup_cpus() {
+    std::string line;
+    if(read_line("/sys/fs/cgroup/cpuset.cpus.effective", line)
+            || read_line("/sys/fs/cgroup/cpuset/cpuset.effective_cpus", line)
+            || read_line("/sys/fs/cgroup/cpuset/cpuset.cpus", line)) {
+        return parse_cpu_list(line);
+    }
+    return std::set<int>();
+}
+
+// The number of CPUs the cgroup's CPU quota allows, or 0 if unlimited.
+static int cgroup_cpu_limit() {
+    std::string line;
+    long long quota = -1;
+    long long period = 0;
+    if(read_line("/sys/fs/cgroup/cpu.max", line)) {
+        // "max 100000" or "<quota> <period>"
+        if(line.compare(0, 3, "max") != 0) {
+            quota = atoll(line.c_str());
+            const size_t space = line.find(' ');
+            period = space == std::string::npos ? 0 : atoll(line.c_str() + space + 1);
+        }
+    } else if(read_line("/sys/fs/cgroup/cpu/cpu.cfs_quota_us", line)) {
+        quota = atoll(line.c_str());
+        period = read_int("/sys/fs/cgroup/cpu/cpu.cfs_period_us", 0);
+    }
+    if(quota <= 0 || period <= 0) {
+        return 0;
+    }
+    return static_cast<int>((quota + period - 1) / period);
+}
+
+static int most(const std::map<int, std::set<std::pair<int, int>>> & cores_by_domain) {
+    size_t result = 1;
+    for(const auto & domain : cores_by_domain) {
+        result = std::max(result, domain.second.size());
+    }
+    return static_cast<int>(result);
+}
+
+cpu_topology read_topology() {
+    std::set<int> cpus = affinity_cpus();
+    const std::set<int> cpuset = cgroup_cpus();
+    if(!cpuset.empty()) {
+        std::set<int> both;
+        std::set_intersection(cpus.begin(), cpus.end(), cpuset.begin(), cpuset.end(), std::inserter(both, both.begin()));
+        if(!both.empty()) {
+            cpus.swap(both);
+        }
+    }
+
+    // CPU -> NUMA node.
+    std::map<int, int> node_of;
+    std::string nodes;
+    if(read_line("/sys/devices/system/node/online", nodes)) {
+        for(int node : parse_cpu_list(nodes)) {
+            std::string line;
+            if(read_line("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist", line)) {
+                for(int cpu : parse_cpu_list(line)) {
+                    node_of[cpu] = node;
+                }
+            }
+        }
+    }
+
+    // Cores are identified by (package, core id).
+    std::set<std::pair<int, int>> cores;
+    std::map<int, std::set<std::pair<int, int>>> cores_by_socket;
+    std::map<int, std::set<std::pair<int, int>>> cores_by_node;
+    for(int cpu : cpus) {
+        const std::string base = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/";
+        const int package = read_int(base + "physical_package_id", 0);
+        const int core_id = read_int(base + "core_id", cpu);
+        const std::pair<int, int> core(package, core_id);
+        cores.insert(core);
+        cores_by_socket[package].insert(core);
+        const auto node = node_of.find(cpu);
+        cores_by_node[node == node_of.end() ? 0 : node->second].insert(core);
+    }
+
+    cpu_topology topology;
+    topology.cpus = std::max<int>(1, cpus.size());
+    topology.cores = std::max<int>(1, cores.size());
+    topology.sockets = std::max<int>(1, cores_by_socket.size());
+    topology.numa_nodes = std::max<int>(1, cores_by_node.size());
+    topology.cores_per_socket = most(cores_by_socket);
+    topology.cores_per_numa_node = most(cores_by_node);
+    topology.core_limit = topology.cores;
+    const int limit = cgroup_cpu_limit();
+    if(limit > 0) {
+        topology.core_limit = std::min(topology.core_limit, limit);
+    }
+    return topology;
+}
+
+// Adds the multiples of a socket or NUMA node size up to cap. Domains of
+// one core (common on VMs) would add every count, and a single domain
+// below cap adds nothing that cap does not.
+static void add_domain_multiples(std::set<int> & counts, int domain, int cap) {
+    if(domain <= 1 || 2 * domain > cap) {
+        return;
+    }
+    for(int count = domain; count <= cap; count += domain) {
+        counts.insert(count);
+    }
+}
+
+std::list<std::string> topology_thread_space(const cpu_topology & topology) {
+    const int cap = std::max(1, topology.core_limit);
+    std::set<int> counts;
+    for(int count = 2; count <= cap; count *= 2) {
+        counts.insert(count);
+    }
+    add_domain_multiples(counts, topology.cores_per_numa_node, cap);
+    add_domain_multiples(counts, topology.cores_per_socket, cap);
+    counts.insert(cap);
+    // Oversubscribing cores with SMT siblings only makes sense when the
+    // quota does not already limit us to fewer CPUs than cores.
+    if(topology.cpus > topology.cores && cap == topology.cores) {
+        counts.insert(topology.cpus);
+    }
+    std::list<std::string> space;
+    for(int count : counts) {
+        space.push_back(std::to_string(count));
+    }
+    return space;
+}
@@ -0,0 +1,41 @@
+//  APEX OpenMP Policy
+//
+//  Copyright (c) 2015 University of Oregon
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <list>
+#include <set>
+#include <string>
+
+// The part of the machine this process may run on.
+struct cpu_topology {
+    // Hardware threads in the affinity mask and cgroup cpuset.
+    int cpus = 1;
+    // Physical cores those hardware threads belong to.
+    int cores = 1;
+    // Cores capped by the cgroup CPU quota, if any.
+    int core_limit = 1;
+    int sockets = 1;
+    int numa_nodes = 1;
+    // Usable cores on the fullest socket and NUMA node.
+    int cores_per_socket = 1;
+    int cores_per_numa_node = 1;
+};
+
+// Parses a Linux CPU list such as "0-3,8,10-11".
+std::set<int> parse_cpu_list(const std::string & list);
+
+// Reads the topology from the affinity mask, the cgroup (v1 or v2) cpuset
+// and CPU quota, and /sys/devices/system/{cpu,node}. Anything that cannot
+// be read falls back to treating each CPU in the affinity mask as a core
+// on a single socket and NUMA node.
+cpu_topology read_topology();
+
+// Default omp_num_threads values for a topology: powers of two, multiples
+// of the cores per NUMA node and per socket when there are several of
+// more than one core, and all cores, capped at the usable cores. All hardware threads are added when SMT is available.
+std::list<std::string> topology_thread_space(const cpu_topology & topology);
@@ -0,0 +1,213 @@
+//  APEX OpenMP Policy
+//
+//  Copyright (c) 2015 University of Oregon
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <cstring>
+#include <stdio.h>
+
+#include "trace.hpp"
+
+std::atomic<bool> trace_enabled{false};
+thread_local trace_ring * trace_thread_ring = nullptr;
+
+static std::mutex trace_lock;
+static std::vector<trace_ring *> trace_rings;
+static std::vector<std::pair<uint32_t, std::string>> trace_pending_names;
+static size_t trace_ring_records = 8192;
+static FILE * trace_file = nullptr;
+static std::thread trace_flusher;
+static std::condition_variable trace_wakeup;
+static bool trace_stopping = false;
+
+trace_ring::trace_ring(size_t capacity, uint16_t index) : index(index) {
+    size_t size = 16;
+    while(size < capacity) {
+        size <<= 1;
+    }
+    slots.resize(size);
+    mask = size - 1;
+}
+
+uint64_t trace_ring::drain(std::vector<trace_record> & out) {
+    const uint64_t end = head.load(std::memory_order_acquire);
+    uint64_t position = tail.load(std::memory_order_relaxed);
+    for(; position != end; ++position) {
+        out.push_back(slots[position & mask]);
+    }
+    tail.store(position, std::memory_order_release);
+    const uint64_t lost = dropped.exchange(0, std::memory_order_relaxed);
+    return lost;
+}
+
+// Rings are never freed: a thread may still hold its pointer after the
+// trace is closed.
+trace_ring * trace_attach() {
+    std::lock_guard<std::mutex> guard(trace_lock);
+    if(!trace_enabled.load() || trace_rings.size() > UINT16_MAX) {
+        return nullptr;
+    }
+    trace_thread_ring = new trace_ring(trace_ring_records, static_cast<uint16_t>(trace_rings.size()));
+    trace_rings.push_back(trace_thread_ring);
+    return trace_thread_ring;
+}
+
+static void write_chunk(uint32_t type, const void * data, size_t size) {
+    const uint32_t header[2] = {type, static_cast<uint32_t>(size)};
+    fwrite(header, sizeof(header), 1, trace_file);
+    fwrite(data, 1, size, trace_file);
+}
+
+// Takes the pending names and the list of rings under trace_lock and does
+// the file I/O without it, so a slow file system does not hold up threads
+// registering regions or rings. Only the flusher thread, or trace_close
+// once it has joined it, calls this.
+static void flush_trace() {
+    std::vector<std::pair<uint32_t, std::string>> names;
+    std::vector<trace_ring *> rings;
+    {
+        std::lock_guard<std::mutex> guard(trace_lock);
+        names.swap(trace_pending_names);
+        rings = trace_rings;
+    }
+    for(const auto & name : names) {
+        std::string payload(reinterpret_cast<const char *>(&name.first), sizeof(name.first));
+        payload += name.second;
+        write_chunk(TRACE_REGION_NAME, payload.data(), payload.size());
+    }
+    std::vector<trace_record> records;
+    uint64_t dropped = 0;
+    for(trace_ring * ring : rings) {
+        dropped += ring->drain(records);
+    }
+    // Bounded chunks keep the length field small.
+    const size_t per_chunk = 65536;
+    for(size_t offset = 0; offset < records.size(); offset += per_chunk) {
+        const size_t count = std::min(per_chunk, records.size() - offset);
+        write_chunk(TRACE_RECORDS, records.data() + offset, count * sizeof(trace_record));
+    }
+    if(dropped > 0) {
+        write_chunk(TRACE_DROPPED, &dropped, sizeof(dropped));
+    }
+    fflush(trace_file);
+}
+
+bool trace_open(const std::string & filename, size_t ring_records, unsigned interval_ms) {
+    std::lock_guard<std::mutex> guard(trace_lock);
+    if(trace_file != nullptr) {
+        return true;
+    }
+    trace_file = fopen(filename.c_str(), "wb");
+    if(trace_file == nullptr) {
+        std::cerr << "Unable to open trace file " << filename << std::endl;
+        return false;
+    }
+    trace_file_header header;
+    memcpy(header.magic, trace_magic, sizeof(trace_magic));
+    header.version = trace_version;
+    header.record_size = sizeof(trace_record);
+    fwrite(&header, sizeof(header), 1, trace_file);
+    trace_ring_records = ring_records;
+    trace_stopping = false;
+    trace_enabled.store(true);
+    trace_flusher = std::thread([interval_ms]() {
+        std::unique_lock<std::mutex> lock(trace_lock);
+        while(!trace_stopping) {
+            trace_wakeup.wait_for(lock, std::chrono::milliseconds(interval_ms));
+            lock.unlock();
+            flush_trace();
+            lock.lock();
+        }
+    });
+    return true;
+}
+
+void trace_close() {
+    {
+        std::lock_guard<std::mutex> guard(trace_lock);
+        if(trace_file == nullptr) {
+            return;
+        }
+        trace_enabled.store(false);
+        trace_stopping = true;
+    }
+    trace_wakeup.notify_all();
+    trace_flusher.join();
+    flush_trace();
+    std::lock_guard<std::mutex> guard(trace_lock);
+    fclose(trace_file);
+    trace_file = nullptr;
+}
+
+void trace_region(uint32_t id, const std::string & name) {
+    std::lock_guard<std::mutex> guard(trace_lock);
+    if(trace_file != nullptr) {
+        trace_pending_names.emplace_back(id, name);
+    }
+}
+
+static uint32_t byte_swap(uint32_t value) {
+    return (value >> 24) | ((value >> 8) & 0xff00) | ((value << 8) & 0xff0000) | (value << 24);
+}
+
+bool read_trace(const std::string & filename, std::vector<trace_record> & records,
+        std::unordered_map<uint32_t, std::string> & names, uint64_t & dropped) {
+    std::ifstream in(filename, std::ifstream::in | std::ifstream::binary);
+    if(!in.good()) {
+        std::cerr << "Unable to open trace file " << filename << std::endl;
+        return false;
+    }
+    const std::string contents((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    trace_file_header header;
+    if(contents.size() < sizeof(header)) {
+        std::cerr << filename << " is not a trace file" << std::endl;
+        return false;
+    }
+    memcpy(&header, contents.data(), sizeof(header));
+    if(memcmp(header.magic, trace_magic, sizeof(trace_magic)) == 0 && header.version == byte_swap(trace_version)) {
+        std::cerr << "Trace file " << filename << " was written on a machine of the other byte order" << std::endl;
+        return false;
+    }
+    if(memcmp(header.magic, trace_magic, sizeof(trace_magic)) != 0 || header.version != trace_version
+            || header.record_size != sizeof(trace_record)) {
+        std::cerr << filename << " is not a version " << trace_version << " trace file" << std::endl;
+        return false;
+    }
+    dropped = 0;
+    size_t offset = sizeof(header);
+    while(offset + 2 * sizeof(uint32_t) <= contents.size()) {
+        uint32_t chunk[2];
+        memcpy(chunk, contents.data() + offset, sizeof(chunk));
+        const char * payload = contents.data() + offset + sizeof(chunk);
+        if(offset + sizeof(chunk) + chunk[1] > contents.size()) {
+            std::cerr << "Ignoring incomplete chunk at offset " << offset << " of trace " << filename << std::endl;
+            break;
+        }
+        if(chunk[0] == TRACE_RECORDS) {
+            const size_t count = chunk[1] / sizeof(trace_record);
+            const size_t first = records.size();
+            records.resize(first + count);
+            memcpy(records.data() + first, payload, count * sizeof(trace_record));
+        } else if(chunk[0] == TRACE_REGION_NAME && chunk[1] >= sizeof(uint32_t)) {
+            uint32_t id;
+            memcpy(&id, payload, sizeof(id));
+            names[id].assign(payload + sizeof(id), chunk[1] - sizeof(id));
+        } else if(chunk[0] == TRACE_DROPPED && chunk[1] == sizeof(uint64_t)) {
+            uint64_t count;
+            memcpy(&count, payload, sizeof(count));
+            dropped += count;
+        }
+        offset += sizeof(chunk) + chunk[1];
+    }
+    return true;
+}
@@ -0,0 +1,126 @@
+//  APEX OpenMP Policy
+//
+//  Copyright (c) 2015 University of Oregon
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+// Binary trace of region invocations (APEX_OPENMP_TRACE). Integers are
+// stored in the byte order of the machine that wrote the file; a trace
+// from a machine of the other byte order is recognized by its byte-swapped
+// version and rejected. The file is
+//
+//   header
+//   chunks: uint32 type, uint32 payload length, payload
+//
+// TRACE_RECORDS chunks hold an array of trace_record. TRACE_REGION_NAME
+// chunks hold a uint32 region id followed by the name bytes, and come
+// before the first record of that region. TRACE_DROPPED chunks hold a
+// uint64 count of records lost because a thread's ring was full. A trace
+// cut short by a crash is valid up to its last complete chunk.
+static const char trace_magic[8] = {'A', 'P', 'X', 'O', 'M', 'P', 'T', '\0'};
+static const uint32_t trace_version = 1;
+
+struct trace_file_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+};
+
+enum trace_chunk_type : uint32_t {
+    TRACE_RECORDS = 1,
+    TRACE_REGION_NAME = 2,
+    TRACE_DROPPED = 3
+};
+
+// One region invocation and the config it ran with.
+struct trace_record {
+    uint64_t start;           // steady clock, nanoseconds
+    uint64_t stop;
+    uint32_t region;
+    int32_t chunk;
+    int16_t threads;
+    uint16_t thread;          // index of the recording thread
+    int8_t schedule;          // history_schedule_code, | trace_schedule_monotonic
+    uint8_t flags;
+    int8_t dynamic;           // -1 if not tuned
+    int8_t max_active_levels; // -1 if not tuned
+};
+
+static const int8_t trace_schedule_monotonic = 0x40;
+static const uint8_t trace_flag_trial = 1;     // part of a tuning trial
+static const uint8_t trace_flag_converged = 2; // the region had converged
+static const uint8_t trace_flag_online = 4;    // chosen by the online bandit
+
+// Single-producer single-consumer ring of records, one per thread. The
+// owning thread pushes; the flusher thread drains. A full ring drops the
+// record rather than blocking the application.
+class trace_ring {
+    private:
+        std::vector<trace_record> slots;
+        uint64_t mask;
+        uint16_t index;
+        std::atomic<uint64_t> head{0};
+        std::atomic<uint64_t> tail{0};
+        std::atomic<uint64_t> dropped{0};
+
+    public:
+        // capacity is rounded up to a power of two.
+        trace_ring(size_t capacity, uint16_t index);
+
+        void push(const trace_record & record) {
+            const uint64_t position = head.load(std::memory_order_relaxed);
+            if(position - tail.load(std::memory_order_acquire) > mask) {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            trace_record & slot = slots[position & mask];
+            slot = record;
+            slot.thread = index;
+            head.store(position + 1, std::memory_order_release);
+        }
+
+        // Appends the pending records to out; returns the number of records
+        // dropped since the last drain.
+        uint64_t drain(std::vector<trace_record> & out);
+};
+
+extern std::atomic<bool> trace_enabled;
+extern thread_local trace_ring * trace_thread_ring;
+trace_ring * trace_attach();
+
+// Starts a trace with a ring of ring_records per thread, flushed to
+// filename every interval_ms by a background thread.
+bool trace_open(const std::string & filename, size_t ring_records, unsigned interval_ms);
+// Stops the flusher and writes what is left.
+void trace_close();
+void trace_region(uint32_t id, const std::string & name);
+
+inline bool trace_is_open() {
+    return trace_enabled.load(std::memory_order_relaxed);
+}
+
+inline void trace_invocation(const trace_record & record) {
+    trace_ring * ring = trace_thread_ring;
+    if(ring == nullptr) {
+        ring = trace_attach();
+        if(ring == nullptr) {
+            return;
+        }
+    }
+    ring->push(record);
+}
+
+// Reads a trace file; records are returned in file order, which is only
+// roughly time order across threads.
+bool read_trace(const std::string & filename, std::vector<trace_record> & records,
+        std::unordered_map<uint32_t, std::string> & names, uint64_t & dropped);
@@ -0,0 +1,137 @@
+//  Copyright (c) 2015 University of Oregon
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// Reads a trace written by the APEX OpenMP policy (APEX_OPENMP_TRACE) and
+// prints, per region, the invocations, the time spent and the time lost
+// while tuning: the time the trial invocations took beyond what the best
+// config measured would have. With --curve it prints the convergence curve
+// instead, one line per trial (a run of invocations with one config).
+//
+#include <stdlib.h>
+#include <stdio.h>
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "history.hpp"
+#include "trace.hpp"
+
+typedef std::tuple<int, int, int, int, int> trace_config;
+
+static trace_config config_of(const trace_record & record) {
+    return trace_config(record.threads, record.schedule, record.chunk, record.dynamic, record.max_active_levels);
+}
+
+static std::string schedule_of(const trace_record & record) {
+    int32_t code = record.schedule & ~trace_schedule_monotonic;
+    if(record.schedule & trace_schedule_monotonic) {
+        code |= history_schedule_monotonic;
+    }
+    const std::string name = history_schedule_name(code);
+    return name.empty() ? std::to_string(record.schedule) : name;
+}
+
+static double seconds(const trace_record & record) {
+    return (record.stop - record.start) * 1e-9;
+}
+
+int main (int argc, char *argv[]) {
+    bool curve = false;
+    std::string filename;
+    if (argc == 3 && std::string(argv[1]) == "--curve") {
+        curve = true;
+        filename = argv[2];
+    } else if (argc == 2) {
+        filename = argv[1];
+    } else {
+        std::cout << "Usage: " << argv[0] << " [--curve] <trace file>" << std::endl;
+        exit(0);
+    }
+
+    std::vector<trace_record> records;
+    std::unordered_map<uint32_t, std::string> names;
+    uint64_t dropped = 0;
+    if(!read_trace(filename, records, names, dropped)) {
+        return 1;
+    }
+    if(dropped > 0) {
+        std::cerr << "WARNING: " << dropped << " invocations were dropped from the trace" << std::endl;
+    }
+
+    std::map<uint32_t, std::vector<trace_record>> regions;
+    for(const trace_record & record : records) {
+        regions[record.region].push_back(record);
+    }
+
+    if(curve) {
+        std::cout << "\"name\",\"trial\",\"num_threads\",\"schedule\",\"chunk_size\",\"calls\",\"mean\",\"best_so_far\"" << std::endl;
+    } else {
+        printf("%-48s %10s %10s %12s %12s %12s\n", "region", "calls", "trials", "total s", "tuning s", "lost s");
+    }
+    for(auto & item : regions) {
+        std::vector<trace_record> & invocations = item.second;
+        std::sort(invocations.begin(), invocations.end(), [](const trace_record & a, const trace_record & b) {
+            return a.start < b.start;
+        });
+        const auto name = names.find(item.first);
+        const std::string region = name == names.end() ? std::to_string(item.first) : name->second;
+
+        // Mean time of each config over all its invocations.
+        std::map<trace_config, std::pair<double, size_t>> configs;
+        for(const trace_record & record : invocations) {
+            std::pair<double, size_t> & total = configs[config_of(record)];
+            total.first += seconds(record);
+            ++total.second;
+        }
+        double best = std::numeric_limits<double>::infinity();
+        for(const auto & config : configs) {
+            best = std::min(best, config.second.first / config.second.second);
+        }
+
+        if(curve) {
+            size_t trial = 0;
+            double best_so_far = std::numeric_limits<double>::infinity();
+            for(size_t i = 0; i < invocations.size(); ) {
+                if(!(invocations[i].flags & trace_flag_trial)) {
+                    ++i;
+                    continue;
+                }
+                size_t end = i;
+                double total = 0.0;
+                while(end < invocations.size() && (invocations[end].flags & trace_flag_trial)
+                        && config_of(invocations[end]) == config_of(invocations[i])) {
+                    total += seconds(invocations[end]);
+                    ++end;
+                }
+                const double mean = total / (end - i);
+                best_so_far = std::min(best_so_far, mean);
+                const trace_record & record = invocations[i];
+                std::cout << "\"" << region << "\"," << ++trial << "," << record.threads << ",\"" << schedule_of(record)
+                    << "\"," << record.chunk << "," << (end - i) << "," << mean << "," << best_so_far << std::endl;
+                i = end;
+            }
+            continue;
+        }
+
+        size_t trial_calls = 0;
+        double total = 0.0;
+        double tuning = 0.0;
+        for(const trace_record & record : invocations) {
+            total += seconds(record);
+            if(record.flags & trace_flag_trial) {
+                tuning += seconds(record);
+                ++trial_calls;
+            }
+        }
+        const double lost = std::max(0.0, tuning - trial_calls * best);
+        printf("%-48s %10zu %10zu %12.6f %12.6f %12.6f\n", region.c_str(), invocations.size(), trial_calls, total, tuning, lost);
+    }
+    return 0;
+}
@@ -0,0 +1,337 @@
+//  APEX OpenMP Policy
+//
+//  Copyright (c) 2015 University of Oregon
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include <iostream>
+#include <fstream>
+#include <set>
+#include <algorithm>
+#include <fnmatch.h>
+
+#include <rapidjson/document.h>
+#include <rapidjson/istreamwrapper.h>
+
+#include "tuning_space.hpp"
+
+int tuning_space::dimension(const std::string & name) const {
+    for(size_t d = 0; d < dimensions.size(); ++d) {
+        if(dimensions[d].name == name) {
+            return static_cast<int>(d);
+        }
+    }
+    return -1;
+}
+
+static bool contains(const std::vector<std::string> & values, const std::string & value) {
+    return std::find(values.begin(), values.end(), value) != values.end();
+}
+
+bool tuning_space::normalize(search_point & point) const {
+    for(const space_constraint & constraint : constraints) {
+        const int when = dimension(constraint.when);
+        const int param = dimension(constraint.param);
+        if(when < 0 || param < 0 || !contains(constraint.when_values, dimensions[when].values[point[when]])) {
+            continue;
+        }
+        if(!constraint.fixed.empty()) {
+            const int fixed = search_index_of(dimensions[param], constraint.fixed);
+            if(fixed >= 0) {
+                point[param] = fixed;
+            }
+        } else if(contains(constraint.excluded, dimensions[param].values[point[param]])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t tuning_space::size() const {
+    if(dimensions.empty()) {
+        return 0;
+    }
+    std::set<search_point> distinct;
+    search_point point(dimensions.size(), 0);
+    while(true) {
+        search_point normalized = point;
+        if(normalize(normalized)) {
+            distinct.insert(normalized);
+        }
+        size_t d = 0;
+        while(d < dimensions.size() && ++point[d] == static_cast<int>(dimensions[d].values.size())) {
+            point[d++] = 0;
+        }
+        if(d == dimensions.size()) {
+            break;
+        }
+    }
+    return distinct.size();
+}
+
+typedef rapidjson::Value json_value;
+
+static bool parse_scalar(const json_value & value, std::string & result) {
+    if(value.IsInt()) {
+        result = std::to_string(value.GetInt());
+    } else if(value.IsString()) {
+        result = std::string(value.GetString(), value.GetStringLength());
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// A scalar or an array of scalars.
+static bool parse_values(const json_value & value, std::vector<std::string> & values) {
+    std::string scalar;
+    if(parse_scalar(value, scalar)) {
+        values.push_back(scalar);
+        return true;
+    }
+    if(!value.IsArray()) {
+        return false;
+    }
+    for(auto itr = value.Begin(); itr != value.End(); ++itr) {
+        if(!parse_scalar(*itr, scalar)) {
+            return false;
+        }
+        values.push_back(scalar);
+    }
+    return true;
+}
+
+static bool parse_bound(const json_value & value, const std::map<std::string, int> & symbols, int & bound) {
+    if(value.IsInt()) {
+        bound = value.GetInt();
+        return true;
+    }
+    if(value.IsString()) {
+        const auto symbol = symbols.find(value.GetString());
+        if(symbol != symbols.end()) {
+            bound = symbol->second;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool parse_dimension(const std::string & name, const json_value & spec, const std::map<std::string, int> & symbols,
+        search_dimension & dimension) {
+    dimension.name = name;
+    if(spec.IsArray()) {
+        if(!parse_values(spec, dimension.values)) {
+            std::cerr << "Parameter space file's '" << name << "' member must contain only integers or strings" << std::endl;
+            return false;
+        }
+    } else if(spec.IsObject() && spec.HasMember("type") && spec["type"].IsString()) {
+        const std::string type = spec["type"].GetString();
+        if(type == "enum") {
+            if(!spec.HasMember("values") || !spec["values"].IsArray() || !parse_values(spec["values"], dimension.values)) {
+                std::cerr << "Parameter space file's '" << name << "' enum must have a 'values' array of integers or strings" << std::endl;
+                return false;
+            }
+        } else if(type == "integer") {
+            int min = 0;
+            int max = 0;
+            if(!spec.HasMember("min") || !spec.HasMember("max")
+                    || !parse_bound(spec["min"], symbols, min) || !parse_bound(spec["max"], symbols, max)) {
+                std::cerr << "Parameter space file's '" << name << "' range must have integer 'min' and 'max' members" << std::endl;
+                return false;
+            }
+            const bool log2 = spec.HasMember("step") && spec["step"].IsString() && std::string(spec["step"].GetString()) == "log2";
+            const int step = (spec.HasMember("step") && spec["step"].IsInt()) ? spec["step"].GetInt() : 1;
+            if((log2 && min < 1) || (!log2 && step < 1) || (spec.HasMember("step") && !log2 && !spec["step"].IsInt())) {
+                std::cerr << "Parameter space file's '" << name << "' range needs a positive step, or \"log2\" with min >= 1" << std::endl;
+                return false;
+            }
+            for(long long value = min; value <= max; value = log2 ? value * 2 : value + step) {
+                dimension.values.push_back(std::to_string(value));
+            }
+        } else {
+            std::cerr << "Parameter space file's '" << name << "' has unknown type '" << type << "'" << std::endl;
+            return false;
+        }
+    } else {
+        std::cerr << "Parameter space file's '" << name << "' member must be an array or an object with a 'type'" << std::endl;
+        return false;
+    }
+    if(dimension.values.empty()) {
+        std::cerr << "Parameter space file's '" << name << "' member has no values" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+static bool parse_dimensions(const json_value & spec, const std::map<std::string, int> & symbols, search_space & dimensions) {
+    if(!spec.IsObject()) {
+        std::cerr << "Parameter space file's 'tuning_space' member must be an object." << std::endl;
+        return false;
+    }
+    for(auto itr = spec.MemberBegin(); itr != spec.MemberEnd(); ++itr) {
+        search_dimension dimension;
+        if(!parse_dimension(itr->name.GetString(), itr->value, symbols, dimension)) {
+            return false;
+        }
+        dimensions.push_back(dimension);
+    }
+    return true;
+}
+
+static bool parse_constraints(const json_value & spec, std::vector<space_constraint> & constraints) {
+    if(!spec.IsArray()) {
+        std::cerr << "Parameter space file's 'constraints' member must be an array." << std::endl;
+        return false;
+    }
+    for(auto itr = spec.Begin(); itr != spec.End(); ++itr) {
+        const json_value & rule = *itr;
+        const bool fix = rule.IsObject() && rule.HasMember("then");
+        const bool exclude = rule.IsObject() && rule.HasMember("exclude");
+        if(!rule.IsObject() || !rule.HasMember("if") || !rule["if"].IsObject() || rule["if"].MemberCount() != 1 || fix == exclude) {
+            std::cerr << "Each constraint must have an 'if' object with one parameter and either 'then' or 'exclude'." << std::endl;
+            return false;
+        }
+        const auto condition = rule["if"].MemberBegin();
+        const json_value & action = fix ? rule["then"] : rule["exclude"];
+        if(!action.IsObject()) {
+            std::cerr << "A constraint's 'then' and 'exclude' members must be objects." << std::endl;
+            return false;
+        }
+        for(auto target = action.MemberBegin(); target != action.MemberEnd(); ++target) {
+            space_constraint constraint;
+            constraint.when = condition->name.GetString();
+            constraint.param = target->name.GetString();
+            bool valid = parse_values(condition->value, constraint.when_values);
+            if(fix) {
+                valid = valid && parse_scalar(target->value, constraint.fixed);
+            } else {
+                valid = valid && parse_values(target->value, constraint.excluded);
+            }
+            if(!valid) {
+                std::cerr << "Constraint on '" << constraint.when << "' and '" << constraint.param << "' must use integers or strings." << std::endl;
+                return false;
+            }
+            constraints.push_back(constraint);
+        }
+    }
+    return true;
+}
+
+bool tuning_space_config::parse(const std::string & filename, const std::map<std::string, int> & symbols) {
+    using namespace rapidjson;
+    std::ifstream space_file(filename, std::ifstream::in);
+    if(!space_file.good()) {
+        std::cerr << "Unable to open parameter space specification file " << filename << std::endl;
+        return false;
+    }
+    IStreamWrapper space_file_wrapper(space_file);
+    Document document;
+    document.ParseStream(space_file_wrapper);
+    if(!document.IsObject()) {
+        std::cerr << "Parameter space file root must be an object." << std::endl;
+        return false;
+    }
+    if(!document.HasMember("tuning_space")) {
+        std::cerr << "Parameter space file root must contain a member named 'tuning_space'." << std::endl;
+        return false;
+    }
+    global = tuning_space();
+    overrides.clear();
+    if(!parse_dimensions(document["tuning_space"], symbols, global.dimensions)) {
+        return false;
+    }
+    if(document.HasMember("constraints") && !parse_constraints(document["constraints"], global.constraints)) {
+        return false;
+    }
+    if(document.HasMember("regions")) {
+        const json_value & regions = document["regions"];
+        if(!regions.IsArray()) {
+            std::cerr << "Parameter space file's 'regions' member must be an array." << std::endl;
+            return false;
+        }
+        for(auto itr = regions.Begin(); itr != regions.End(); ++itr) {
+            if(!itr->IsObject() || !itr->HasMember("match") || !(*itr)["match"].IsString()) {
+                std::cerr << "Each entry of 'regions' must be an object with a 'match' pattern." << std::endl;
+                return false;
+            }
+            region_override entry;
+            entry.pattern = (*itr)["match"].GetString();
+            if(itr->HasMember("tuning_space") && !parse_dimensions((*itr)["tuning_space"], symbols, entry.space.dimensions)) {
+                return false;
+            }
+            if(itr->HasMember("constraints") && !parse_constraints((*itr)["constraints"], entry.space.constraints)) {
+                return false;
+            }
+            overrides.push_back(entry);
+        }
+    }
+    return true;
+}
+
+void tuning_space_config::add_defaults(const search_space & defaults) {
+    for(const search_dimension & dimension : defaults) {
+        if(global.dimension(dimension.name) < 0) {
+            global.dimensions.push_back(dimension);
+        }
+    }
+}
+
+void tuning_space_config::add_constraint(const space_constraint & constraint) {
+    global.constraints.push_back(constraint);
+}
+
+static bool remove_from(search_space & dimensions, const std::string & name) {
+    const auto end = std::remove_if(dimensions.begin(), dimensions.end(),
+            [&name](const search_dimension & dimension) { return dimension.name == name; });
+    const bool removed = end != dimensions.end();
+    dimensions.erase(end, dimensions.end());
+    return removed;
+}
+
+bool tuning_space_config::remove_dimension(const std::string & name) {
+    bool removed = remove_from(global.dimensions, name);
+    for(region_override & entry : overrides) {
+        removed = remove_from(entry.space.dimensions, name) || removed;
+    }
+    return removed;
+}
+
+tuning_space tuning_space_config::for_region(const std::string & name) const {
+    tuning_space space = global;
+    for(const region_override & entry : overrides) {
+        if(fnmatch(entry.pattern.c_str(), name.c_str(), 0) != 0) {
+            continue;
+        }
+        for(const search_dimension & dimension : entry.space.dimensions) {
+            const int d = space.dimension(dimension.name);
+            if(d < 0) {
+                space.dimensions.push_back(dimension);
+            } else {
+                space.dimensions[d] = dimension;
+            }
+        }
+        space.constraints.insert(space.constraints.end(), entry.space.constraints.begin(), entry.space.constraints.end());
+        break;
+    }
+    std::vector<space_constraint> constraints;
+    for(const space_constraint & constraint : space.constraints) {
+        if(space.dimension(constraint.when) >= 0 && space.dimension(constraint.param) >= 0) {
+            constraints.push_back(constraint);
+        }
+    }
+    space.constraints.swap(constraints);
+    return space;
+}
+
+const tuning_space & tuning_space_config::global_space() const {
+    return global;
+}
+
+size_t tuning_space_config::override_count() const {
+    return overrides.size();
+}
+
+const std::string & tuning_space_config::override_pattern(size_t index) const {
+    return overrides[index].pattern;
+}
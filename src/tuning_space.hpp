@@ -0,0 +1,96 @@
+//  APEX OpenMP Policy
+//
+//  Copyright (c) 2015 University of Oregon
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "search.hpp"
+
+// A rule between two parameters: when parameter `when` takes one of
+// when_values, parameter `param` is either fixed to `fixed` (the points
+// differing only in param are equivalent, e.g. the chunk size under the
+// auto schedule) or must not take any of the excluded values.
+struct space_constraint {
+    std::string when;
+    std::vector<std::string> when_values;
+    std::string param;
+    std::string fixed;
+    std::vector<std::string> excluded;
+};
+
+// A search space together with the constraints between its dimensions.
+struct tuning_space {
+    search_space dimensions;
+    std::vector<space_constraint> constraints;
+
+    // Index of the named dimension, or -1.
+    int dimension(const std::string & name) const;
+    // Returns false if point is excluded by a constraint. Otherwise rewrites
+    // the fixed parameters of point, so equivalent points compare equal.
+    bool normalize(search_point & point) const;
+    // Number of distinct points that normalize() accepts.
+    size_t size() const;
+};
+
+// A tuning space read from a JSON file:
+//
+//   {
+//     "tuning_space": {
+//       "omp_num_threads": {"type": "integer", "min": 2, "max": "cores", "step": "log2"},
+//       "omp_schedule":    ["static", "dynamic", "guided", "auto"],
+//       "omp_chunk_size":  {"type": "integer", "min": 1, "max": 512, "step": "log2"}
+//     },
+//     "constraints": [
+//       {"if": {"omp_schedule": "auto"}, "then": {"omp_chunk_size": 1}},
+//       {"if": {"omp_num_threads": [2, 4]}, "exclude": {"omp_schedule": ["guided"]}}
+//     ],
+//     "regions": [
+//       {"match": "OpenMP_PARALLEL_REGION: hot.cpp:*",
+//        "tuning_space": {"omp_chunk_size": {"type": "integer", "min": 1, "max": 64, "step": 1}}}
+//     ]
+//   }
+//
+// A parameter is an array of values (an enum), {"type": "enum", "values":
+// [...]}, or an integer range whose step is a number or "log2". Range
+// bounds may name a symbol such as "cores". Region overrides are matched
+// in order with fnmatch() patterns; the first match replaces the listed
+// parameters and adds its constraints to the global ones.
+//
+// Besides omp_num_threads, omp_schedule and omp_chunk_size, the policy
+// knows omp_schedule_modifier ("monotonic", "nonmonotonic"), omp_dynamic
+// ("true", "false") and omp_max_active_levels.
+class tuning_space_config {
+    private:
+        struct region_override {
+            std::string pattern;
+            tuning_space space;
+        };
+
+        tuning_space global;
+        std::vector<region_override> overrides;
+
+    public:
+        // Returns false (after printing why) if the file is unusable.
+        bool parse(const std::string & filename, const std::map<std::string, int> & symbols);
+        // Adds the dimensions of defaults that the global space lacks.
+        void add_defaults(const search_space & defaults);
+        // Applies to every region.
+        void add_constraint(const space_constraint & constraint);
+        // Removes the dimension from the global space and every override;
+        // returns true if any had it.
+        bool remove_dimension(const std::string & name);
+        // The space for a region: the global space with the first matching
+        // override applied. Constraints on missing dimensions are dropped.
+        tuning_space for_region(const std::string & name) const;
+
+        const tuning_space & global_space() const;
+        size_t override_count() const;
+        const std::string & override_pattern(size_t index) const;
+};
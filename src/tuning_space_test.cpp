@@ -0,0 +1,168 @@
+//  Copyright (c) 2015 University of Oregon
+//
+//  Distributed under the Boost Software License, Version 1.0. (See accompanying
+//  file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//
+// The tuning space schema: ranges, enums and symbol bounds are expanded,
+// constraints fix or exclude points, region overrides are matched with
+// fnmatch() patterns, and unusable files are rejected. Also the default
+// omp_num_threads values derived from the CPU topology.
+//
+//   tuning_space_test [scratch directory]
+//
+#undef NDEBUG
+#include <cassert>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include "topology.hpp"
+#include "tuning_space.hpp"
+
+static void write_file(const std::string & filename, const std::string & contents) {
+    std::ofstream out(filename, std::ofstream::out | std::ofstream::trunc);
+    out << contents;
+}
+
+static std::vector<std::string> values_of(const tuning_space & space, const std::string & name) {
+    const int d = space.dimension(name);
+    assert(d >= 0);
+    return space.dimensions[d].values;
+}
+
+static search_point point_of(const tuning_space & space, const std::map<std::string, std::string> & values) {
+    search_point point(space.dimensions.size(), 0);
+    for(const auto & value : values) {
+        const int d = space.dimension(value.first);
+        assert(d >= 0);
+        point[d] = search_index_of(space.dimensions[d], value.second);
+    }
+    return point;
+}
+
+int main (int argc, char *argv[]) {
+    const std::string directory = argc > 1 ? argv[1] : "/tmp";
+    const std::string path = directory + "/tuning_space_test." + std::to_string(getpid());
+    const std::map<std::string, int> symbols = {{"cores", 8}};
+
+    write_file(path, "{\n"
+            "  \"tuning_space\": {\n"
+            "    \"omp_num_threads\": {\"type\": \"integer\", \"min\": 2, \"max\": \"cores\", \"step\": \"log2\"},\n"
+            "    \"omp_schedule\": [\"static\", \"dynamic\", \"guided\", \"auto\"],\n"
+            "    \"omp_chunk_size\": {\"type\": \"integer\", \"min\": 1, \"max\": 7, \"step\": 2}\n"
+            "  },\n"
+            "  \"constraints\": [\n"
+            "    {\"if\": {\"omp_schedule\": \"auto\"}, \"then\": {\"omp_chunk_size\": 1}},\n"
+            "    {\"if\": {\"omp_num_threads\": [2, 4]}, \"exclude\": {\"omp_schedule\": [\"guided\"]}}\n"
+            "  ],\n"
+            "  \"regions\": [\n"
+            "    {\"match\": \"OpenMP_PARALLEL_REGION: hot.cpp:*\",\n"
+            "     \"tuning_space\": {\n"
+            "       \"omp_chunk_size\": {\"type\": \"enum\", \"values\": [16, 32]},\n"
+            "       \"omp_dynamic\": [\"true\", \"false\"]\n"
+            "     },\n"
+            "     \"constraints\": [{\"if\": {\"omp_dynamic\": \"true\"}, \"exclude\": {\"omp_num_threads\": 8}}]},\n"
+            "    {\"match\": \"OpenMP_PARALLEL_REGION: *\",\n"
+            "     \"tuning_space\": {\"omp_chunk_size\": [64]}}\n"
+            "  ]\n"
+            "}\n");
+    tuning_space_config config;
+    assert(config.parse(path, symbols));
+    const tuning_space & global = config.global_space();
+    assert(global.dimensions.size() == 3);
+    assert(values_of(global, "omp_num_threads") == std::vector<std::string>({"2", "4", "8"}));
+    assert(values_of(global, "omp_schedule") == std::vector<std::string>({"static", "dynamic", "guided", "auto"}));
+    assert(values_of(global, "omp_chunk_size") == std::vector<std::string>({"1", "3", "5", "7"}));
+    assert(global.constraints.size() == 2);
+    assert(config.override_count() == 2);
+    assert(config.override_pattern(0) == "OpenMP_PARALLEL_REGION: hot.cpp:*");
+
+    // The auto schedule fixes the chunk size, so its points collapse into one.
+    search_point point = point_of(global, {{"omp_num_threads", "8"}, {"omp_schedule", "auto"}, {"omp_chunk_size", "5"}});
+    assert(global.normalize(point));
+    assert(point == point_of(global, {{"omp_num_threads", "8"}, {"omp_schedule", "auto"}, {"omp_chunk_size", "1"}}));
+    point = point_of(global, {{"omp_num_threads", "4"}, {"omp_schedule", "guided"}, {"omp_chunk_size", "3"}});
+    assert(!global.normalize(point));
+    point = point_of(global, {{"omp_num_threads", "8"}, {"omp_schedule", "guided"}, {"omp_chunk_size", "3"}});
+    assert(global.normalize(point));
+    // With 8 threads: 3 schedules with 4 chunk sizes plus auto; with 2 and 4
+    // threads guided is excluded.
+    assert(global.size() == 13 + 9 + 9);
+
+    // The first matching override replaces the chunk sizes, adds omp_dynamic
+    // and its constraint; a region matching none gets the global space.
+    const tuning_space hot = config.for_region("OpenMP_PARALLEL_REGION: hot.cpp:10");
+    assert(hot.dimensions.size() == 4);
+    assert(values_of(hot, "omp_chunk_size") == std::vector<std::string>({"16", "32"}));
+    assert(values_of(hot, "omp_dynamic") == std::vector<std::string>({"true", "false"}));
+    assert(hot.constraints.size() == 3);
+    point = point_of(hot, {{"omp_num_threads", "8"}, {"omp_schedule", "static"}, {"omp_chunk_size", "16"}, {"omp_dynamic", "true"}});
+    assert(!hot.normalize(point));
+    const tuning_space cold = config.for_region("OpenMP_PARALLEL_REGION: cold.cpp:10");
+    assert(values_of(cold, "omp_chunk_size") == std::vector<std::string>({"64"}));
+    const tuning_space other = config.for_region("other");
+    assert(other.dimensions.size() == 3 && other.constraints.size() == 2);
+
+    // Defaults only add dimensions the file leaves out.
+    search_space defaults(2);
+    defaults[0].name = "omp_num_threads";
+    defaults[0].values = {"1"};
+    defaults[1].name = "omp_max_active_levels";
+    defaults[1].values = {"1", "2"};
+    config.add_defaults(defaults);
+    assert(values_of(config.global_space(), "omp_num_threads").size() == 3);
+    assert(values_of(config.global_space(), "omp_max_active_levels").size() == 2);
+
+    // Constraints on a removed dimension are dropped from every region.
+    assert(config.remove_dimension("omp_schedule"));
+    assert(!config.remove_dimension("omp_schedule"));
+    assert(config.for_region("other").constraints.empty());
+    assert(config.for_region("other").size() == 3 * 4 * 2);
+    assert(config.for_region("OpenMP_PARALLEL_REGION: hot.cpp:10").constraints.size() == 1);
+
+    // Files that cannot be used are rejected rather than half applied.
+    const std::vector<std::string> invalid = {
+        "{\"tuning_space\": ",
+        "[]",
+        "{\"constraints\": []}",
+        "{\"tuning_space\": {\"omp_num_threads\": {\"type\": \"integer\", \"min\": 1, \"max\": \"sockets\"}}}",
+        "{\"tuning_space\": {\"omp_num_threads\": {\"type\": \"integer\", \"min\": 1, \"max\": 8, \"step\": 0}}}",
+        "{\"tuning_space\": {\"omp_num_threads\": {\"type\": \"integer\", \"min\": 0, \"max\": 8, \"step\": \"log2\"}}}",
+        "{\"tuning_space\": {\"omp_num_threads\": {\"type\": \"integer\", \"min\": 8, \"max\": 1}}}",
+        "{\"tuning_space\": {\"omp_schedule\": {\"type\": \"set\", \"values\": [\"static\"]}}}",
+        "{\"tuning_space\": {\"omp_schedule\": [\"static\", 1.5]}}",
+        "{\"tuning_space\": {}, \"constraints\": [{\"if\": {\"a\": 1}, \"then\": {\"b\": 1}, \"exclude\": {\"b\": [2]}}]}",
+        "{\"tuning_space\": {}, \"constraints\": [{\"if\": {\"a\": 1, \"c\": 2}, \"then\": {\"b\": 1}}]}",
+        "{\"tuning_space\": {}, \"regions\": [{\"tuning_space\": {}}]}",
+    };
+    for(const std::string & contents : invalid) {
+        write_file(path, contents);
+        tuning_space_config rejected;
+        assert(!rejected.parse(path, symbols));
+    }
+    unlink(path.c_str());
+    tuning_space_config missing;
+    assert(!missing.parse(path, symbols));
+
+    // One-core sockets, as many VMs report, add no counts beyond the
+    // powers of two; several larger sockets add their multiples, and a
+    // single one below the quota adds nothing.
+    cpu_topology topology;
+    topology.cpus = topology.cores = topology.core_limit = topology.sockets = topology.numa_nodes = 64;
+    topology.cores_per_socket = topology.cores_per_numa_node = 1;
+    assert(topology_thread_space(topology) == std::list<std::string>({"2", "4", "8", "16", "32", "64"}));
+    topology.cpus = topology.cores = topology.core_limit = 24;
+    topology.sockets = topology.numa_nodes = 2;
+    topology.cores_per_socket = topology.cores_per_numa_node = 12;
+    assert(topology_thread_space(topology) == std::list<std::string>({"2", "4", "8", "12", "16", "24"}));
+    topology.core_limit = 16;
+    assert(topology_thread_space(topology) == std::list<std::string>({"2", "4", "8", "16"}));
+
+    std::cerr << "Test passed." << std::endl;
+    return 0;
+}